@@ -0,0 +1,275 @@
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "git-compat-util.h"
+#include "blob-cache.h"
+#include "config.h"
+#include "convert.h"
+#include "copy.h"
+#include "gettext.h"
+#include "hash.h"
+#include "hex.h"
+#include "object-store-ll.h"
+#include "path.h"
+#include "read-cache-ll.h"
+#include "strbuf.h"
+#include "wrapper.h"
+
+#ifdef HAVE_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+enum blob_cache_mode {
+	BLOB_CACHE_REFLINK = 0,
+	BLOB_CACHE_HARDLINK,
+};
+
+static struct {
+	int initialized;
+	char *dir; /* NULL if the cache is not used */
+	enum blob_cache_mode mode;
+} blob_cache;
+
+static void disable_blob_cache(void)
+{
+	FREE_AND_NULL(blob_cache.dir);
+}
+
+int blob_cache_enabled(void)
+{
+	const char *mode;
+
+	if (blob_cache.initialized)
+		return !!blob_cache.dir;
+	blob_cache.initialized = 1;
+
+	if (git_config_get_pathname("checkout.blobcache", &blob_cache.dir))
+		return 0;
+
+	if (!git_config_get_string_tmp("checkout.blobcachemode", &mode)) {
+		if (!strcmp(mode, "reflink"))
+			blob_cache.mode = BLOB_CACHE_REFLINK;
+		else if (!strcmp(mode, "hardlink"))
+			blob_cache.mode = BLOB_CACHE_HARDLINK;
+		else
+			die(_("invalid value for '%s': '%s'"),
+			    "checkout.blobCacheMode", mode);
+	}
+
+#ifndef HAVE_FICLONE
+	if (blob_cache.mode == BLOB_CACHE_REFLINK)
+		disable_blob_cache();
+#endif
+
+	return !!blob_cache.dir;
+}
+
+static int is_cacheable(const struct cache_entry *ce,
+			const struct conv_attrs *ca)
+{
+	struct stream_filter *filter;
+	int identity;
+
+	if (!S_ISREG(ce->ce_mode) || !blob_cache_enabled())
+		return 0;
+
+	/*
+	 * Only cache files that are written exactly as the blob, so that
+	 * every file created from the cache can be checked against the
+	 * object id in the index. This also leaves out external filters,
+	 * which may not be deterministic.
+	 */
+	filter = get_stream_filter_ca(ca, &ce->oid);
+	identity = filter && is_null_stream_filter(filter);
+	free_stream_filter(filter);
+	return identity;
+}
+
+static void blob_cache_path(struct strbuf *path, const struct cache_entry *ce)
+{
+	const char *hex = oid_to_hex(&ce->oid);
+
+	strbuf_addf(path, "%s/%.2s/%s%s", blob_cache.dir, hex, hex + 2,
+		    (ce->ce_mode & 0100) ? ".x" : "");
+}
+
+/*
+ * Whether the file at "path" holds the blob "oid". The cache may be
+ * shared with other repositories and users, so nothing read from it is
+ * trusted before this check.
+ */
+static int file_matches_blob(const char *path, const struct object_id *oid)
+{
+	struct object_id actual;
+	struct stat st;
+	void *buf = NULL;
+	size_t size;
+	int fd, ret = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+		goto out;
+	size = xsize_t(st.st_size);
+	if (size)
+		buf = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	hash_object_file(the_hash_algo, buf ? buf : "", size, OBJ_BLOB,
+			 &actual);
+	if (buf)
+		munmap(buf, size);
+	ret = oideq(&actual, oid);
+out:
+	close(fd);
+	return ret;
+}
+
+static int mkdir_shared(const char *path)
+{
+	if (mkdir(path, 0700)) {
+		if (errno != EEXIST)
+			return -1;
+		return 0;
+	}
+	return adjust_shared_perm(path);
+}
+
+/* Errors which mean that the cache cannot be used at all. */
+static int is_unsupported_errno(int err)
+{
+	return err == EXDEV || err == EOPNOTSUPP || err == ENOTTY ||
+	       err == EINVAL || err == ENOSYS || err == EPERM;
+}
+
+static int clone_fd(int dst, int src)
+{
+#ifdef HAVE_FICLONE
+	return ioctl(dst, FICLONE, src);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int blob_cache_checkout(const struct cache_entry *ce,
+			const struct conv_attrs *ca, const char *path)
+{
+	struct strbuf cached = STRBUF_INIT;
+	int src = -1, dst = -1, ret = -1;
+
+	if (!is_cacheable(ce, ca))
+		return -1;
+	blob_cache_path(&cached, ce);
+
+	if (blob_cache.mode == BLOB_CACHE_HARDLINK) {
+		if (!link(cached.buf, path))
+			ret = 0;
+		else if (is_unsupported_errno(errno))
+			disable_blob_cache();
+		goto verify;
+	}
+
+	src = open(cached.buf, O_RDONLY);
+	if (src < 0)
+		goto out;
+	dst = open(path, O_WRONLY | O_CREAT | O_EXCL,
+		   (ce->ce_mode & 0100) ? 0777 : 0666);
+	if (dst < 0)
+		goto out;
+
+	if (clone_fd(dst, src) < 0) {
+		if (is_unsupported_errno(errno))
+			disable_blob_cache();
+		close(dst);
+		unlink(path);
+		goto out;
+	}
+
+	if (close(dst)) {
+		unlink(path);
+		goto out;
+	}
+	ret = 0;
+
+verify:
+	/*
+	 * Check the file we created rather than the cached one, so that
+	 * the cache cannot be swapped in between.
+	 */
+	if (!ret && !file_matches_blob(path, &ce->oid)) {
+		warning(_("ignoring corrupt blob cache entry '%s'"), cached.buf);
+		unlink(path);
+		unlink(cached.buf);
+		ret = -1;
+	}
+out:
+	if (src >= 0)
+		close(src);
+	strbuf_release(&cached);
+	return ret;
+}
+
+void blob_cache_add(const struct cache_entry *ce,
+		    const struct conv_attrs *ca, const char *path)
+{
+	struct strbuf cached = STRBUF_INIT, tmp = STRBUF_INIT;
+	int src = -1, dst = -1;
+	size_t dirlen;
+	int mode = (ce->ce_mode & 0100) ? 0555 : 0444;
+
+	if (!is_cacheable(ce, ca))
+		return;
+	blob_cache_path(&cached, ce);
+	if (!access(cached.buf, F_OK))
+		goto out;
+
+	dirlen = strrchr(cached.buf, '/') - cached.buf;
+	strbuf_add(&tmp, cached.buf, dirlen);
+	if (mkdir_shared(blob_cache.dir) || mkdir_shared(tmp.buf))
+		goto out;
+	strbuf_addstr(&tmp, "/tmp_blob_XXXXXX");
+
+	src = open(path, O_RDONLY);
+	if (src < 0)
+		goto out;
+	dst = git_mkstemp_mode(tmp.buf, 0600);
+	if (dst < 0)
+		goto out;
+
+	if (blob_cache.mode == BLOB_CACHE_REFLINK) {
+		if (clone_fd(dst, src) < 0) {
+			if (is_unsupported_errno(errno))
+				disable_blob_cache();
+			goto fail;
+		}
+	} else if (copy_fd(src, dst)) {
+		goto fail;
+	}
+
+	/*
+	 * Cached files are never modified in place: make them read-only,
+	 * which also protects the hard-linked working tree files.
+	 */
+	if (fchmod(dst, mode) || adjust_shared_perm(tmp.buf))
+		goto fail;
+	if (close(dst)) {
+		dst = -1;
+		goto fail;
+	}
+	dst = -1;
+
+	/* Another process may have added it meanwhile, which is fine. */
+	if (rename(tmp.buf, cached.buf))
+		goto fail;
+	goto out;
+
+fail:
+	if (dst >= 0)
+		close(dst);
+	unlink(tmp.buf);
+out:
+	if (src >= 0)
+		close(src);
+	strbuf_release(&cached);
+	strbuf_release(&tmp);
+}
@@ -0,0 +1,40 @@
+#ifndef BLOB_CACHE_H
+#define BLOB_CACHE_H
+
+struct cache_entry;
+struct conv_attrs;
+
+/*
+ * The checkout blob cache is a directory, configured with
+ * `checkout.blobCache` and possibly shared by many repositories, holding
+ * copies of blobs. Its files are keyed by the blob and the file mode.
+ * Working tree files are created from it by cloning the data of the
+ * cached file (reflink), or by hard-linking to it with
+ * `checkout.blobCacheMode=hardlink`.
+ *
+ * Only entries that are checked out without any conversion are cached,
+ * so that files created from the cache can be verified against the blob.
+ */
+
+/* Return 1 if the blob cache is configured and usable. */
+int blob_cache_enabled(void);
+
+/*
+ * Create the working tree file `path` for `ce`, converted according to
+ * `ca`, from the blob cache. `path` must not exist. Return 0 on success,
+ * or -1 if the entry is not in the cache, cannot be created from it, or
+ * the cached file does not match the blob (in which case the caller is
+ * expected to write it as usual).
+ */
+int blob_cache_checkout(const struct cache_entry *ce,
+			const struct conv_attrs *ca, const char *path);
+
+/*
+ * Add the freshly written working tree file `path`, holding the content
+ * of `ce` converted according to `ca`, to the blob cache. Errors are
+ * silently ignored, as the cache is only an optimization.
+ */
+void blob_cache_add(const struct cache_entry *ce,
+		    const struct conv_attrs *ca, const char *path);
+
+#endif /* BLOB_CACHE_H */
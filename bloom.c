@@ -1,3 +1,4 @@
+#define USE_THE_REPOSITORY_VARIABLE
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
@@ -11,7 +12,12 @@
 #include "tree.h"
 #include "tree-walk.h"
 #include "config.h"
+#include "gettext.h"
+#include "object-store-ll.h"
+#include "promisor-remote.h"
 #include "repository.h"
+#include "thread-utils.h"
+#include "trace2.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -275,11 +281,6 @@ static void free_one_bloom_filter(struct bloom_filter *filter)
 	free(filter->to_free);
 }
 
-void deinit_bloom_filters(void)
-{
-	deep_clear_bloom_filter_slab(&bloom_filters, free_one_bloom_filter);
-}
-
 static int pathmap_cmp(const void *hashmap_cmp_fn_data UNUSED,
 		       const struct hashmap_entry *eptr,
 		       const struct hashmap_entry *entry_or_key,
@@ -302,6 +303,84 @@ static void init_truncated_large_filter(struct bloom_filter *filter,
 	filter->version = version;
 }
 
+/*
+ * Fill `filter` with the given changed paths, and their leading
+ * directories. Note that the paths are modified.
+ */
+static void fill_filter_from_paths(struct bloom_filter *filter,
+				   char **paths, size_t nr,
+				   const struct bloom_filter_settings *settings,
+				   enum bloom_filter_computed *computed)
+{
+	struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
+	size_t i;
+
+	if (nr > settings->max_changed_paths) {
+		init_truncated_large_filter(filter, settings->hash_version);
+		if (computed)
+			*computed |= BLOOM_TRUNC_LARGE;
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		char *path = paths[i];
+
+		/*
+		 * Add each leading directory of the changed file, i.e. for
+		 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
+		 * the Bloom filter could be used to speed up commands like
+		 * 'git log dir/subdir', too.
+		 *
+		 * Note that directories are added without the trailing '/'.
+		 */
+		do {
+			char *last_slash = strrchr(path, '/');
+
+			FLEX_ALLOC_STR(e, path, path);
+			hashmap_entry_init(&e->entry, strhash(path));
+
+			if (!hashmap_get(&pathmap, &e->entry, NULL))
+				hashmap_add(&pathmap, &e->entry);
+			else
+				free(e);
+
+			if (!last_slash)
+				last_slash = path;
+			*last_slash = '\0';
+
+		} while (*path);
+	}
+
+	if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
+		init_truncated_large_filter(filter, settings->hash_version);
+		if (computed)
+			*computed |= BLOOM_TRUNC_LARGE;
+		goto cleanup;
+	}
+
+	filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	filter->version = settings->hash_version;
+	if (!filter->len) {
+		if (computed)
+			*computed |= BLOOM_TRUNC_EMPTY;
+		filter->len = 1;
+	}
+	CALLOC_ARRAY(filter->data, filter->len);
+	filter->to_free = filter->data;
+
+	hashmap_for_each_entry(&pathmap, &iter, e, entry) {
+		struct bloom_key key;
+		fill_bloom_key(e->path, strlen(e->path), &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+
+cleanup:
+	hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
+}
+
 #define VISITED   (1u<<21)
 #define HIGH_BITS (1u<<22)
 
@@ -369,6 +448,210 @@ static struct bloom_filter *upgrade_filter(struct repository *r, struct commit *
 	return filter;
 }
 
+struct precomputed_bloom_filter {
+	struct bloom_filter filter;
+	enum bloom_filter_computed computed;
+};
+
+define_commit_slab(precomputed_bloom_filter_slab,
+		   struct precomputed_bloom_filter);
+
+static struct precomputed_bloom_filter_slab precomputed_filters;
+
+struct changed_paths {
+	char **paths;
+	size_t nr, alloc, max;
+};
+
+/*
+ * Collect the paths that differ between two trees, like a recursive
+ * diff_tree_oid() without rename detection would report them, stopping
+ * once more than `max` paths have been found.
+ */
+static int collect_changed_path(const struct name_entry *old_e,
+				const struct name_entry *new_e,
+				struct strbuf *base, int depth UNUSED,
+				void *data)
+{
+	struct changed_paths *out = data;
+	const struct name_entry *e = new_e ? new_e : old_e;
+
+	/*
+	 * Whether a submodule change is reported depends on the
+	 * configuration of that submodule, which we cannot look up here.
+	 */
+	if ((old_e && S_ISGITLINK(old_e->mode)) ||
+	    (new_e && S_ISGITLINK(new_e->mode)))
+		return -1;
+	if (S_ISDIR(e->mode))
+		return 0;
+
+	ALLOC_GROW(out->paths, out->nr + 1, out->alloc);
+	out->paths[out->nr++] = xstrfmt("%s%.*s", base->buf,
+					(int)tree_entry_len(e), e->path);
+	return out->nr > out->max;
+}
+
+struct bloom_filter_job {
+	struct commit *commit;
+	const struct object_id *old_tree, *new_tree;
+	struct precomputed_bloom_filter result;
+	int ok;
+};
+
+struct bloom_filter_jobs {
+	struct repository *r;
+	const struct bloom_filter_settings *settings;
+	struct bloom_filter_job *jobs;
+	size_t nr;
+};
+
+/* Number of jobs a thread takes at once. */
+#define BLOOM_FILTER_JOBS_PER_BATCH 32
+
+static void run_bloom_filter_job(size_t nth, void *data)
+{
+	struct bloom_filter_jobs *d = data;
+	struct repository *r = d->r;
+	const struct bloom_filter_settings *settings = d->settings;
+	struct bloom_filter_job *job = &d->jobs[nth];
+	struct changed_paths changes = { .max = settings->max_changed_paths };
+	struct strbuf base = STRBUF_INIT;
+	size_t i;
+
+	/*
+	 * Trees which cannot be compared this way (e.g. if they are
+	 * unreadable or contain submodule changes) are left to the diff
+	 * machinery.
+	 */
+	if (walk_changed_tree_entries(r, job->old_tree, job->new_tree, &base,
+				      collect_changed_path, &changes) >= 0) {
+		fill_filter_from_paths(&job->result.filter, changes.paths,
+				       changes.nr, settings,
+				       &job->result.computed);
+		job->result.computed |= BLOOM_COMPUTED;
+		job->ok = 1;
+	}
+
+	for (i = 0; i < changes.nr; i++)
+		free(changes.paths[i]);
+	free(changes.paths);
+	strbuf_release(&base);
+}
+
+void precompute_bloom_filters(struct repository *r,
+			      struct commit **commits, size_t nr,
+			      size_t max_new_filters,
+			      const struct bloom_filter_settings *settings,
+			      int nr_threads)
+{
+	struct bloom_filter_jobs data = {
+		.r = r,
+		.settings = settings,
+	};
+	struct batch_threads threads = {
+		.fn = run_bloom_filter_job,
+		.data = &data,
+		.batch = BLOOM_FILTER_JOBS_PER_BATCH,
+	};
+	size_t i, alloc = 0, nr_ok = 0;
+
+	if (!HAVE_THREADS || nr_threads < 2 || !bloom_filters.slab_size ||
+	    repo_has_promisor_remote(r))
+		return;
+
+	/*
+	 * Find the commits get_or_compute_bloom_filter() would compute a
+	 * filter for, and everything the threads need from the object
+	 * store outside of the object read lock.
+	 */
+	for (i = 0; i < nr && data.nr < max_new_filters; i++) {
+		struct commit *c = commits[i];
+		struct bloom_filter *filter = bloom_filter_slab_at(&bloom_filters, c);
+		struct bloom_filter_job *job;
+		uint32_t graph_pos;
+
+		if (!filter->data &&
+		    repo_find_commit_pos_in_graph(r, c, &graph_pos))
+			load_bloom_filter_from_graph(r->objects->commit_graph,
+						     filter, graph_pos);
+		if (filter->data && filter->len)
+			continue;
+		if (repo_parse_commit(r, c) ||
+		    (c->parents && repo_parse_commit(r, c->parents->item)))
+			continue;
+
+		ALLOC_GROW(data.jobs, data.nr + 1, alloc);
+		job = &data.jobs[data.nr++];
+		memset(job, 0, sizeof(*job));
+		job->commit = c;
+		job->new_tree = get_commit_tree_oid(c);
+		if (c->parents)
+			job->old_tree = get_commit_tree_oid(c->parents->item);
+	}
+
+	if (data.nr < 2) {
+		free(data.jobs);
+		return;
+	}
+
+	trace2_region_enter("bloom", "precompute", r);
+	enable_obj_read_lock();
+	/* This thread computes filters too. */
+	batch_threads_start(&threads, data.nr, nr_threads - 1);
+	batch_threads_finish(&threads);
+	disable_obj_read_lock();
+
+	if (!precomputed_filters.slab_size)
+		init_precomputed_bloom_filter_slab(&precomputed_filters);
+	for (i = 0; i < data.nr; i++) {
+		if (!data.jobs[i].ok)
+			continue;
+		*precomputed_bloom_filter_slab_at(&precomputed_filters,
+						  data.jobs[i].commit) =
+			data.jobs[i].result;
+		nr_ok++;
+	}
+	trace2_data_intmax("bloom", r, "precomputed", nr_ok);
+	trace2_region_leave("bloom", "precompute", r);
+
+	free(data.jobs);
+}
+
+static int take_precomputed_filter(struct commit *c,
+				   struct bloom_filter *filter,
+				   const struct bloom_filter_settings *settings,
+				   enum bloom_filter_computed *computed)
+{
+	struct precomputed_bloom_filter *p;
+
+	if (!precomputed_filters.slab_size)
+		return 0;
+	p = precomputed_bloom_filter_slab_peek(&precomputed_filters, c);
+	if (!p || !p->filter.data ||
+	    p->filter.version != settings->hash_version)
+		return 0;
+
+	*filter = p->filter;
+	if (computed)
+		*computed |= p->computed;
+	memset(p, 0, sizeof(*p));
+	return 1;
+}
+
+static void free_precomputed_filter(struct precomputed_bloom_filter *p)
+{
+	free(p->filter.to_free);
+}
+
+void deinit_bloom_filters(void)
+{
+	deep_clear_bloom_filter_slab(&bloom_filters, free_one_bloom_filter);
+	if (precomputed_filters.slab_size)
+		deep_clear_precomputed_bloom_filter_slab(&precomputed_filters,
+							 free_precomputed_filter);
+}
+
 struct bloom_filter *get_bloom_filter(struct repository *r, struct commit *c)
 {
 	struct bloom_filter *filter;
@@ -395,6 +678,7 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	struct bloom_filter *filter;
 	int i;
 	struct diff_options diffopt;
+	char **paths;
 
 	if (computed)
 		*computed = BLOOM_NOT_COMPUTED;
@@ -431,6 +715,9 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	if (!compute_if_not_present)
 		return NULL;
 
+	if (take_precomputed_filter(c, filter, settings, computed))
+		return filter;
+
 	repo_diff_setup(r, &diffopt);
 	diffopt.flags.recursive = 1;
 	diffopt.detect_rename = 0;
@@ -446,73 +733,12 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
 	diffcore_std(&diffopt);
 
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
-		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
-		struct pathmap_hash_entry *e;
-		struct hashmap_iter iter;
-
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
-
-			/*
-			 * Add each leading directory of the changed file, i.e. for
-			 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
-			 * the Bloom filter could be used to speed up commands like
-			 * 'git log dir/subdir', too.
-			 *
-			 * Note that directories are added without the trailing '/'.
-			 */
-			do {
-				char *last_slash = strrchr(path, '/');
-
-				FLEX_ALLOC_STR(e, path, path);
-				hashmap_entry_init(&e->entry, strhash(path));
-
-				if (!hashmap_get(&pathmap, &e->entry, NULL))
-					hashmap_add(&pathmap, &e->entry);
-				else
-					free(e);
-
-				if (!last_slash)
-					last_slash = (char*)path;
-				*last_slash = '\0';
-
-			} while (*path);
-		}
-
-		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
-			init_truncated_large_filter(filter,
-						    settings->hash_version);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
-			goto cleanup;
-		}
-
-		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
-		filter->version = settings->hash_version;
-		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
-			filter->len = 1;
-		}
-		CALLOC_ARRAY(filter->data, filter->len);
-		filter->to_free = filter->data;
-
-		hashmap_for_each_entry(&pathmap, &iter, e, entry) {
-			struct bloom_key key;
-			fill_bloom_key(e->path, strlen(e->path), &key, settings);
-			add_key_to_filter(&key, filter, settings);
-			clear_bloom_key(&key);
-		}
-
-	cleanup:
-		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
-	} else {
-		init_truncated_large_filter(filter, settings->hash_version);
-
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
-	}
+	ALLOC_ARRAY(paths, diff_queued_diff.nr);
+	for (i = 0; i < diff_queued_diff.nr; i++)
+		paths[i] = diff_queued_diff.queue[i]->two->path;
+	fill_filter_from_paths(filter, paths, diff_queued_diff.nr, settings,
+			       computed);
+	free(paths);
 
 	if (computed)
 		*computed |= BLOOM_COMPUTED;
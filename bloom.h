@@ -43,6 +43,13 @@ struct bloom_filter_settings {
 
 #define DEFAULT_BLOOM_MAX_CHANGES 512
 #define DEFAULT_BLOOM_FILTER_SETTINGS { 1, 7, 10, DEFAULT_BLOOM_MAX_CHANGES }
+
+/*
+ * Settings for the filter summarizing a fetch client's commits in the
+ * "bloom-haves" argument of protocol v2. Only num_hashes is sent over
+ * the wire; the hash version is fixed by the protocol.
+ */
+#define BLOOM_HAVES_FILTER_SETTINGS { 2, 7, 10, 0 }
 #define BITS_PER_WORD 8
 #define BLOOMDATA_CHUNK_HEADER_SIZE 3 * sizeof(uint32_t)
 
@@ -114,6 +121,20 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 const struct bloom_filter_settings *settings,
 						 enum bloom_filter_computed *computed);
 
+/*
+ * Compute, using up to `nr_threads` threads, the Bloom filters that
+ * get_or_compute_bloom_filter() would compute for the first
+ * `max_new_filters` of the given commits lacking one, so that it can
+ * return them without computing them itself. The result is identical.
+ * Filters which cannot be computed in threads (e.g. for commits touching
+ * submodules) are left to get_or_compute_bloom_filter().
+ */
+void precompute_bloom_filters(struct repository *r,
+			      struct commit **commits, size_t nr,
+			      size_t max_new_filters,
+			      const struct bloom_filter_settings *settings,
+			      int nr_threads);
+
 /*
  * Find the Bloom filter associated with the given commit "c".
  *
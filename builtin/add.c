@@ -7,6 +7,7 @@
 #include "builtin.h"
 #include "advice.h"
 #include "config.h"
+#include "convert.h"
 #include "lockfile.h"
 #include "editor.h"
 #include "dir.h"
@@ -335,6 +336,8 @@ static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 {
 	int i, exit_status = 0;
 	struct string_list matched_sparse_paths = STRING_LIST_INIT_NODUP;
+	const char **paths;
+	size_t prefetched = 0;
 
 	if (dir->ignored_nr) {
 		fprintf(stderr, _(ignore_error));
@@ -345,7 +348,15 @@ static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 		exit_status = 1;
 	}
 
+	ALLOC_ARRAY(paths, dir->nr);
+	for (i = 0; i < dir->nr; i++)
+		paths[i] = dir->entries[i]->name;
+
 	for (i = 0; i < dir->nr; i++) {
+		if ((size_t)i == prefetched && !(flags & ADD_CACHE_PRETEND))
+			prefetched += convert_prefetch_clean(repo->index,
+							     paths + i,
+							     dir->nr - i);
 		if (!include_sparse &&
 		    !path_in_sparse_checkout(dir->entries[i]->name, repo->index)) {
 			string_list_append(&matched_sparse_paths,
@@ -360,6 +371,8 @@ static int add_files(struct repository *repo, struct dir_struct *dir, int flags)
 			check_embedded_repo(dir->entries[i]->name);
 		}
 	}
+	discard_prefetched_clean();
+	free(paths);
 
 	if (matched_sparse_paths.nr) {
 		advise_on_updating_sparse_paths(&matched_sparse_paths);
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "entry.h"
 #include "gettext.h"
+#include "hex.h"
 #include "parallel-checkout.h"
 #include "parse-options.h"
 #include "pkt-line.h"
@@ -15,7 +16,7 @@ static void packet_to_pc_item(const char *buffer, int len,
 {
 	const struct pc_item_fixed_portion *fixed_portion;
 	const char *variant;
-	char *encoding;
+	char *encoding, *driver_name = NULL;
 
 	if (len < sizeof(struct pc_item_fixed_portion))
 		BUG("checkout worker received too short item (got %dB, exp %dB)",
@@ -24,7 +25,8 @@ static void packet_to_pc_item(const char *buffer, int len,
 	fixed_portion = (struct pc_item_fixed_portion *)buffer;
 
 	if (len - sizeof(struct pc_item_fixed_portion) !=
-		fixed_portion->name_len + fixed_portion->working_tree_encoding_len)
+		fixed_portion->name_len + fixed_portion->working_tree_encoding_len +
+		fixed_portion->driver_name_len)
 		BUG("checkout worker received corrupted item");
 
 	variant = buffer + sizeof(struct pc_item_fixed_portion);
@@ -43,6 +45,11 @@ static void packet_to_pc_item(const char *buffer, int len,
 		encoding = NULL;
 	}
 
+	if (fixed_portion->driver_name_len) {
+		driver_name = xmemdupz(variant, fixed_portion->driver_name_len);
+		variant += fixed_portion->driver_name_len;
+	}
+
 	memset(pc_item, 0, sizeof(*pc_item));
 	pc_item->ce = make_empty_transient_cache_entry(fixed_portion->name_len, NULL);
 	pc_item->ce->ce_namelen = fixed_portion->name_len;
@@ -54,6 +61,13 @@ static void packet_to_pc_item(const char *buffer, int len,
 	pc_item->ca.crlf_action = fixed_portion->crlf_action;
 	pc_item->ca.ident = fixed_portion->ident;
 	pc_item->ca.working_tree_encoding = encoding;
+
+	if (driver_name) {
+		if (conv_attrs_set_driver(&pc_item->ca, driver_name))
+			die(_("checkout worker: unknown filter driver '%s'"),
+			    driver_name);
+		free(driver_name);
+	}
 }
 
 static void report_result(struct parallel_checkout_item *pc_item)
@@ -81,10 +95,20 @@ static void release_pc_item_data(struct parallel_checkout_item *pc_item)
 	discard_cache_entry(pc_item->ce);
 }
 
+static void item_written(struct parallel_checkout_item *pc_item,
+			 void *data UNUSED)
+{
+	/* Reported once written by write_delayed_pc_items(). */
+	if (pc_item->status == PC_ITEM_DELAYED)
+		return;
+	report_result(pc_item);
+	release_pc_item_data(pc_item);
+}
+
 static void worker_loop(struct checkout *state)
 {
 	struct parallel_checkout_item *items = NULL;
-	size_t i, nr = 0, alloc = 0;
+	size_t nr = 0, alloc = 0;
 
 	while (1) {
 		int len = packet_read(0, packet_buffer, sizeof(packet_buffer),
@@ -99,13 +123,8 @@ static void worker_loop(struct checkout *state)
 		packet_to_pc_item(packet_buffer, len, &items[nr++]);
 	}
 
-	for (i = 0; i < nr; i++) {
-		struct parallel_checkout_item *pc_item = &items[i];
-		write_pc_item(pc_item, state);
-		report_result(pc_item);
-		release_pc_item_data(pc_item);
-	}
-
+	write_pc_items(items, nr, state, item_written, NULL);
+	write_delayed_pc_items(items, nr, state, item_written, NULL);
 	packet_flush(1);
 
 	free(items);
@@ -122,9 +141,17 @@ int cmd_checkout__worker(int argc,
 			 struct repository *repo UNUSED)
 {
 	struct checkout state = CHECKOUT_INIT;
+	const char *treeish = NULL;
+	int delay = 0;
 	struct option checkout_worker_options[] = {
 		OPT_STRING(0, "prefix", &state.base_dir, N_("string"),
 			N_("when creating files, prepend <string>")),
+		OPT_STRING(0, "refname", &state.meta.refname, N_("refname"),
+			N_("ref being checked out, for filter processes")),
+		OPT_STRING(0, "treeish", &treeish, N_("object-id"),
+			N_("tree-ish being checked out, for filter processes")),
+		OPT_BOOL(0, "delay", &delay,
+			N_("let filter processes delay entries")),
 		OPT_END()
 	};
 
@@ -140,6 +167,8 @@ int cmd_checkout__worker(int argc,
 
 	if (state.base_dir)
 		state.base_dir_len = strlen(state.base_dir);
+	if (treeish && get_oid_hex(treeish, &state.meta.treeish))
+		die(_("checkout worker: invalid tree-ish '%s'"), treeish);
 
 	/*
 	 * Setting this on a worker won't actually update the index. We just
@@ -147,6 +176,8 @@ int cmd_checkout__worker(int argc,
 	 * so that we can send this data back to the main process.
 	 */
 	state.refresh_cache = 1;
+	if (delay)
+		enable_delayed_checkout(&state);
 
 	worker_loop(&state);
 	return 0;
@@ -223,7 +223,7 @@ int cmd_checkout_index(int argc,
 	int force = 0, quiet = 0, not_new = 0;
 	int index_opt = 0;
 	int err = 0;
-	int pc_workers, pc_threshold;
+	int pc_workers, pc_threshold, use_pc;
 	struct option builtin_checkout_index_options[] = {
 		OPT_BOOL('a', "all", &all,
 			N_("check out all files in the index")),
@@ -291,7 +291,8 @@ int cmd_checkout_index(int argc,
 	}
 
 	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
-	if (pc_workers > 1)
+	use_pc = use_parallel_checkout(pc_workers);
+	if (use_pc)
 		init_parallel_checkout();
 
 	/* Check out named files first */
@@ -336,7 +337,7 @@ int cmd_checkout_index(int argc,
 	if (all)
 		err |= checkout_all(prefix, prefix_length);
 
-	if (pc_workers > 1)
+	if (use_pc)
 		err |= run_parallel_checkout(&state, pc_workers, pc_threshold,
 					     NULL, NULL);
 
@@ -389,7 +389,7 @@ static int checkout_worktree(const struct checkout_opts *opts,
 	int nr_checkouts = 0, nr_unmerged = 0;
 	int errs = 0;
 	int pos;
-	int pc_workers, pc_threshold;
+	int pc_workers, pc_threshold, use_pc;
 	struct mem_pool ce_mem_pool;
 
 	state.force = 1;
@@ -398,13 +398,14 @@ static int checkout_worktree(const struct checkout_opts *opts,
 
 	mem_pool_init(&ce_mem_pool, 0);
 	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	use_pc = use_parallel_checkout(pc_workers);
 	init_checkout_metadata(&state.meta, info->refname,
 			       info->commit ? &info->commit->object.oid : &info->oid,
 			       NULL);
 
 	enable_delayed_checkout(&state);
 
-	if (pc_workers > 1)
+	if (use_pc)
 		init_parallel_checkout();
 
 	enable_fscache(the_repository->index->cache_nr);
@@ -429,7 +430,7 @@ static int checkout_worktree(const struct checkout_opts *opts,
 			pos = skip_same_name(ce, pos) - 1;
 		}
 	}
-	if (pc_workers > 1)
+	if (use_pc)
 		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold,
 					      NULL, NULL);
 	mem_pool_discard(&ce_mem_pool, should_validate_cache_entries());
@@ -45,6 +45,10 @@
 #include "commit-reach.h"
 #include "range-diff.h"
 #include "tmp-objdir.h"
+#include "sigchain.h"
+#include "tempfile.h"
+#include "thread-utils.h"
+#include "trace2.h"
 #include "tree.h"
 #include "write-or-die.h"
 
@@ -105,6 +109,8 @@ struct log_config {
 	int default_abbrev_commit;
 	int default_show_root;
 	int default_follow;
+	int path_cache;
+	int workers;
 	int default_show_signature;
 	int default_encode_email_headers;
 	int decoration_style;
@@ -120,6 +126,7 @@ static void log_config_init(struct log_config *cfg)
 {
 	memset(cfg, 0, sizeof(*cfg));
 	cfg->default_show_root = 1;
+	cfg->workers = 1;
 	cfg->default_encode_email_headers = 1;
 	cfg->use_mailmap_config = 1;
 	cfg->fmt_patch_subject_prefix = xstrdup("PATCH");
@@ -503,12 +510,22 @@ static void finish_early_output(struct rev_info *rev)
 	show_early_header(rev, "done", n);
 }
 
+static int log_walk_result(struct rev_info *rev)
+{
+	int result = diff_result_code(rev);
+
+	if (rev->diffopt.output_format & DIFF_FORMAT_CHECKDIFF &&
+	    rev->diffopt.flags.check_failed) {
+		result = 02;
+	}
+	return result;
+}
+
 static int cmd_log_walk_no_free(struct rev_info *rev)
 {
 	struct commit *commit;
 	int saved_nrl = 0;
 	int saved_dcctc = 0;
-	int result;
 
 	if (rev->early_output)
 		setup_early_output();
@@ -553,12 +570,7 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
 
-	result = diff_result_code(rev);
-	if (rev->diffopt.output_format & DIFF_FORMAT_CHECKDIFF &&
-	    rev->diffopt.flags.check_failed) {
-		result = 02;
-	}
-	return result;
+	return log_walk_result(rev);
 }
 
 static int cmd_log_walk(struct rev_info *rev)
@@ -572,6 +584,347 @@ static int cmd_log_walk(struct rev_info *rev)
 	return retval;
 }
 
+#ifndef GIT_WINDOWS_NATIVE
+/*
+ * With log.workers, the parent walks the history and hands the commits
+ * in turn to forked worker processes, which show them and send their
+ * output back to the parent, which prints it in walk order.
+ *
+ * For each commit, the parent sends its object flags and its number of
+ * parents, as 4-byte network-order integers, then the raw object names
+ * of the commit and of its parents, as the walk left them (e.g. after
+ * history simplification). Its output is sent back in chunks, each
+ * preceded by its length as a 4-byte network-order integer, and
+ * terminated by an empty chunk. Once the parent closes its end, the
+ * worker sends what the exit code depends on as four such integers:
+ * whether there were changes, whether --check failed, the needed
+ * rename limit and whether combined diffs were degraded.
+ *
+ * A worker gets its next commit only after the parent printed the
+ * output of its previous one, so neither of them can block writing to
+ * a full pipe that the other is not reading.
+ */
+#define LOG_WORKER_CHUNK_SIZE 65536
+
+struct log_worker {
+	pid_t pid;
+	/* each side holds its own end of the pipes */
+	int in; /* commits to show */
+	int out; /* their output */
+};
+
+/*
+ * Whether each commit is shown independently of how the previous ones
+ * were, except for the separator between them, which needs every commit
+ * to be shown, as log_tree_commit() does with always_show_header, and
+ * only from its flags and parents, i.e. without other state of the walk
+ * (like the children of commits or the original parents kept with
+ * --parents).
+ */
+static int log_workers_compatible(struct rev_info *rev)
+{
+	return rev->always_show_header &&
+	       (rev->diffopt.output_format & ~DIFF_FORMAT_NO_OUTPUT) &&
+	       rev->diffopt.file == stdout &&
+	       !rev->graph && !rev->early_output && !rev->track_linear &&
+	       !rev->line_level_traverse && !rev->remerge_diff &&
+	       !rev->reflog_info && !rev->diffopt.flags.follow_renames &&
+	       !rev->rewrite_parents && !rev->children.name && !rev->sources;
+}
+
+static NORETURN void die_log_worker(const char *err, va_list params)
+{
+	get_die_message_routine()(err, params);
+	_exit(128);
+}
+
+static NORETURN void log_worker_failed(void)
+{
+	die(_("a log worker process failed"));
+}
+
+static struct commit *read_log_worker_commit(struct log_worker *w)
+{
+	const struct git_hash_algo *algop = the_repository->hash_algo;
+	unsigned char hdr[8], hash[GIT_MAX_RAWSZ];
+	struct commit_list **tail;
+	struct object_id oid;
+	struct commit *commit;
+	uint32_t nr_parents;
+	ssize_t n;
+
+	n = read_in_full(w->in, hdr, sizeof(hdr));
+	if (!n)
+		return NULL;
+	if (n != sizeof(hdr) ||
+	    read_in_full(w->in, hash, algop->rawsz) != algop->rawsz)
+		die(_("unexpected input from git log"));
+	oidread(&oid, hash, algop);
+	commit = lookup_commit_or_die(&oid, oid_to_hex(&oid));
+	parse_commit_or_die(commit);
+	commit->object.flags = get_be32(hdr);
+
+	free_commit_list(commit->parents);
+	commit->parents = NULL;
+	tail = &commit->parents;
+	for (nr_parents = get_be32(hdr + 4); nr_parents; nr_parents--) {
+		struct commit *parent;
+
+		if (read_in_full(w->in, hash, algop->rawsz) != algop->rawsz)
+			die(_("unexpected input from git log"));
+		oidread(&oid, hash, algop);
+		parent = lookup_commit_or_die(&oid, oid_to_hex(&oid));
+		parse_commit_or_die(parent);
+		tail = commit_list_append(parent, tail);
+	}
+	return commit;
+}
+
+static void send_log_worker_output(struct log_worker *w)
+{
+	char *buf = xmalloc(LOG_WORKER_CHUNK_SIZE);
+	unsigned char len[4];
+	off_t pos = 0, end;
+
+	if (fflush(stdout) || (end = ftello(stdout)) < 0)
+		die_errno(_("unable to write log output"));
+	while (pos < end) {
+		size_t n = end - pos < LOG_WORKER_CHUNK_SIZE ?
+			end - pos : LOG_WORKER_CHUNK_SIZE;
+
+		if (pread_in_full(1, buf, n, pos) != n)
+			die_errno(_("unable to read log output"));
+		put_be32(len, n);
+		write_or_die(w->out, len, sizeof(len));
+		write_or_die(w->out, buf, n);
+		pos += n;
+	}
+	put_be32(len, 0);
+	write_or_die(w->out, len, sizeof(len));
+	rewind(stdout);
+	free(buf);
+}
+
+/*
+ * Show the commits the parent sends, and exit without running the exit
+ * handlers of the parent (e.g. waiting for its pager).
+ */
+static NORETURN void run_log_worker(struct rev_info *rev, struct log_worker *w,
+				    int first, const char *columns)
+{
+	struct commit *commit;
+	struct tempfile *tmp;
+	unsigned char summary[16];
+	int saved_nrl = 0;
+	int saved_dcctc = 0;
+
+	set_die_routine(die_log_worker);
+	setenv("COLUMNS", columns, 1);
+
+	/*
+	 * Collect the output of each commit in a temporary file, as
+	 * stdout, since some of it (e.g. combined diffs) is written there
+	 * rather than to rev->diffopt.file.
+	 */
+	tmp = mks_tempfile_t("git-log-XXXXXX");
+	if (!tmp || dup2(get_tempfile_fd(tmp), 1) < 0)
+		die_errno(_("unable to create temporary file"));
+	unlink(get_tempfile_path(tmp));
+
+	rev->shown_one = !first;
+	while ((commit = read_log_worker_commit(w))) {
+		log_tree_commit(rev, commit);
+		send_log_worker_output(w);
+		free_commit_buffer(the_repository->parsed_objects, commit);
+		free_commit_list(commit->parents);
+		commit->parents = NULL;
+		if (saved_nrl < rev->diffopt.needed_rename_limit)
+			saved_nrl = rev->diffopt.needed_rename_limit;
+		if (rev->diffopt.degraded_cc_to_c)
+			saved_dcctc = 1;
+	}
+
+	put_be32(summary, rev->diffopt.flags.has_changes);
+	put_be32(summary + 4, rev->diffopt.flags.check_failed);
+	put_be32(summary + 8, saved_nrl);
+	put_be32(summary + 12, saved_dcctc);
+	write_or_die(w->out, summary, sizeof(summary));
+	_exit(0);
+}
+
+static void send_log_worker_commit(struct log_worker *w,
+				   struct commit *commit, struct strbuf *buf)
+{
+	const struct git_hash_algo *algop = the_repository->hash_algo;
+	unsigned char hdr[8];
+	struct commit_list *p;
+
+	put_be32(hdr, commit->object.flags);
+	put_be32(hdr + 4, commit_list_count(commit->parents));
+	strbuf_reset(buf);
+	strbuf_add(buf, hdr, sizeof(hdr));
+	strbuf_add(buf, commit->object.oid.hash, algop->rawsz);
+	for (p = commit->parents; p; p = p->next)
+		strbuf_add(buf, p->item->object.oid.hash, algop->rawsz);
+	if (write_in_full(w->in, buf->buf, buf->len) < 0)
+		log_worker_failed();
+}
+
+/* Copy the output of the next commit of a worker to stdout. */
+static void copy_log_worker_output(struct log_worker *w, char *buf)
+{
+	unsigned char len[4];
+	size_t n;
+
+	for (;;) {
+		if (read_in_full(w->out, len, sizeof(len)) != sizeof(len))
+			log_worker_failed();
+		n = get_be32(len);
+		if (!n)
+			break;
+		if (n > LOG_WORKER_CHUNK_SIZE || read_in_full(w->out, buf, n) != n)
+			log_worker_failed();
+		fwrite(buf, 1, n, stdout);
+	}
+	maybe_flush_or_die(stdout, "stdout");
+}
+
+/*
+ * Wait for a worker, and accumulate what the exit code depends on in
+ * rev->diffopt, as cmd_log_walk_no_free() does.
+ */
+static void finish_log_worker(struct rev_info *rev, struct log_worker *w)
+{
+	unsigned char summary[16];
+	int nrl, status;
+	pid_t pid;
+
+	close(w->in);
+	if (read_in_full(w->out, summary, sizeof(summary)) != sizeof(summary))
+		log_worker_failed();
+	close(w->out);
+	while ((pid = waitpid(w->pid, &status, 0)) < 0 && errno == EINTR)
+		; /* nothing */
+	if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		log_worker_failed();
+
+	if (get_be32(summary))
+		rev->diffopt.flags.has_changes = 1;
+	if (get_be32(summary + 4))
+		rev->diffopt.flags.check_failed = 1;
+	nrl = get_be32(summary + 8);
+	if (rev->diffopt.needed_rename_limit < nrl)
+		rev->diffopt.needed_rename_limit = nrl;
+	if (get_be32(summary + 12))
+		rev->diffopt.degraded_cc_to_c = 1;
+}
+
+static int cmd_log_walk_workers(struct rev_info *rev, int nr)
+{
+	struct log_worker *workers;
+	struct strbuf cmd = STRBUF_INIT;
+	struct commit *commit;
+	char columns[32];
+	char *buf;
+	int i, n = 0;
+
+	CALLOC_ARRAY(workers, nr);
+
+	/*
+	 * Decide what depends on stdout being a terminal before the
+	 * workers redirect theirs: whether to use colors, and its width,
+	 * e.g. for --stat and "%<|(N)", which the workers (and the
+	 * programs they run) find in $COLUMNS, as they would below a
+	 * pager.
+	 */
+	rev->diffopt.use_color = want_color(rev->diffopt.use_color);
+	rev->grep_filter.color = want_color(rev->grep_filter.color);
+	xsnprintf(columns, sizeof(columns), "%d", term_columns());
+
+	/* Flush stdio before fork() to avoid cloning buffers */
+	fflush(NULL);
+	for (i = 0; i < nr; i++) {
+		int in[2], out[2];
+
+		if (pipe(in) < 0 || pipe(out) < 0)
+			die_errno(_("cannot create pipe"));
+		workers[i].pid = fork();
+		if (workers[i].pid < 0)
+			die_errno(_("cannot fork log worker"));
+		if (!workers[i].pid) {
+			int j;
+
+			for (j = 0; j < i; j++) {
+				close(workers[j].in);
+				close(workers[j].out);
+			}
+			close(in[1]);
+			close(out[0]);
+			workers[i].in = in[0];
+			workers[i].out = out[1];
+			run_log_worker(rev, &workers[i], !i, columns);
+		}
+		close(in[0]);
+		close(out[1]);
+		workers[i].in = in[1];
+		workers[i].out = out[0];
+	}
+
+	/* Notice dead workers when writing to them. */
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	if (prepare_revision_walk(rev))
+		die(_("revision walk setup failed"));
+
+	buf = xmalloc(LOG_WORKER_CHUNK_SIZE);
+	while ((commit = get_revision(rev)) != NULL) {
+		struct log_worker *w = &workers[n % nr];
+
+		if (n++ >= nr)
+			copy_log_worker_output(w, buf);
+		send_log_worker_commit(w, commit, &cmd);
+		free_commit_buffer(the_repository->parsed_objects, commit);
+		free_commit_list(commit->parents);
+		commit->parents = NULL;
+	}
+	for (i = n > nr ? n - nr : 0; i < n; i++)
+		copy_log_worker_output(&workers[i % nr], buf);
+	for (i = 0; i < nr; i++)
+		finish_log_worker(rev, &workers[i]);
+
+	sigchain_pop(SIGPIPE);
+	strbuf_release(&cmd);
+	free(buf);
+	free(workers);
+	return log_walk_result(rev);
+}
+#endif
+
+/*
+ * Like cmd_log_walk(), but compute the output of the commits in `nr`
+ * worker processes, if it can be.
+ */
+static int cmd_log_walk_parallel(struct rev_info *rev, int nr)
+{
+#ifndef GIT_WINDOWS_NATIVE
+	int retval;
+
+	if (nr < 1)
+		nr = online_cpus();
+	if (nr < 2 || !log_workers_compatible(rev))
+		return cmd_log_walk(rev);
+
+	trace2_data_intmax("log", rev->repo, "workers", nr);
+	rev->diffopt.no_free = 1;
+	retval = cmd_log_walk_workers(rev, nr);
+	rev->diffopt.no_free = 0;
+	diff_free(&rev->diffopt);
+	return retval;
+#else
+	return cmd_log_walk(rev);
+#endif
+}
+
 static int git_log_config(const char *var, const char *value,
 			  const struct config_context *ctx, void *cb)
 {
@@ -617,6 +970,14 @@ static int git_log_config(const char *var, const char *value,
 		cfg->default_show_root = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "log.workers")) {
+		cfg->workers = git_config_int(var, value, ctx->kvi);
+		return 0;
+	}
+	if (!strcmp(var, "log.pathcache")) {
+		cfg->path_cache = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "log.follow")) {
 		cfg->default_follow = git_config_bool(var, value);
 		return 0;
@@ -945,9 +1306,10 @@ int cmd_log(int argc,
 	opt.def = "HEAD";
 	opt.revarg_opt = REVARG_COMMITTISH;
 	opt.tweak = log_setup_revisions_tweak;
+	rev.use_log_cache = cfg.path_cache;
 	cmd_log_init(argc, argv, prefix, &rev, &opt, &cfg);
 
-	ret = cmd_log_walk(&rev);
+	ret = cmd_log_walk_parallel(&rev, cfg.workers);
 
 	release_revisions(&rev);
 	log_config_release(&cfg);
@@ -18,6 +18,9 @@
 #include "tree.h"
 #include "config.h"
 #include "strvec.h"
+#include "strmap.h"
+#include "diffcore.h"
+#include "trace2.h"
 
 static int line_termination = '\n';
 
@@ -415,8 +418,46 @@ struct merge_tree_options {
 	int name_only;
 	int use_stdin;
 	struct merge_options merge_options;
+
+	/*
+	 * With --stdin, the merge bases of each pair of commits merged so
+	 * far, keyed by "<oid1> <oid2>", and how often they were reused.
+	 */
+	struct strmap merge_bases;
+	int merge_bases_reused;
 };
 
+static int get_merge_bases(struct merge_tree_options *o,
+			   struct commit *parent1, struct commit *parent2,
+			   struct commit_list **merge_bases)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct commit_list *cached;
+
+	if (!o->use_stdin)
+		return repo_get_merge_bases(the_repository, parent1, parent2,
+					    merge_bases);
+
+	strbuf_addf(&key, "%s ", oid_to_hex(&parent1->object.oid));
+	strbuf_addstr(&key, oid_to_hex(&parent2->object.oid));
+	if (!strmap_contains(&o->merge_bases, key.buf)) {
+		cached = NULL;
+		if (repo_get_merge_bases(the_repository, parent1, parent2,
+					 &cached) < 0) {
+			strbuf_release(&key);
+			return -1;
+		}
+		strmap_put(&o->merge_bases, key.buf, cached);
+	} else {
+		o->merge_bases_reused++;
+	}
+	cached = strmap_get(&o->merge_bases, key.buf);
+	strbuf_release(&key);
+
+	*merge_bases = copy_commit_list(cached);
+	return 0;
+}
+
 static int real_merge(struct merge_tree_options *o,
 		      const char *merge_base,
 		      const char *branch1, const char *branch2,
@@ -476,8 +517,7 @@ static int real_merge(struct merge_tree_options *o,
 		 * Get the merge bases, in reverse order; see comment above
 		 * merge_incore_recursive in merge-ort.h
 		 */
-		if (repo_get_merge_bases(the_repository, parent1,
-					 parent2, &merge_bases) < 0)
+		if (get_merge_bases(o, parent1, parent2, &merge_bases) < 0)
 			exit(128);
 		if (!merge_bases && !o->allow_unrelated_histories)
 			die(_("refusing to merge unrelated histories"));
@@ -591,6 +631,8 @@ int cmd_merge_tree(int argc,
 	/* Handle --stdin */
 	if (o.use_stdin) {
 		struct strbuf buf = STRBUF_INIT;
+		struct hashmap_iter iter;
+		struct strmap_entry *e;
 
 		if (o.mode == MODE_TRIVIAL)
 			die(_("--trivial-merge is incompatible with all other options"));
@@ -598,6 +640,18 @@ int cmd_merge_tree(int argc,
 			die(_("options '%s' and '%s' cannot be used together"),
 			    "--merge-base", "--stdin");
 		line_termination = '\0';
+
+		/*
+		 * Merges requested in one batch tend to share sides and
+		 * merge bases, so keep what can be reused between them:
+		 * the merge bases of each pair, and the similarity scores
+		 * computed by rename detection.
+		 */
+		strmap_init(&o.merge_bases);
+		o.merge_options.rename_score_cache =
+			rename_score_cache_new(the_repository,
+					       o.merge_options.rename_cache);
+
 		while (strbuf_getline_lf(&buf, stdin) != EOF) {
 			struct strbuf **split;
 			int result;
@@ -629,6 +683,13 @@ int cmd_merge_tree(int argc,
 			strbuf_list_free(split);
 		}
 		strbuf_release(&buf);
+		strmap_for_each_entry(&o.merge_bases, &iter, e)
+			free_commit_list(e->value);
+		strmap_clear(&o.merge_bases, 0);
+		trace2_data_intmax("merge-tree", the_repository,
+				   "merge bases reused", o.merge_bases_reused);
+		rename_score_cache_free(o.merge_options.rename_score_cache);
+		o.merge_options.rename_score_cache = NULL;
 
 		ret = 0;
 		goto out;
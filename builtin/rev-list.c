@@ -4,6 +4,7 @@
 #include "builtin.h"
 #include "config.h"
 #include "commit.h"
+#include "commit-reach.h"
 #include "diff.h"
 #include "environment.h"
 #include "gettext.h"
@@ -21,6 +22,7 @@
 #include "bisect.h"
 #include "progress.h"
 #include "reflog-walk.h"
+#include "tag.h"
 #include "oidset.h"
 #include "packfile.h"
 
@@ -475,6 +477,72 @@ static int try_bitmap_count(struct rev_info *revs,
 	return 0;
 }
 
+static int try_commit_graph_count(struct rev_info *revs)
+{
+	struct commit **tips = NULL, **bottoms = NULL;
+	size_t tips_nr = 0, tips_alloc = 0, bottoms_nr = 0, bottoms_alloc = 0;
+	uint32_t commit_count;
+	int ret = -1;
+	size_t i;
+
+	/* This function only handles counting, not general traversal. */
+	if (!revs->count)
+		return -1;
+
+	/*
+	 * Only plain counts of the commits reachable from some commits and
+	 * not from others can be computed from the commit-graph alone.
+	 */
+	if (revs->left_right || revs->left_only || revs->right_only ||
+	    revs->cherry_mark || revs->cherry_pick || revs->boundary ||
+	    revs->ancestry_path || revs->exclude_first_parent_only ||
+	    revs->simplify_by_decoration || revs->no_walk ||
+	    revs->unpacked || revs->no_kept_objects ||
+	    revs->tag_objects || revs->tree_objects || revs->blob_objects ||
+	    revs->reflog_info || revs->prune_data.nr || revs->commits ||
+	    revs->ignore_missing_links || revs->exclude_promisor_objects ||
+	    revs->do_not_die_on_missing_objects || revs->include_check ||
+	    revs->grep_filter.pattern_list || revs->grep_filter.header_list)
+		return -1;
+	if (revs->max_age != -1 || revs->min_age != -1 ||
+	    revs->max_age_as_filter != -1 || revs->skip_count >= 0 ||
+	    revs->min_parents || revs->max_parents >= 0)
+		return -1;
+
+	for (i = 0; i < revs->pending.nr; i++) {
+		struct object *obj = revs->pending.objects[i].item;
+		unsigned int flags = obj->flags;
+
+		obj = deref_tag(revs->repo, obj, NULL, 0);
+		if (!obj || obj->type != OBJ_COMMIT ||
+		    repo_parse_commit(revs->repo, (struct commit *)obj))
+			goto cleanup;
+
+		if (flags & UNINTERESTING) {
+			ALLOC_GROW(bottoms, bottoms_nr + 1, bottoms_alloc);
+			bottoms[bottoms_nr++] = (struct commit *)obj;
+		} else {
+			ALLOC_GROW(tips, tips_nr + 1, tips_alloc);
+			tips[tips_nr++] = (struct commit *)obj;
+		}
+	}
+
+	if (count_reachable_in_graph(revs->repo, tips, tips_nr,
+				     bottoms, bottoms_nr,
+				     revs->first_parent_only, &commit_count))
+		goto cleanup;
+
+	if (revs->max_count >= 0 && revs->max_count < commit_count)
+		commit_count = revs->max_count;
+	printf("%"PRIu32"\n", commit_count);
+	ret = 0;
+
+cleanup:
+	free(tips);
+	free(bottoms);
+	return ret;
+}
+
 static int try_bitmap_traversal(struct rev_info *revs,
 				int filter_provided_objects)
 {
@@ -746,6 +814,11 @@ int cmd_rev_list(int argc,
 			goto cleanup;
 	}
 
+	if (!bisect_list && !show_disk_usage && !arg_missing_action &&
+	    !filter_provided_objects && !revs.filter.choice &&
+	    !try_commit_graph_count(&revs))
+		goto cleanup;
+
 	if (prepare_revision_walk(&revs))
 		die("revision walk setup failed");
 	if (revs.tree_objects)
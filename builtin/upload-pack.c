@@ -1,4 +1,8 @@
+#define USE_THE_REPOSITORY_VARIABLE
+
 #include "builtin.h"
+#include "abspath.h"
+#include "config.h"
 #include "exec-cmd.h"
 #include "gettext.h"
 #include "pkt-line.h"
@@ -10,19 +14,255 @@
 #include "serve.h"
 #include "commit.h"
 #include "environment.h"
+#include "packfile.h"
+#include "commit-graph.h"
+#include "trace2.h"
+#include "write-or-die.h"
+
+#ifndef NO_UNIX_SOCKETS
+#include "unix-socket.h"
+#include "unix-stream-server.h"
+#endif
 
 static const char * const upload_pack_usage[] = {
 	N_("git-upload-pack [--[no-]strict] [--timeout=<n>] [--stateless-rpc]\n"
 	   "                [--advertise-refs] <directory>"),
+	N_("git-upload-pack [--[no-]strict] --serve-socket=<path> <directory>"),
 	NULL
 };
 
+#ifndef NO_UNIX_SOCKETS
+
+static int daemon_socket_config(const char *var, const char *value,
+				const struct config_context *ctx UNUSED,
+				void *cb_data)
+{
+	char **path = cb_data;
+
+	if (!strcmp(var, "uploadpack.daemonsocket")) {
+		FREE_AND_NULL(*path);
+		return git_config_pathname(path, var, value);
+	}
+	return 0;
+}
+
+/*
+ * The daemon serves requests with its own environment, configuration
+ * and options, so only relay requests that it would serve the same way
+ * we would.
+ */
+static int can_relay_to_daemon(int strict, int timeout)
+{
+	if (strict || timeout)
+		return 0;
+	if (*get_git_namespace())
+		return 0;
+	if (getenv(CONFIG_DATA_ENVIRONMENT) || getenv(CONFIG_COUNT_ENVIRONMENT))
+		return 0;
+	return 1;
+}
+
+/*
+ * Hand the protocol v2 conversation on our stdin/stdout over to the
+ * resident upload-pack listening on "path" and relay the data in both
+ * directions until it hangs up. Returns -1 without having consumed any
+ * input if no daemon is listening, so that the caller can serve the
+ * request itself.
+ */
+static int relay_to_daemon(const char *path, int stateless_rpc)
+{
+	char buf[LARGE_PACKET_MAX];
+	char *gitdir, *line;
+	int to_daemon = 1;
+	int fd;
+
+	fd = unix_stream_connect(path, 0);
+	if (fd < 0) {
+		trace2_data_string("upload-pack", the_repository,
+				   "daemon/unavailable", path);
+		return -1;
+	}
+
+	gitdir = real_pathdup(repo_get_git_dir(the_repository), 1);
+	packet_write_fmt(fd, "%s\n", stateless_rpc ? "stateless-rpc" : "stateful");
+	packet_write_fmt(fd, "gitdir=%s\n", gitdir);
+	free(gitdir);
+
+	/*
+	 * The daemon serves a single repository; it tells us whether it is
+	 * ours before we hand over anything the client sent.
+	 */
+	if (packet_read_line_gently(fd, NULL, &line) < 0 ||
+	    strcmp(line, "ok")) {
+		trace2_data_string("upload-pack", the_repository,
+				   "daemon/rejected", path);
+		close(fd);
+		return -1;
+	}
+	trace2_data_string("upload-pack", the_repository, "daemon", path);
+
+	for (;;) {
+		struct pollfd pfd[2];
+		int nr = 0, daemon_pos;
+		ssize_t sz;
+
+		if (to_daemon) {
+			pfd[nr].fd = 0;
+			pfd[nr].events = POLLIN;
+			nr++;
+		}
+		daemon_pos = nr;
+		pfd[nr].fd = fd;
+		pfd[nr].events = POLLIN;
+		nr++;
+
+		if (poll(pfd, nr, -1) < 0) {
+			if (errno != EINTR)
+				die_errno(_("poll failed"));
+			continue;
+		}
+
+		if (to_daemon && (pfd[0].revents & (POLLIN | POLLHUP))) {
+			sz = xread(0, buf, sizeof(buf));
+			if (sz < 0)
+				die_errno(_("read error"));
+			if (!sz) {
+				shutdown(fd, SHUT_WR);
+				to_daemon = 0;
+			} else {
+				write_or_die(fd, buf, sz);
+			}
+		}
+
+		if (pfd[daemon_pos].revents & (POLLIN | POLLHUP)) {
+			sz = xread(fd, buf, sizeof(buf));
+			if (sz < 0)
+				die_errno(_("read error from upload-pack daemon"));
+			if (!sz)
+				break;
+			write_or_die(1, buf, sz);
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void serve_connection(int fd, const char *gitdir)
+{
+	const char *line, *arg;
+	int stateless_rpc;
+
+	dup2(fd, 0);
+	dup2(fd, 1);
+	close(fd);
+
+	line = packet_read_line(0, NULL);
+	if (line && !strcmp(line, "stateless-rpc"))
+		stateless_rpc = 1;
+	else if (line && !strcmp(line, "stateful"))
+		stateless_rpc = 0;
+	else
+		die(_("upload-pack daemon: bad connection header"));
+
+	line = packet_read_line(0, NULL);
+	if (!line || !skip_prefix(line, "gitdir=", &arg))
+		die(_("upload-pack daemon: bad connection header"));
+	if (strcmp(arg, gitdir)) {
+		packet_write_fmt(1, "wrong-repository\n");
+		return;
+	}
+	packet_write_fmt(1, "ok\n");
+
+	protocol_v2_serve_loop(stateless_rpc);
+}
+
+/*
+ * Accept connections from front-end upload-pack processes on "path"
+ * until the socket is removed or taken over, serving each of them in a
+ * child forked from this process. The children start out with the
+ * configuration, packfiles and commit-graph we loaded once up front.
+ */
+static int serve_socket(const char *path)
+{
+	struct unix_stream_listen_opts opts = UNIX_STREAM_LISTEN_OPTS_INIT;
+	struct unix_ss_socket *server;
+	char *gitdir;
+	int ret;
+
+	ret = unix_ss_create(path, &opts, -1, &server);
+	if (ret == -2)
+		return error(_("another upload-pack daemon is listening on '%s'"),
+			     path);
+	if (ret)
+		return error_errno(_("could not listen on '%s'"), path);
+
+	gitdir = real_pathdup(repo_get_git_dir(the_repository), 1);
+
+	/* Warm up what every request is going to need. */
+	prepare_repo_settings(the_repository);
+	get_all_packs(the_repository);
+	generation_numbers_enabled(the_repository);
+
+	trace2_region_enter("upload-pack", "daemon", the_repository);
+	for (;;) {
+		struct pollfd pfd;
+		pid_t pid;
+		int fd;
+
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			; /* reap finished children */
+
+		if (unix_ss_was_stolen(server))
+			break;
+
+		pfd.fd = server->fd_socket;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		fd = accept(server->fd_socket, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR && errno != EAGAIN)
+				error_errno(_("accept failed"));
+			continue;
+		}
+
+		/* Pick up packs written since the previous request. */
+		reprepare_packed_git(the_repository);
+		trace2_data_intmax("upload-pack", the_repository,
+				   "daemon/connection", 1);
+
+		fflush(NULL);
+		pid = fork();
+		if (pid < 0) {
+			error_errno(_("fork failed"));
+			close(fd);
+			continue;
+		}
+		if (!pid) {
+			close(server->fd_socket);
+			serve_connection(fd, gitdir);
+			exit(0);
+		}
+		close(fd);
+	}
+	trace2_region_leave("upload-pack", "daemon", the_repository);
+
+	unix_ss_free(server);
+	free(gitdir);
+	return 0;
+}
+
+#endif /* NO_UNIX_SOCKETS */
+
 int cmd_upload_pack(int argc,
 		    const char **argv,
 		    const char *prefix,
 		    struct repository *repo UNUSED)
 {
 	const char *dir;
+	char *serve_socket_path = NULL;
 	int strict = 0;
 	int advertise_refs = 0;
 	int stateless_rpc = 0;
@@ -37,11 +277,14 @@ int cmd_upload_pack(int argc,
 			 N_("do not try <directory>/.git/ if <directory> is no Git directory")),
 		OPT_INTEGER(0, "timeout", &timeout,
 			    N_("interrupt transfer after <n> seconds of inactivity")),
+		OPT_STRING(0, "serve-socket", &serve_socket_path, N_("path"),
+			   N_("serve protocol v2 requests relayed through a Unix socket")),
 		OPT_END()
 	};
 	unsigned enter_repo_flags = ENTER_REPO_ANY_OWNER_OK;
 
 	packet_trace_identity("upload-pack");
+	upload_pack_set_pack_objects_fn(cmd_pack_objects);
 	disable_replace_refs();
 	save_commit_buffer = 0;
 	xsetenv(NO_LAZY_FETCH_ENVIRONMENT, "1", 0);
@@ -55,17 +298,48 @@ int cmd_upload_pack(int argc,
 
 	dir = argv[0];
 
+	/* We are about to chdir() into the repository. */
+	if (serve_socket_path)
+		serve_socket_path = absolute_pathdup(serve_socket_path);
+
 	if (strict)
 		enter_repo_flags |= ENTER_REPO_STRICT;
 	if (!enter_repo(dir, enter_repo_flags))
 		die("'%s' does not appear to be a git repository", dir);
 
+	if (serve_socket_path) {
+#ifndef NO_UNIX_SOCKETS
+		int ret = !!serve_socket(serve_socket_path);
+		free(serve_socket_path);
+		return ret;
+#else
+		die(_("--serve-socket requires Unix socket support"));
+#endif
+	}
+
 	switch (determine_protocol_version_server()) {
 	case protocol_v2:
-		if (advertise_refs)
+		if (advertise_refs) {
 			protocol_v2_advertise_capabilities();
-		else
+		} else {
+#ifndef NO_UNIX_SOCKETS
+			char *daemon_socket = NULL;
+			int relayed;
+
+			git_protected_config(daemon_socket_config, &daemon_socket);
+			if (daemon_socket && !can_relay_to_daemon(strict, timeout)) {
+				trace2_data_string("upload-pack", the_repository,
+						   "daemon/skipped", daemon_socket);
+				FREE_AND_NULL(daemon_socket);
+			}
+			relayed = daemon_socket &&
+				  !relay_to_daemon(daemon_socket, stateless_rpc);
+			free(daemon_socket);
+			if (relayed)
+				break;
+#endif
 			protocol_v2_serve_loop(stateless_rpc);
+		}
 		break;
 	case protocol_v1:
 		/*
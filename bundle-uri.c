@@ -289,30 +289,44 @@ static char *find_temp_filename(void)
 	return strbuf_detach(&name, NULL);
 }
 
-static int download_https_uri_to_file(const char *file, const char *uri)
+struct https_download {
+	struct child_process cp;
+	FILE *out;
+	unsigned started:1;
+};
+
+/*
+ * Ask a "git-remote-https" helper to download "uri" to "file", without
+ * waiting for it: finish_https_download() does.
+ */
+static int start_https_download(struct https_download *d,
+				const char *file, const char *uri)
 {
 	int result = 0;
-	struct child_process cp = CHILD_PROCESS_INIT;
-	FILE *child_in = NULL, *child_out = NULL;
+	FILE *child_in = NULL;
 	struct strbuf line = STRBUF_INIT;
 	int found_get = 0;
 
-	strvec_pushl(&cp.args, "git-remote-https", uri, NULL);
-	cp.err = -1;
-	cp.in = -1;
-	cp.out = -1;
+	child_process_init(&d->cp);
+	strvec_pushl(&d->cp.args, "git-remote-https", uri, NULL);
+	d->cp.err = -1;
+	d->cp.in = -1;
+	d->cp.out = -1;
+	d->cp.clean_on_exit = 1;
+	d->out = NULL;
 
-	if (start_command(&cp))
+	if (start_command(&d->cp))
 		return 1;
+	d->started = 1;
 
-	child_in = fdopen(cp.in, "w");
+	child_in = fdopen(d->cp.in, "w");
 	if (!child_in) {
 		result = 1;
 		goto cleanup;
 	}
 
-	child_out = fdopen(cp.out, "r");
-	if (!child_out) {
+	d->out = fdopen(d->cp.out, "r");
+	if (!d->out) {
 		result = 1;
 		goto cleanup;
 	}
@@ -320,7 +334,7 @@ static int download_https_uri_to_file(const char *file, const char *uri)
 	fprintf(child_in, "capabilities\n");
 	fflush(child_in);
 
-	while (!strbuf_getline(&line, child_out)) {
+	while (!strbuf_getline(&line, d->out)) {
 		if (!line.len)
 			break;
 		if (!strcmp(line.buf, "get"))
@@ -338,13 +352,27 @@ static int download_https_uri_to_file(const char *file, const char *uri)
 cleanup:
 	if (child_in)
 		fclose(child_in);
-	if (finish_command(&cp))
-		return 1;
-	if (child_out)
-		fclose(child_out);
 	return result;
 }
 
+static int finish_https_download(struct https_download *d, int result)
+{
+	if (!d->started)
+		return result;
+	if (finish_command(&d->cp))
+		result = 1;
+	if (d->out)
+		fclose(d->out);
+	return result;
+}
+
+static int download_https_uri_to_file(const char *file, const char *uri)
+{
+	struct https_download d = { 0 };
+
+	return finish_https_download(&d, start_https_download(&d, file, uri));
+}
+
 static int copy_uri_to_file(const char *filename, const char *uri)
 {
 	const char *out;
@@ -423,6 +451,12 @@ static int unbundle_from_file(struct repository *r, const char *file)
 	return result;
 }
 
+/**
+ * This limits the recursion on fetch_bundle_uri_internal() when following
+ * bundle lists.
+ */
+static int max_bundle_uri_depth = 4;
+
 struct bundle_list_context {
 	struct repository *r;
 	struct bundle_list *list;
@@ -646,6 +680,75 @@ static int fetch_bundles_by_token(struct repository *r,
 	return cur >= 0;
 }
 
+struct https_bundles {
+	struct remote_bundle_info **items;
+	size_t alloc;
+	size_t nr;
+};
+
+static int append_https_bundle(struct remote_bundle_info *bundle, void *data)
+{
+	struct https_bundles *list = data;
+
+	if (!bundle->file && !bundle->downloaded &&
+	    (starts_with(bundle->uri, "https:") ||
+	     starts_with(bundle->uri, "http:"))) {
+		ALLOC_GROW(list->items, list->nr + 1, list->alloc);
+		list->items[list->nr++] = bundle;
+	}
+	return 0;
+}
+
+/*
+ * Download the bundles of a list in "all" mode from HTTP(S) servers
+ * ahead of download_bundle_to_file(), up to "fetch.uriJobs" at a time.
+ * The ones that fail are downloaded again, one at a time, by
+ * fetch_bundle_uri_internal(), which reports the errors.
+ */
+static void download_https_bundles(struct bundle_list *list)
+{
+	struct https_bundles bundles = { 0 };
+	struct https_download *downloads;
+	int *results;
+	size_t jobs = fetch_pack_uri_jobs();
+	size_t started = 0, finished = 0;
+
+	for_all_bundles_in_list(list, append_https_bundle, &bundles);
+	if (bundles.nr < 2 || jobs < 2) {
+		free(bundles.items);
+		return;
+	}
+
+	CALLOC_ARRAY(downloads, bundles.nr);
+	CALLOC_ARRAY(results, bundles.nr);
+	while (finished < bundles.nr) {
+		struct remote_bundle_info *bundle;
+
+		while (started < bundles.nr && started - finished < jobs) {
+			bundle = bundles.items[started];
+			if (!(bundle->file = find_temp_filename()))
+				results[started] = 1;
+			else
+				results[started] = start_https_download(
+					&downloads[started], bundle->file,
+					bundle->uri);
+			started++;
+		}
+
+		bundle = bundles.items[finished];
+		if (!finish_https_download(&downloads[finished],
+					   results[finished]))
+			bundle->downloaded = 1;
+		else if (bundle->file)
+			unlink(bundle->file);
+		finished++;
+	}
+
+	free(results);
+	free(downloads);
+	free(bundles.items);
+}
+
 static int download_bundle_list(struct repository *r,
 				struct bundle_list *local_list,
 				struct bundle_list *global_list,
@@ -658,6 +761,11 @@ static int download_bundle_list(struct repository *r,
 		.mode = local_list->mode,
 	};
 
+	/* download_bundle_to_file() goes two levels deeper. */
+	if (local_list->mode == BUNDLE_MODE_ALL &&
+	    depth + 2 < max_bundle_uri_depth)
+		download_https_bundles(local_list);
+
 	return for_all_bundles_in_list(local_list, download_bundle_to_file, &ctx);
 }
 
@@ -700,12 +808,6 @@ static int fetch_bundle_list_in_config_format(struct repository *r,
 	return result;
 }
 
-/**
- * This limits the recursion on fetch_bundle_uri_internal() when following
- * bundle lists.
- */
-static int max_bundle_uri_depth = 4;
-
 /**
  * Recursively download all bundles advertised at the given URI
  * to files. If the file is a bundle, then add it to the given
@@ -732,7 +834,8 @@ static int fetch_bundle_uri_internal(struct repository *r,
 		goto cleanup;
 	}
 
-	if ((result = copy_uri_to_file(bundle->file, bundle->uri))) {
+	if (!bundle->downloaded &&
+	    (result = copy_uri_to_file(bundle->file, bundle->uri))) {
 		warning(_("failed to download bundle from URI '%s'"), bundle->uri);
 		goto cleanup;
 	}
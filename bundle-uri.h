@@ -37,6 +37,12 @@ struct remote_bundle_info {
 	 */
 	char *file;
 
+	/**
+	 * If the contents at 'uri' have already been downloaded to
+	 * 'file', then this boolean is true.
+	 */
+	unsigned downloaded:1;
+
 	/**
 	 * If the bundle has been unbundled successfully, then
 	 * this boolean is true.
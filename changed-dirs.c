@@ -0,0 +1,379 @@
+#include "git-compat-util.h"
+#include "changed-dirs.h"
+#include "bloom.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "commit-slab.h"
+#include "object-store-ll.h"
+#include "pathspec.h"
+#include "repository.h"
+#include "strbuf.h"
+#include "tree.h"
+#include "tree-walk.h"
+
+#define CHANGED_DIRS_SEED 0x293ae76f
+#define CHANGED_DIRS_EXTENSION_SEED 0x7e646e2c
+#define CHANGED_DIRS_DEPTH_MASK 3
+#define CHANGED_DIRS_ROOT_CHANGES_MAX ((1u << 30) - 1)
+
+define_commit_slab(changed_dirs_slab, struct changed_dirs);
+
+static struct changed_dirs_slab changed_dirs_slab;
+
+static uint32_t changed_dirs_hash(const char *path, size_t len)
+{
+	return murmur3_seeded_v2(CHANGED_DIRS_SEED, path, len);
+}
+
+static const char *find_last_dot(const char *s, size_t len)
+{
+	while (len--)
+		if (s[len] == '.')
+			return s + len;
+	return NULL;
+}
+
+/*
+ * The extension of a file name is everything from its last dot, and is
+ * lowercased so that it serves case-insensitive pathspecs as well.
+ */
+static int extension_hash(const char *name, size_t len,
+			  struct strbuf *scratch, uint32_t *hash)
+{
+	const char *dot = find_last_dot(name, len);
+
+	if (!dot)
+		return -1;
+	strbuf_reset(scratch);
+	strbuf_add(scratch, dot, name + len - dot);
+	strbuf_tolower(scratch);
+	*hash = murmur3_seeded_v2(CHANGED_DIRS_EXTENSION_SEED,
+				  scratch->buf, scratch->len);
+	return 0;
+}
+
+int fill_changed_dirs_key(const struct pathspec_item *item,
+			  struct changed_dirs_key *key)
+{
+	struct strbuf path = STRBUF_INIT, scratch = STRBUF_INIT;
+	const char *p, *end, *tail;
+
+	memset(key, 0, sizeof(*key));
+	if (item->magic & ~(PATHSPEC_FROMTOP | PATHSPEC_LITERAL |
+			    PATHSPEC_GLOB | PATHSPEC_ICASE))
+		return -1;
+
+	/* Case-insensitive pathspecs fold ASCII letters only. */
+	strbuf_add(&path, item->match, item->len);
+	if (item->magic & PATHSPEC_ICASE)
+		strbuf_tolower(&path);
+
+	/*
+	 * The components before the first wildcard, without the last one
+	 * unless there is no wildcard at all, are leading components of
+	 * every matching path.
+	 */
+	p = path.buf;
+	end = path.buf + item->nowildcard_len;
+	while (key->depth < CHANGED_DIRS_MAX_DEPTH) {
+		const char *slash = memchr(p, '/', end - p);
+
+		if (!slash) {
+			if (item->nowildcard_len < item->len || p == end)
+				break;
+			slash = end;
+		}
+		if (slash == p)
+			break;
+		key->hashes[key->depth++] = changed_dirs_hash(path.buf,
+							      slash - path.buf);
+		if (slash == end)
+			break;
+		p = slash + 1;
+	}
+
+	/*
+	 * Every matching path ends with the text after the last wildcard,
+	 * or is below a directory whose name does (e.g. with a literal
+	 * pathspec naming a directory). Either way, a changed entry has
+	 * its extension, if that text has one.
+	 */
+	tail = path.buf + path.len;
+	if (item->nowildcard_len < item->len)
+		while (tail > path.buf && !is_glob_special(tail[-1]) &&
+		       tail[-1] != ']')
+			tail--;
+	else
+		tail = path.buf;
+	p = find_last_dot(tail, path.buf + path.len - tail);
+	if (p && !memchr(p, '/', path.buf + path.len - p) &&
+	    !extension_hash(p, path.buf + path.len - p, &scratch,
+			    &key->extension_hash))
+		key->has_extension = 1;
+
+	strbuf_release(&path);
+	strbuf_release(&scratch);
+	return key->depth || key->has_extension ? 0 : -1;
+}
+
+uint32_t changed_dirs_root_changes(const struct changed_dirs *dirs)
+{
+	return get_be32(dirs->data) >> 2;
+}
+
+static int has_hash(const struct changed_dirs *dirs, uint32_t hash)
+{
+	size_t lo = 1, hi = dirs->nr_words;
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		uint32_t cur = get_be32(dirs->data + 4 * mi);
+
+		if (cur == hash)
+			return 1;
+		if (cur < hash)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return 0;
+}
+
+int changed_dirs_contains(const struct changed_dirs *dirs,
+			  const struct changed_dirs_key *key)
+{
+	int depth = get_be32(dirs->data) & CHANGED_DIRS_DEPTH_MASK;
+
+	if (!depth || depth > CHANGED_DIRS_MAX_DEPTH)
+		return 1;
+	if (key->depth &&
+	    !has_hash(dirs, key->hashes[(key->depth < depth ?
+					 key->depth : depth) - 1]))
+		return 0;
+	if (key->has_extension && !has_hash(dirs, key->extension_hash))
+		return 0;
+	return 1;
+}
+
+int load_changed_dirs_from_graph(struct commit_graph *g,
+				 struct changed_dirs *dirs,
+				 uint32_t graph_pos)
+{
+	uint32_t lex_pos, start, end;
+	size_t max;
+
+	while (graph_pos < g->num_commits_in_base)
+		g = g->base_graph;
+
+	if (!g->chunk_changed_dirs_index)
+		return 0;
+
+	lex_pos = graph_pos - g->num_commits_in_base;
+	end = get_be32(g->chunk_changed_dirs_index + 4 * lex_pos);
+	if (lex_pos > 0)
+		start = get_be32(g->chunk_changed_dirs_index + 4 * (lex_pos - 1));
+	else
+		start = 0;
+
+	/* Every summary holds at least its header word. */
+	max = (g->chunk_changed_dirs_data_size -
+	       CHANGED_DIRS_CHUNK_HEADER_SIZE) / sizeof(uint32_t);
+	if (end > max || start >= end) {
+		warning("ignoring invalid changed-directory summary offsets"
+			" (%"PRIuMAX", %"PRIuMAX") at pos %"PRIuMAX" of %s",
+			(uintmax_t)start, (uintmax_t)end, (uintmax_t)lex_pos,
+			g->filename);
+		return 0;
+	}
+
+	dirs->data = g->chunk_changed_dirs_data +
+		CHANGED_DIRS_CHUNK_HEADER_SIZE + sizeof(uint32_t) * start;
+	dirs->nr_words = end - start;
+	dirs->to_free = NULL;
+	return 1;
+}
+
+int load_changed_dirs(struct repository *r, struct commit *c,
+		      struct changed_dirs *dirs)
+{
+	uint32_t graph_pos;
+
+	if (!repo_find_commit_pos_in_graph(r, c, &graph_pos))
+		return 0;
+	return load_changed_dirs_from_graph(r->objects->commit_graph, dirs,
+					    graph_pos);
+}
+
+int repo_has_changed_dirs(struct repository *r)
+{
+	struct commit_graph *g;
+
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (g->chunk_changed_dirs_index)
+			return 1;
+	return 0;
+}
+
+struct hash_list {
+	uint32_t *hashes;
+	size_t nr, alloc;
+};
+
+static void add_hash(struct hash_list *list, uint32_t hash)
+{
+	ALLOC_GROW(list->hashes, list->nr + 1, list->alloc);
+	list->hashes[list->nr++] = hash;
+}
+
+static int uint32_cmp(const void *va, const void *vb)
+{
+	uint32_t a = *(const uint32_t *)va, b = *(const uint32_t *)vb;
+
+	return a < b ? -1 : a > b;
+}
+
+static void sort_and_dedup_hashes(struct hash_list *list)
+{
+	size_t i, j;
+
+	QSORT(list->hashes, list->nr, uint32_cmp);
+	for (i = j = 0; i < list->nr; i++)
+		if (!j || list->hashes[j - 1] != list->hashes[i])
+			list->hashes[j++] = list->hashes[i];
+	list->nr = j;
+}
+
+struct changed_dir_hashes {
+	struct hash_list levels[CHANGED_DIRS_MAX_DEPTH];
+	struct hash_list extensions;
+	struct strbuf scratch;
+	uint32_t root_changes;
+};
+
+/*
+ * Record the hashes of the leading components, and of the extension,
+ * of a path which differs between the trees being summarized.
+ */
+static int add_changed_entry(const struct name_entry *old_e,
+			     const struct name_entry *new_e,
+			     struct strbuf *base, int depth, void *data)
+{
+	struct changed_dir_hashes *out = data;
+	const struct name_entry *e = new_e ? new_e : old_e;
+	size_t baselen = base->len, len = tree_entry_len(e);
+	uint32_t hash;
+
+	if (!depth && out->root_changes < CHANGED_DIRS_ROOT_CHANGES_MAX)
+		out->root_changes++;
+
+	if (depth < CHANGED_DIRS_MAX_DEPTH) {
+		strbuf_add(base, e->path, len);
+		add_hash(&out->levels[depth],
+			 changed_dirs_hash(base->buf, base->len));
+
+		strbuf_reset(&out->scratch);
+		strbuf_addbuf(&out->scratch, base);
+		strbuf_tolower(&out->scratch);
+		if (strcmp(out->scratch.buf, base->buf))
+			add_hash(&out->levels[depth],
+				 changed_dirs_hash(out->scratch.buf,
+						   out->scratch.len));
+		strbuf_setlen(base, baselen);
+	}
+	if (!extension_hash(e->path, len, &out->scratch, &hash))
+		add_hash(&out->extensions, hash);
+	return 0;
+}
+
+static void summarize_changed_dirs(struct repository *r, struct commit *c,
+				   struct changed_dirs *dirs)
+{
+	struct changed_dir_hashes h = { .scratch = STRBUF_INIT };
+	struct strbuf base = STRBUF_INIT;
+	const struct object_id *old_tree = NULL;
+	struct hash_list all = { 0 };
+	size_t i;
+	int depth, d, unwalkable;
+	unsigned char *p;
+
+	repo_parse_commit(r, c);
+	if (c->parents) {
+		repo_parse_commit(r, c->parents->item);
+		old_tree = get_commit_tree_oid(c->parents->item);
+	}
+
+	/*
+	 * Keep the extensions and as many levels as fit in
+	 * CHANGED_DIRS_MAX_ENTRIES, so that huge commits (e.g. imports)
+	 * still get a useful summary. A commit whose trees cannot be
+	 * walked, e.g. because they are nested too deep, gets the summary
+	 * of one changing too many directories.
+	 */
+	unwalkable = walk_changed_tree_entries(r, old_tree,
+					     get_commit_tree_oid(c), &base,
+					     add_changed_entry, &h) < 0;
+	if (unwalkable && !h.root_changes)
+		h.root_changes = 1;
+	depth = 0;
+	for (d = -1; !unwalkable && d < CHANGED_DIRS_MAX_DEPTH; d++) {
+		struct hash_list *list = d < 0 ? &h.extensions : &h.levels[d];
+
+		sort_and_dedup_hashes(list);
+		if (all.nr + list->nr > CHANGED_DIRS_MAX_ENTRIES)
+			break;
+		ALLOC_GROW(all.hashes, all.nr + list->nr, all.alloc);
+		COPY_ARRAY(all.hashes + all.nr, list->hashes, list->nr);
+		all.nr += list->nr;
+		depth = d + 1;
+	}
+	if (!depth)
+		all.nr = 0;
+	sort_and_dedup_hashes(&all);
+
+	dirs->nr_words = all.nr + 1;
+	dirs->data = dirs->to_free = p = xmalloc(sizeof(uint32_t) * (all.nr + 1));
+	put_be32(p, h.root_changes << 2 | depth);
+	for (i = 0; i < all.nr; i++)
+		put_be32(p + 4 * (i + 1), all.hashes[i]);
+
+	free(all.hashes);
+	free(h.extensions.hashes);
+	for (d = 0; d < CHANGED_DIRS_MAX_DEPTH; d++)
+		free(h.levels[d].hashes);
+	strbuf_release(&h.scratch);
+	strbuf_release(&base);
+}
+
+void init_changed_dirs(void)
+{
+	init_changed_dirs_slab(&changed_dirs_slab);
+}
+
+static void free_changed_dirs(struct changed_dirs *dirs)
+{
+	free(dirs->to_free);
+}
+
+void deinit_changed_dirs(void)
+{
+	deep_clear_changed_dirs_slab(&changed_dirs_slab, free_changed_dirs);
+}
+
+const struct changed_dirs *get_or_compute_changed_dirs(struct repository *r,
+							struct commit *c,
+							int *computed)
+{
+	struct changed_dirs *dirs = changed_dirs_slab_at(&changed_dirs_slab, c);
+
+	if (computed)
+		*computed = 0;
+	if (dirs->data)
+		return dirs;
+	if (load_changed_dirs(r, c, dirs))
+		return dirs;
+
+	summarize_changed_dirs(r, c, dirs);
+	if (computed)
+		*computed = 1;
+	return dirs;
+}
@@ -0,0 +1,109 @@
+#ifndef CHANGED_DIRS_H
+#define CHANGED_DIRS_H
+
+struct commit;
+struct commit_graph;
+struct pathspec_item;
+struct repository;
+
+/*
+ * A changed-directory summary records which leading directories of the
+ * paths changed by a commit (compared to its first parent, or to the
+ * empty tree for root commits) were touched. It is kept in the
+ * commit-graph next to the changed-path Bloom filters, and lets history
+ * traversals limited by pathspecs which cannot use those filters, such
+ * as 'git log -- "t/t42*.sh"', skip commits without diffing their trees.
+ *
+ * Unlike the Bloom filters, a summary is exact up to hash collisions: it
+ * stores the sorted 32-bit hashes of the first component of each changed
+ * path and, if there are not too many of them, of its first two
+ * components (e.g. "Documentation" and "Documentation/config" for
+ * "Documentation/config/core.txt", or "Makefile" for "Makefile"). These
+ * are also stored lowercased for case-insensitive pathspecs, along with
+ * the lowercased extensions of the changed files (".txt"), which let
+ * pathspecs like "*.txt" skip commits too.
+ */
+
+#define CHANGED_DIRS_VERSION 2
+#define CHANGED_DIRS_MAX_DEPTH 2
+#define CHANGED_DIRS_MAX_ENTRIES 512
+#define CHANGED_DIRS_CHUNK_HEADER_SIZE sizeof(uint32_t)
+
+struct changed_dirs {
+	/*
+	 * The summary as written to the commit-graph, i.e. 'nr_words'
+	 * 32-bit words in network byte order. The first word holds the
+	 * number of path components covered by the hashes (0 if the
+	 * commit changes too many directories to be summarized) in its
+	 * two low bits, and the number of entries of the root tree which
+	 * changed in the other bits. It is followed by the sorted hashes.
+	 */
+	const unsigned char *data;
+	size_t nr_words;
+	unsigned char *to_free;
+};
+
+/*
+ * A pathspec element reduced to what all the paths it matches have in
+ * common, to be looked up in changed-directory summaries.
+ */
+struct changed_dirs_key {
+	/* Number of literal leading components hashed, if any. */
+	int depth;
+	uint32_t hashes[CHANGED_DIRS_MAX_DEPTH];
+
+	/* Whether the matched files all have the same extension. */
+	int has_extension;
+	uint32_t extension_hash;
+};
+
+/*
+ * Fill `key` for the pathspec element `item`. Return -1 if nothing is
+ * known about the paths it matches (e.g. for "*" or exclude pathspecs),
+ * in which case it cannot be looked up.
+ */
+int fill_changed_dirs_key(const struct pathspec_item *item,
+			  struct changed_dirs_key *key);
+
+/* The number of root tree entries changed by the summarized commit. */
+uint32_t changed_dirs_root_changes(const struct changed_dirs *dirs);
+
+/*
+ * Return 0 if the commit summarized by `dirs` definitely did not touch
+ * any path matching `key`, and 1 otherwise.
+ */
+int changed_dirs_contains(const struct changed_dirs *dirs,
+			  const struct changed_dirs_key *key);
+
+/*
+ * Point `dirs` to the summary of the commit at `graph_pos` in `g`.
+ * Return 1 on success, or 0 if the layer containing the commit has no
+ * summaries (or they are corrupt).
+ */
+int load_changed_dirs_from_graph(struct commit_graph *g,
+				 struct changed_dirs *dirs,
+				 uint32_t graph_pos);
+
+/*
+ * Look up the summary of commit `c` in the commit-graph of `r`. Return 1
+ * if it was found, and 0 otherwise.
+ */
+int load_changed_dirs(struct repository *r, struct commit *c,
+		      struct changed_dirs *dirs);
+
+/* Return 1 if any layer of the commit-graph of `r` has summaries. */
+int repo_has_changed_dirs(struct repository *r);
+
+void init_changed_dirs(void);
+void deinit_changed_dirs(void);
+
+/*
+ * Return the summary of commit `c`, loading it from the commit-graph or
+ * computing it, and keep it until deinit_changed_dirs(). Set `*computed`
+ * if it had to be computed.
+ */
+const struct changed_dirs *get_or_compute_changed_dirs(struct repository *r,
+							struct commit *c,
+							int *computed);
+
+#endif /* CHANGED_DIRS_H */
@@ -8,6 +8,7 @@
 #include "hex.h"
 #include "lockfile.h"
 #include "packfile.h"
+#include "parse.h"
 #include "commit.h"
 #include "object.h"
 #include "refs.h"
@@ -22,9 +23,11 @@
 #include "replace-object.h"
 #include "progress.h"
 #include "bloom.h"
+#include "changed-dirs.h"
 #include "commit-slab.h"
 #include "shallow.h"
 #include "json-writer.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "chunk-format.h"
@@ -52,9 +55,13 @@ void git_test_write_commit_graph_or_die(void)
 #define GRAPH_CHUNKID_EXTRAEDGES 0x45444745 /* "EDGE" */
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
+#define GRAPH_CHUNKID_CHANGEDDIRSINDEX 0x44495258 /* "DIRX" */
+#define GRAPH_CHUNKID_CHANGEDDIRSDATA 0x44495244 /* "DIRD" */
+#define GRAPH_CHUNKID_REACHABILITYINDEX 0x52494458 /* "RIDX" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
 
 #define GRAPH_DATA_WIDTH (the_hash_algo->rawsz + 16)
+#define GRAPH_REACH_LABEL_WIDTH 12
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -216,7 +223,7 @@ static struct commit_graph *alloc_commit_graph(void)
 	return g;
 }
 
-static int commit_graph_compatible(struct repository *r)
+int commit_graph_compatible(struct repository *r)
 {
 	if (!r->gitdir)
 		return 0;
@@ -368,6 +375,50 @@ static int graph_read_bloom_data(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_changed_dirs_index(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / 4 != g->num_commits) {
+		warning(_("commit-graph changed-directory index chunk is too small"));
+		return -1;
+	}
+	g->chunk_changed_dirs_index = chunk_start;
+	return 0;
+}
+
+static int graph_read_changed_dirs_data(const unsigned char *chunk_start,
+					size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	if (chunk_size < CHANGED_DIRS_CHUNK_HEADER_SIZE) {
+		warning(_("ignoring too-small changed-directory chunk"
+			" (%"PRIuMAX" < %"PRIuMAX") in commit-graph file"),
+			(uintmax_t)chunk_size,
+			(uintmax_t)CHANGED_DIRS_CHUNK_HEADER_SIZE);
+		return -1;
+	}
+	if (get_be32(chunk_start) != CHANGED_DIRS_VERSION)
+		return 0;
+
+	g->chunk_changed_dirs_data = chunk_start;
+	g->chunk_changed_dirs_data_size = chunk_size;
+	return 0;
+}
+
+static int graph_read_reachability_index(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / GRAPH_REACH_LABEL_WIDTH != g->num_commits) {
+		warning(_("commit-graph reachability index chunk is too small"));
+		return -1;
+	}
+	g->chunk_reachability_index = chunk_start;
+	return 0;
+}
+
 struct commit_graph *parse_commit_graph(struct repo_settings *s,
 					void *graph_map, size_t graph_size)
 {
@@ -473,6 +524,18 @@ struct commit_graph *parse_commit_graph(struct repo_settings *s,
 		FREE_AND_NULL(graph->bloom_filter_settings);
 	}
 
+	read_chunk(cf, GRAPH_CHUNKID_CHANGEDDIRSINDEX,
+		   graph_read_changed_dirs_index, graph);
+	read_chunk(cf, GRAPH_CHUNKID_CHANGEDDIRSDATA,
+		   graph_read_changed_dirs_data, graph);
+	if (!graph->chunk_changed_dirs_index || !graph->chunk_changed_dirs_data) {
+		graph->chunk_changed_dirs_index = NULL;
+		graph->chunk_changed_dirs_data = NULL;
+	}
+
+	read_chunk(cf, GRAPH_CHUNKID_REACHABILITYINDEX,
+		   graph_read_reachability_index, graph);
+
 	oidread(&graph->oid, graph->data + graph->data_len - graph->hash_len,
 		the_repository->hash_algo);
 
@@ -887,12 +950,47 @@ static struct commit_list **insert_parent_or_die(struct repository *r,
 	return &commit_list_insert(c, pptr)->next;
 }
 
+static timestamp_t read_date_from_graph(struct commit_graph *g,
+					const unsigned char *commit_data)
+{
+	uint64_t date_high, date_low;
+
+	date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
+	date_low = get_be32(commit_data + g->hash_len + 12);
+	return (timestamp_t)((date_high << 32) | date_low);
+}
+
+static timestamp_t read_generation_from_graph(struct commit_graph *g,
+					      uint32_t lex_index,
+					      const unsigned char *commit_data,
+					      timestamp_t date)
+{
+	uint32_t offset_pos;
+	uint64_t offset;
+
+	if (!g->read_generation_data)
+		return get_be32(commit_data + g->hash_len + 8) >> 2;
+
+	offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
+
+	if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
+		if (!g->chunk_generation_data_overflow)
+			die(_("commit-graph requires overflow generation data but has none"));
+
+		offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
+		if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
+			die(_("commit-graph overflow generation data is too small"));
+		return date +
+			get_be64(g->chunk_generation_data_overflow + sizeof(uint64_t) * offset_pos);
+	}
+	return date + offset;
+}
+
 static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
 {
 	const unsigned char *commit_data;
 	struct commit_graph_data *graph_data;
-	uint32_t lex_index, offset_pos;
-	uint64_t date_high, date_low, offset;
+	uint32_t lex_index;
 
 	while (pos < g->num_commits_in_base)
 		g = g->base_graph;
@@ -906,26 +1004,10 @@ static void fill_commit_graph_info(struct commit *item, struct commit_graph *g,
 	graph_data = commit_graph_data_at(item);
 	graph_data->graph_pos = pos;
 
-	date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
-	date_low = get_be32(commit_data + g->hash_len + 12);
-	item->date = (timestamp_t)((date_high << 32) | date_low);
-
-	if (g->read_generation_data) {
-		offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
-
-		if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
-			if (!g->chunk_generation_data_overflow)
-				die(_("commit-graph requires overflow generation data but has none"));
-
-			offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
-			if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
-				die(_("commit-graph overflow generation data is too small"));
-			graph_data->generation = item->date +
-				get_be64(g->chunk_generation_data_overflow + sizeof(uint64_t) * offset_pos);
-		} else
-			graph_data->generation = item->date + offset;
-	} else
-		graph_data->generation = get_be32(commit_data + g->hash_len + 8) >> 2;
+	item->date = read_date_from_graph(g, commit_data);
+	graph_data->generation = read_generation_from_graph(g, lex_index,
+							    commit_data,
+							    item->date);
 
 	if (g->topo_levels)
 		*topo_level_slab_at(g->topo_levels, item) = get_be32(commit_data + g->hash_len + 8) >> 2;
@@ -1130,6 +1212,237 @@ struct tree *get_commit_tree_in_graph(struct repository *r, const struct commit
 	return get_commit_tree_in_graph_one(r, r->objects->commit_graph, c);
 }
 
+static const unsigned char *reach_label(struct commit_graph *g,
+					const struct commit *c)
+{
+	uint32_t pos = commit_graph_position(c);
+
+	if (pos == COMMIT_NOT_FROM_GRAPH || pos >= g->num_commits)
+		return NULL;
+	return g->chunk_reachability_index +
+		st_mult(GRAPH_REACH_LABEL_WIDTH, pos);
+}
+
+int commit_graph_reachable(struct repository *r,
+			   struct commit *from, struct commit *to)
+{
+	struct commit_graph *g;
+	const unsigned char *from_label, *to_label;
+	uint32_t to_finish;
+
+	if (!prepare_commit_graph(r))
+		return -1;
+
+	/*
+	 * Only the first layer of a commit-graph chain can have an index,
+	 * since the commits it can reach are all in that layer.
+	 */
+	for (g = r->objects->commit_graph; g->base_graph; g = g->base_graph)
+		; /* nothing */
+	if (!g->chunk_reachability_index)
+		return -1;
+
+	if (repo_parse_commit(r, from) || repo_parse_commit(r, to))
+		return -1;
+	from_label = reach_label(g, from);
+	to_label = reach_label(g, to);
+	if (!from_label || !to_label)
+		return -1;
+
+	/*
+	 * The commits reached by the depth-first search from `from` were
+	 * given the finishing numbers from its start to its own.
+	 */
+	to_finish = get_be32(to_label);
+	if (get_be32(from_label + 4) <= to_finish &&
+	    to_finish <= get_be32(from_label))
+		return 1;
+
+	/*
+	 * Every commit reachable from `from` has a finishing number in the
+	 * range from its lowest reachable one to its own.
+	 */
+	if (get_be32(to_label + 8) < get_be32(from_label + 8) ||
+	    to_finish > get_be32(from_label))
+		return 0;
+
+	return -1;
+}
+
+#define TOPOLOGY_OCTOPUS 0x80000000
+
+struct commit_graph_topology *repo_commit_graph_topology(struct repository *r)
+{
+	struct commit_graph *g;
+	struct commit_graph_topology *t;
+
+	if (!generation_numbers_enabled(r))
+		return NULL;
+
+	g = r->objects->commit_graph;
+	if (g->topology)
+		return g->topology;
+
+	CALLOC_ARRAY(t, 1);
+	t->graph = g;
+	t->nr = g->num_commits + g->num_commits_in_base;
+	if (t->nr & TOPOLOGY_OCTOPUS)
+		die(_("commit-graph has too many commits"));
+
+	/*
+	 * These are large for big graphs, but mostly left untouched by
+	 * walks which only read a part of the history, and so never
+	 * actually faulted in.
+	 */
+	CALLOC_ARRAY(t->loaded, DIV_ROUND_UP(t->nr, 64));
+	CALLOC_ARRAY(t->generation, t->nr);
+	CALLOC_ARRAY(t->parents, st_mult(2, t->nr));
+
+	g->topology = t;
+	return t;
+}
+
+static uint32_t topology_parent(struct commit_graph_topology *t,
+				uint32_t edge_value)
+{
+	if (edge_value >= t->nr)
+		die(_("invalid parent position %"PRIu32), edge_value);
+	return edge_value;
+}
+
+static void load_topology_octopus(struct commit_graph_topology *t,
+				  struct commit_graph *g, uint32_t pos,
+				  uint32_t parent_data_pos)
+{
+	struct commit_graph_octopus *octopus;
+	uint32_t edge_value, nr = 0, alloc = 4;
+
+	octopus = xmalloc(st_add(sizeof(*octopus),
+				 st_mult(sizeof(uint32_t), alloc)));
+	octopus->parents[nr++] = t->parents[2 * pos];
+	do {
+		if (g->chunk_extra_edges_size / sizeof(uint32_t) <= parent_data_pos)
+			die(_("commit-graph extra-edges pointer out of bounds"));
+		edge_value = get_be32(g->chunk_extra_edges +
+				      sizeof(uint32_t) * parent_data_pos);
+		if (nr == alloc) {
+			alloc = alloc_nr(alloc);
+			octopus = xrealloc(octopus,
+					   st_add(sizeof(*octopus),
+						  st_mult(sizeof(uint32_t), alloc)));
+		}
+		octopus->parents[nr++] =
+			topology_parent(t, edge_value & GRAPH_EDGE_LAST_MASK);
+		parent_data_pos++;
+	} while (!(edge_value & GRAPH_LAST_EDGE));
+	octopus->nr = nr;
+
+	ALLOC_GROW(t->octopus, t->octopus_nr + 1, t->octopus_alloc);
+	t->parents[2 * pos + 1] = t->octopus_nr | TOPOLOGY_OCTOPUS;
+	t->octopus[t->octopus_nr++] = octopus;
+}
+
+static void load_topology_at(struct commit_graph_topology *t, uint32_t pos)
+{
+	struct commit_graph *g = t->graph;
+	const unsigned char *commit_data;
+	uint32_t lex_index, edge_value;
+
+	if (pos >= t->nr)
+		die(_("invalid commit position. commit-graph is likely corrupt"));
+	while (pos < g->num_commits_in_base)
+		g = g->base_graph;
+
+	lex_index = pos - g->num_commits_in_base;
+	commit_data = g->chunk_commit_data + st_mult(GRAPH_DATA_WIDTH, lex_index);
+
+	t->generation[pos] = read_generation_from_graph(g, lex_index, commit_data,
+							read_date_from_graph(g, commit_data));
+
+	t->parents[2 * pos] = GRAPH_PARENT_NONE;
+	t->parents[2 * pos + 1] = GRAPH_PARENT_NONE;
+
+	edge_value = get_be32(commit_data + g->hash_len);
+	if (edge_value != GRAPH_PARENT_NONE) {
+		t->parents[2 * pos] = topology_parent(t, edge_value);
+
+		edge_value = get_be32(commit_data + g->hash_len + 4);
+		if (edge_value & GRAPH_EXTRA_EDGES_NEEDED)
+			load_topology_octopus(t, g, pos,
+					      edge_value & GRAPH_EDGE_LAST_MASK);
+		else if (edge_value != GRAPH_PARENT_NONE)
+			t->parents[2 * pos + 1] = topology_parent(t, edge_value);
+	}
+
+	t->loaded[pos / 64] |= (uint64_t)1 << (pos % 64);
+}
+
+static inline void ensure_topology_at(struct commit_graph_topology *t,
+				      uint32_t pos)
+{
+	if (pos >= t->nr ||
+	    !(t->loaded[pos / 64] & ((uint64_t)1 << (pos % 64))))
+		load_topology_at(t, pos);
+}
+
+timestamp_t commit_graph_topology_generation(struct commit_graph_topology *t,
+					     uint32_t pos)
+{
+	ensure_topology_at(t, pos);
+	return t->generation[pos];
+}
+
+const uint32_t *commit_graph_topology_parents(struct commit_graph_topology *t,
+					      uint32_t pos, uint32_t *nr)
+{
+	const uint32_t *parents;
+
+	ensure_topology_at(t, pos);
+	parents = t->parents + 2 * pos;
+
+	if (parents[1] & TOPOLOGY_OCTOPUS) {
+		struct commit_graph_octopus *octopus =
+			t->octopus[parents[1] & ~TOPOLOGY_OCTOPUS];
+		*nr = octopus->nr;
+		return octopus->parents;
+	}
+
+	if (parents[0] == GRAPH_PARENT_NONE)
+		*nr = 0;
+	else if (parents[1] == GRAPH_PARENT_NONE)
+		*nr = 1;
+	else
+		*nr = 2;
+	return parents;
+}
+
+struct commit *commit_graph_topology_lookup(struct repository *r,
+					    struct commit_graph_topology *t,
+					    uint32_t pos)
+{
+	struct object_id oid;
+
+	load_oid_from_graph(t->graph, pos, &oid);
+	return lookup_commit(r, &oid);
+}
+
+static void free_commit_graph_topology(struct commit_graph_topology *t)
+{
+	size_t i;
+
+	if (!t)
+		return;
+	for (i = 0; i < t->octopus_nr; i++)
+		free(t->octopus[i]);
+	free(t->octopus);
+	free(t->walk_flags);
+	free(t->walk_bitmaps);
+	free(t->parents);
+	free(t->generation);
+	free(t->loaded);
+	free(t);
+}
+
 struct packed_commit_list {
 	struct commit **list;
 	size_t nr;
@@ -1162,6 +1475,8 @@ struct write_commit_graph_context {
 		 report_progress:1,
 		 split:1,
 		 changed_paths:1,
+		 changed_dirs:1,
+		 reachability_index:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
 		 trust_generation_numbers:1;
@@ -1176,6 +1491,12 @@ struct write_commit_graph_context {
 	int count_bloom_filter_trunc_empty;
 	int count_bloom_filter_trunc_large;
 	int count_bloom_filter_upgraded;
+
+	size_t total_changed_dirs_words;
+	int count_changed_dirs_computed;
+
+	/* The finishing number, subtree start and lowest reach of each commit. */
+	uint32_t *reach_labels;
 };
 
 static int write_graph_chunk_fanout(struct hashfile *f,
@@ -1488,6 +1809,63 @@ static int write_graph_chunk_bloom_data(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_changed_dirs_index(struct hashfile *f,
+						void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	struct commit **list = ctx->commits.list;
+	struct commit **last = ctx->commits.list + ctx->commits.nr;
+	uint32_t cur_pos = 0;
+
+	while (list < last) {
+		const struct changed_dirs *dirs =
+			get_or_compute_changed_dirs(ctx->r, *list, NULL);
+		cur_pos += dirs->nr_words;
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, cur_pos);
+		list++;
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_changed_dirs_data(struct hashfile *f,
+					       void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	struct commit **list = ctx->commits.list;
+	struct commit **last = ctx->commits.list + ctx->commits.nr;
+
+	hashwrite_be32(f, CHANGED_DIRS_VERSION);
+
+	while (list < last) {
+		const struct changed_dirs *dirs =
+			get_or_compute_changed_dirs(ctx->r, *list, NULL);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite(f, dirs->data, st_mult(sizeof(uint32_t), dirs->nr_words));
+		list++;
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_reachability_index(struct hashfile *f,
+						void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	uint32_t *label = ctx->reach_labels;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, *label++);
+		hashwrite_be32(f, *label++);
+		hashwrite_be32(f, *label++);
+	}
+	return 0;
+}
+
 static int add_packed_commits(const struct object_id *oid,
 			      struct packed_git *pack,
 			      uint32_t pos,
@@ -1787,6 +2165,18 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_upgraded);
 }
 
+static int commit_graph_threads(const char *test_env)
+{
+	int nr_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	nr_threads = git_env_ulong(test_env, 0);
+	if (nr_threads)
+		return nr_threads;
+	return online_cpus();
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
 	int i;
@@ -1811,6 +2201,10 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	precompute_bloom_filters(ctx->r, sorted_commits, ctx->commits.nr,
+				 max_new_filters, ctx->bloom_settings,
+				 commit_graph_threads("GIT_TEST_BLOOM_THREADS"));
+
 	for (i = 0; i < ctx->commits.nr; i++) {
 		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
@@ -1842,6 +2236,160 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	stop_progress(&progress);
 }
 
+static void compute_changed_dirs(struct write_commit_graph_context *ctx)
+{
+	int i;
+	struct progress *progress = NULL;
+
+	init_changed_dirs();
+
+	if (ctx->report_progress)
+		progress = start_delayed_progress(
+			_("Computing commit changed directories"),
+			ctx->commits.nr);
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		int computed;
+		const struct changed_dirs *dirs = get_or_compute_changed_dirs(
+			ctx->r, ctx->commits.list[i], &computed);
+
+		ctx->count_changed_dirs_computed += computed;
+		ctx->total_changed_dirs_words += dirs->nr_words;
+		display_progress(progress, i + 1);
+	}
+
+	trace2_data_intmax("commit-graph", ctx->r, "changed-dirs-computed",
+			   ctx->count_changed_dirs_computed);
+	stop_progress(&progress);
+}
+
+struct reach_root {
+	uint32_t level;
+	uint32_t pos;
+};
+
+static int repo_has_reachability_index(struct repository *r)
+{
+	struct commit_graph *g;
+
+	if (!prepare_commit_graph(r))
+		return 0;
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (g->chunk_reachability_index)
+			return 1;
+	return 0;
+}
+
+static int reach_root_cmp(const void *va, const void *vb)
+{
+	const struct reach_root *a = va, *b = vb;
+
+	if (a->level != b->level)
+		return a->level > b->level ? -1 : 1;
+	return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/*
+ * Label the commits for the reachability index with a depth-first search
+ * following parents, started from the commits with the highest
+ * topological levels. Each commit gets:
+ *
+ *  - its finishing number, i.e. its position in the post-order of the
+ *    search,
+ *  - the first finishing number of the commits first reached through it,
+ *    which form a range ending with its own,
+ *  - the lowest finishing number of the commits it can reach.
+ */
+static void compute_reachability_index(struct write_commit_graph_context *ctx)
+{
+	uint32_t nr = ctx->commits.nr, finished = 0, i;
+	uint32_t *parent_index, *parents = NULL, *next_parent, *stack;
+	size_t parents_nr = 0, parents_alloc = 0, stack_nr = 0;
+	struct reach_root *roots;
+	unsigned char *visited;
+	uint32_t *labels;
+	struct progress *progress = NULL;
+
+	if (ctx->report_progress)
+		progress = start_delayed_progress(
+			_("Computing commit graph reachability index"), nr);
+
+	ALLOC_ARRAY(parent_index, st_add(nr, 1));
+	ALLOC_ARRAY(roots, nr);
+	for (i = 0; i < nr; i++) {
+		struct commit *c = ctx->commits.list[i];
+		struct commit_list *p;
+
+		parent_index[i] = parents_nr;
+		for (p = c->parents; p; p = p->next) {
+			int pos = oid_pos(&p->item->object.oid, ctx->commits.list,
+					  nr, commit_to_oid);
+			if (pos < 0)
+				BUG("missing parent %s for commit %s",
+				    oid_to_hex(&p->item->object.oid),
+				    oid_to_hex(&c->object.oid));
+			ALLOC_GROW(parents, parents_nr + 1, parents_alloc);
+			parents[parents_nr++] = pos;
+		}
+
+		roots[i].level = *topo_level_slab_at(ctx->topo_levels, c);
+		roots[i].pos = i;
+	}
+	parent_index[nr] = parents_nr;
+	QSORT(roots, nr, reach_root_cmp);
+
+	CALLOC_ARRAY(labels, st_mult(3, nr));
+	CALLOC_ARRAY(visited, nr);
+	ALLOC_ARRAY(next_parent, nr);
+	ALLOC_ARRAY(stack, nr);
+
+	for (i = 0; i < nr; i++) {
+		uint32_t root = roots[i].pos;
+
+		if (visited[root])
+			continue;
+		visited[root] = 1;
+		labels[3 * root + 1] = finished;
+		next_parent[root] = parent_index[root];
+		stack[stack_nr++] = root;
+
+		while (stack_nr) {
+			uint32_t cur = stack[stack_nr - 1];
+			uint32_t j, low;
+
+			if (next_parent[cur] < parent_index[cur + 1]) {
+				uint32_t p = parents[next_parent[cur]++];
+
+				if (visited[p])
+					continue;
+				visited[p] = 1;
+				labels[3 * p + 1] = finished;
+				next_parent[p] = parent_index[p];
+				stack[stack_nr++] = p;
+				continue;
+			}
+
+			stack_nr--;
+			low = finished;
+			for (j = parent_index[cur]; j < parent_index[cur + 1]; j++)
+				if (labels[3 * parents[j] + 2] < low)
+					low = labels[3 * parents[j] + 2];
+			labels[3 * cur] = finished++;
+			labels[3 * cur + 2] = low;
+			display_progress(progress, finished);
+		}
+	}
+	stop_progress(&progress);
+
+	ctx->reach_labels = labels;
+	free(stack);
+	free(next_parent);
+	free(visited);
+	free(roots);
+	free(parents);
+	free(parent_index);
+}
+
 struct refs_cb_data {
 	struct oidset *commits;
 	struct progress *progress;
@@ -2117,6 +2665,20 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 				 ctx->total_bloom_filter_data_size),
 			  write_graph_chunk_bloom_data);
 	}
+	if (ctx->changed_dirs) {
+		add_chunk(cf, GRAPH_CHUNKID_CHANGEDDIRSINDEX,
+			  st_mult(sizeof(uint32_t), ctx->commits.nr),
+			  write_graph_chunk_changed_dirs_index);
+		add_chunk(cf, GRAPH_CHUNKID_CHANGEDDIRSDATA,
+			  st_add(CHANGED_DIRS_CHUNK_HEADER_SIZE,
+				 st_mult(sizeof(uint32_t),
+					 ctx->total_changed_dirs_words)),
+			  write_graph_chunk_changed_dirs_data);
+	}
+	if (ctx->reachability_index)
+		add_chunk(cf, GRAPH_CHUNKID_REACHABILITYINDEX,
+			  st_mult(GRAPH_REACH_LABEL_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_reachability_index);
 	if (ctx->num_commit_graphs_after > 1)
 		add_chunk(cf, GRAPH_CHUNKID_BASE,
 			  st_mult(hashsz, ctx->num_commit_graphs_after - 1),
@@ -2499,6 +3061,7 @@ int write_commit_graph(struct object_directory *odb,
 	uint32_t i;
 	int res = 0;
 	int replace = 0;
+	int changed_dirs, reachability_index;
 	struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 	struct topo_level_slab topo_levels;
 
@@ -2572,6 +3135,14 @@ int write_commit_graph(struct object_directory *odb,
 
 	bloom_settings.hash_version = bloom_settings.hash_version == 2 ? 2 : 1;
 
+	/* Unless configured otherwise, keep the summaries we already have. */
+	if (repo_config_get_bool(r, "commitgraph.changeddirectories", &changed_dirs))
+		changed_dirs = repo_has_changed_dirs(r);
+	ctx->changed_dirs = changed_dirs;
+	if (repo_config_get_bool(r, "commitgraph.reachabilityindex", &reachability_index))
+		reachability_index = repo_has_reachability_index(r);
+	ctx->reachability_index = reachability_index;
+
 	if (ctx->split) {
 		struct commit_graph *g = ctx->r->objects->commit_graph;
 
@@ -2652,11 +3223,24 @@ int write_commit_graph(struct object_directory *odb,
 
 	if (ctx->changed_paths)
 		compute_bloom_filters(ctx);
+	if (ctx->changed_dirs)
+		compute_changed_dirs(ctx);
+
+	/*
+	 * The labels of a layer would depend on the commits in the layers
+	 * below it.
+	 */
+	if (ctx->num_commit_graphs_after > 1)
+		ctx->reachability_index = 0;
+	if (ctx->reachability_index)
+		compute_reachability_index(ctx);
 
 	res = write_commit_graph_file(ctx);
 
 	if (ctx->changed_paths)
 		deinit_bloom_filters();
+	if (ctx->changed_dirs)
+		deinit_changed_dirs();
 
 	if (ctx->split)
 		mark_commit_graphs(ctx);
@@ -2667,6 +3251,7 @@ int write_commit_graph(struct object_directory *odb,
 	free(ctx->graph_name);
 	free(ctx->base_graph_name);
 	free(ctx->commits.list);
+	free(ctx->reach_labels);
 	oid_array_clear(&ctx->oids);
 	clear_topo_level_slab(&topo_levels);
 
@@ -2706,15 +3291,203 @@ static int commit_graph_checksum_valid(struct commit_graph *g)
 	return hashfile_checksum_valid(g->data, g->data_len);
 }
 
+/*
+ * Reading commits from the object database dominates verification, so
+ * it is done by threads, a window of commits at a time. While the main
+ * thread parses the commits of one window and compares them with the
+ * commit-graph, the threads read the next one.
+ */
+#define VERIFY_WINDOW_SIZE 4096
+#define VERIFY_READS_PER_BATCH 32
+
+struct verify_commit_read {
+	void *buffer;
+	unsigned long size;
+	enum object_type type;
+};
+
+struct verify_read_data {
+	struct repository *r;
+	struct commit_graph *g;
+	struct verify_commit_read *reads;
+	uint32_t start;
+};
+
+static void read_commit_for_verify(size_t i, void *arg)
+{
+	struct verify_read_data *d = arg;
+	struct verify_commit_read *read = &d->reads[i];
+	struct object_info oi = {
+		.typep = &read->type,
+		.sizep = &read->size,
+		.contentp = &read->buffer,
+	};
+	struct object_id oid;
+	/*
+	 * Unlike repo_parse_commit_internal(), do not die on corrupt
+	 * objects here; they are read again by the main thread, which
+	 * reports them.
+	 */
+	unsigned flags = OBJECT_INFO_LOOKUP_REPLACE |
+		OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_QUICK;
+
+	oidread(&oid, d->g->chunk_oid_lookup +
+		st_mult(d->g->hash_len, d->start + i),
+		d->r->hash_algo);
+	if (oid_object_info_extended(d->r, &oid, &oi, flags) < 0)
+		read->buffer = NULL;
+}
+
+struct verify_read_window {
+	struct verify_read_data data;
+	struct batch_threads threads;
+};
+
+/*
+ * Start reading the `nr` commits from position `start` in `g` into
+ * `reads`. The object read lock must be enabled until the reads are
+ * finished by finish_verify_reads().
+ */
+static void start_verify_reads(struct verify_read_window *w,
+			       struct repository *r, struct commit_graph *g,
+			       uint32_t start, uint32_t nr,
+			       struct verify_commit_read *reads,
+			       int nr_threads)
+{
+	memset(reads, 0, st_mult(sizeof(*reads), nr));
+	w->data.r = r;
+	w->data.g = g;
+	w->data.reads = reads;
+	w->data.start = start;
+	memset(&w->threads, 0, sizeof(w->threads));
+	w->threads.fn = read_commit_for_verify;
+	w->threads.data = &w->data;
+	w->threads.batch = VERIFY_READS_PER_BATCH;
+	/* The main thread reads what is left when it needs the window. */
+	batch_threads_start(&w->threads, nr, nr_threads - 1);
+}
+
+static void finish_verify_reads(struct verify_read_window *w)
+{
+	batch_threads_finish(&w->threads);
+}
+
+/*
+ * Parse `c` from the object database like repo_parse_commit_internal()
+ * without the commit-graph, using the object contents in `read` if the
+ * threads could read them.
+ */
+static int parse_commit_for_verify(struct repository *r, struct commit *c,
+				   struct verify_commit_read *read)
+{
+	int ret;
+
+	if (!read || !read->buffer || read->type != OBJ_COMMIT) {
+		if (read)
+			FREE_AND_NULL(read->buffer);
+		return repo_parse_commit_internal(r, c, 0, 0);
+	}
+
+	ret = parse_commit_buffer(r, c, read->buffer, read->size, 0);
+	if (save_commit_buffer && !ret &&
+	    !get_cached_commit_buffer(r, c, NULL))
+		set_commit_buffer(r, c, read->buffer, read->size);
+	else
+		free(read->buffer);
+	read->buffer = NULL;
+	return ret;
+}
+
+/*
+ * Check the label of `c`, or if `parent` is given, that it agrees with
+ * the one of `parent`. The reachability index answers correctly that a
+ * commit cannot reach another as long as each commit finishes after its
+ * parents, and has no lower reach than them.
+ */
+/*
+ * commit_graph_reachable() says that a commit can reach those whose
+ * finishing number is in the range from its start to its own. That
+ * holds if the finishing numbers are distinct, and if the ranges of the
+ * parents first reached through each commit, i.e. those starting at or
+ * after its start, cover the numbers from its start up to (but not
+ * including) its own. Its negative answers need the parents to finish
+ * before their children, and not to reach lower numbers than they do.
+ */
+static void verify_reach_labels(struct commit_graph *g, struct commit *c,
+				uint64_t *finished)
+{
+	const unsigned char *label = reach_label(g, c);
+	uint32_t finish, start, next;
+	struct commit_list *p;
+	int covered;
+
+	if (!label)
+		return;
+
+	finish = get_be32(label);
+	start = get_be32(label + 4);
+	if (finish >= g->num_commits || start > finish ||
+	    get_be32(label + 8) > finish ||
+	    finished[finish / 64] & (1ULL << (finish % 64))) {
+		graph_report(_("commit-graph reachability label for commit %s is invalid"),
+			     oid_to_hex(&c->object.oid));
+		return;
+	}
+	finished[finish / 64] |= 1ULL << (finish % 64);
+
+	for (p = c->parents; p; p = p->next) {
+		const unsigned char *parent_label = reach_label(g, p->item);
+
+		if (!parent_label)
+			return;
+		if (get_be32(parent_label) >= finish ||
+		    get_be32(parent_label + 8) < get_be32(label + 8)) {
+			graph_report(_("commit-graph reachability label for commit %s is inconsistent with parent %s"),
+				     oid_to_hex(&c->object.oid),
+				     oid_to_hex(&p->item->object.oid));
+			return;
+		}
+	}
+
+	/*
+	 * The ranges of the parents may be nested in each other, e.g. when
+	 * one of them is first reached through another, so extend the
+	 * covered part with any range that starts within it until none
+	 * does.
+	 */
+	next = start;
+	do {
+		covered = 0;
+		for (p = c->parents; p && next < finish; p = p->next) {
+			const unsigned char *parent_label = reach_label(g, p->item);
+			uint32_t parent_start = get_be32(parent_label + 4);
+			uint32_t parent_finish = get_be32(parent_label);
+
+			if (start <= parent_start && parent_start <= next &&
+			    next <= parent_finish) {
+				next = parent_finish + 1;
+				covered = 1;
+			}
+		}
+	} while (covered && next < finish);
+
+	if (next != finish)
+		graph_report(_("commit-graph reachability label for commit %s is invalid"),
+			     oid_to_hex(&c->object.oid));
+}
+
 static int verify_one_commit_graph(struct repository *r,
 				   struct commit_graph *g,
 				   struct progress *progress,
-				   uint64_t *seen)
+				   uint64_t *seen, int nr_threads)
 {
 	uint32_t i, cur_fanout_pos = 0;
 	struct object_id prev_oid, cur_oid;
 	struct commit *seen_gen_zero = NULL;
 	struct commit *seen_gen_non_zero = NULL;
+	struct verify_commit_read *reads = NULL;
+	struct verify_read_window windows[2];
+	uint64_t *finished = NULL;
 
 	if (!commit_graph_checksum_valid(g)) {
 		graph_report(_("the commit-graph file has incorrect checksum and is likely corrupt"));
@@ -2762,19 +3535,53 @@ static int verify_one_commit_graph(struct repository *r,
 	if (verify_commit_graph_error & ~VERIFY_COMMIT_GRAPH_ERROR_HASH)
 		return verify_commit_graph_error;
 
+	if (g->chunk_reachability_index && !g->num_commits_in_base)
+		CALLOC_ARRAY(finished, DIV_ROUND_UP(g->num_commits, 64));
+
+	if (HAVE_THREADS && nr_threads > 1 && g->num_commits > 1) {
+		ALLOC_ARRAY(reads, st_mult(2, VERIFY_WINDOW_SIZE));
+		enable_obj_read_lock();
+		start_verify_reads(&windows[0], r, g, 0,
+				   g->num_commits < VERIFY_WINDOW_SIZE ?
+				   g->num_commits : VERIFY_WINDOW_SIZE,
+				   reads, nr_threads);
+	}
+
 	for (i = 0; i < g->num_commits; i++) {
 		struct commit *graph_commit, *odb_commit;
 		struct commit_list *graph_parents, *odb_parents;
+		struct verify_commit_read *read = NULL;
 		timestamp_t max_generation = 0;
 		timestamp_t generation;
 
+		if (reads) {
+			uint32_t window = (i / VERIFY_WINDOW_SIZE) % 2;
+			uint32_t window_pos = i % VERIFY_WINDOW_SIZE;
+
+			if (!window_pos) {
+				uint32_t next = i + VERIFY_WINDOW_SIZE;
+				uint32_t next_nr = g->num_commits - next;
+
+				finish_verify_reads(&windows[window]);
+				if (next < g->num_commits) {
+					if (next_nr > VERIFY_WINDOW_SIZE)
+						next_nr = VERIFY_WINDOW_SIZE;
+					start_verify_reads(&windows[!window], r, g,
+							   next, next_nr,
+							   reads + (!window) * VERIFY_WINDOW_SIZE,
+							   nr_threads);
+				}
+			}
+			read = &reads[window * VERIFY_WINDOW_SIZE + window_pos];
+		}
+
 		display_progress(progress, ++(*seen));
 		oidread(&cur_oid, g->chunk_oid_lookup + st_mult(g->hash_len, i),
 			the_repository->hash_algo);
 
 		graph_commit = lookup_commit(r, &cur_oid);
 		odb_commit = (struct commit *)create_object(r, &cur_oid, alloc_commit_node(r));
-		if (repo_parse_commit_internal(r, odb_commit, 0, 0)) {
+		if (parse_commit_for_verify(r, odb_commit, read)) {
 			graph_report(_("failed to parse commit %s from object database for commit-graph"),
 				     oid_to_hex(&cur_oid));
 			continue;
@@ -2818,6 +3625,9 @@ static int verify_one_commit_graph(struct repository *r,
 			graph_report(_("commit-graph parent list for commit %s terminates early"),
 				     oid_to_hex(&cur_oid));
 
+		if (finished)
+			verify_reach_labels(g, graph_commit, finished);
+
 		if (commit_graph_generation_from_graph(graph_commit))
 			seen_gen_non_zero = graph_commit;
 		else
@@ -2855,6 +3665,10 @@ static int verify_one_commit_graph(struct repository *r,
 			     oid_to_hex(&seen_gen_zero->object.oid),
 			     oid_to_hex(&seen_gen_non_zero->object.oid));
 
+	if (reads)
+		disable_obj_read_lock();
+	free(finished);
+	free(reads);
 	return verify_commit_graph_error;
 }
 
@@ -2863,6 +3677,7 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 	struct progress *progress = NULL;
 	int local_error = 0;
 	uint64_t seen = 0;
+	int nr_threads = commit_graph_threads("GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS");
 
 	if (!g) {
 		graph_report("no commit-graph file loaded");
@@ -2879,7 +3694,8 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 	}
 
 	for (; g; g = g->base_graph) {
-		local_error |= verify_one_commit_graph(r, g, progress, &seen);
+		local_error |= verify_one_commit_graph(r, g, progress, &seen,
+						       nr_threads);
 		if (flags & COMMIT_GRAPH_VERIFY_SHALLOW)
 			break;
 	}
@@ -2898,6 +3714,7 @@ void free_commit_graph(struct commit_graph *g)
 			munmap((void *)g->data, g->data_len);
 		free(g->filename);
 		free(g->bloom_filter_settings);
+		free_commit_graph_topology(g->topology);
 		free(g);
 
 		g = next;
@@ -24,6 +24,7 @@
 void git_test_write_commit_graph_or_die(void);
 
 struct commit;
+struct bitmap;
 struct bloom_filter_settings;
 struct repository;
 struct raw_object_store;
@@ -34,6 +35,13 @@ char *get_commit_graph_chain_filename(struct object_directory *odb);
 int open_commit_graph(const char *graph_file, int *fd, struct stat *st);
 int open_commit_graph_chain(const char *chain_file, int *fd, struct stat *st);
 
+/*
+ * Return 1 if the parents of commits in `r` are the ones recorded in
+ * their objects, i.e. there are no replace refs, grafts or shallow
+ * history, as the commit-graph requires.
+ */
+int commit_graph_compatible(struct repository *r);
+
 /*
  * Given a commit struct, try to fill the commit struct info, including:
  *  1. tree object
@@ -80,6 +88,77 @@ void load_commit_graph_info(struct repository *r, struct commit *item);
 struct tree *get_commit_tree_in_graph(struct repository *r,
 				      const struct commit *c);
 
+/*
+ * Use the reachability index of the commit-graph, if it has one, to tell
+ * whether `to` can be reached from `from`. Return 1 if it can, 0 if not,
+ * and -1 if the index cannot tell, in which case the history has to be
+ * walked.
+ */
+int commit_graph_reachable(struct repository *r,
+			   struct commit *from, struct commit *to);
+
+/*
+ * A view of the commits in a commit-graph for walks which only need the
+ * shape of the history, like counting or painting commits. Commits are
+ * named by their graph position instead of a "struct commit", and their
+ * generation numbers and parents are kept in arrays indexed by position,
+ * filled from the commit-graph the first time they are needed.
+ */
+struct commit_graph_octopus {
+	uint32_t nr;
+	uint32_t parents[FLEX_ARRAY];
+};
+
+struct commit_graph_topology {
+	struct commit_graph *graph;
+	uint32_t nr;
+
+	/* One bit per commit, set once its entries below are filled. */
+	uint64_t *loaded;
+	timestamp_t *generation;
+
+	/*
+	 * Two entries per commit: its first two parents, or for an octopus
+	 * merge its first parent and the tagged index of all its parents
+	 * in `octopus`.
+	 */
+	uint32_t *parents;
+	struct commit_graph_octopus **octopus;
+	size_t octopus_nr, octopus_alloc;
+
+	/*
+	 * Per-commit scratch space for the walks in commit-reach.c, kept
+	 * between walks so that each of them does not allocate and clear
+	 * arrays for the whole graph. A walk resets the entries it touched
+	 * before it lets go of them.
+	 */
+	unsigned char *walk_flags;
+	struct bitmap **walk_bitmaps;
+	unsigned walk_in_use : 1;
+};
+
+/*
+ * Return the topology of the commit-graph of `r`, or NULL if it has no
+ * commit-graph or no generation numbers. Positions can be found with
+ * repo_find_commit_pos_in_graph().
+ */
+struct commit_graph_topology *repo_commit_graph_topology(struct repository *r);
+
+timestamp_t commit_graph_topology_generation(struct commit_graph_topology *t,
+					     uint32_t pos);
+
+/*
+ * Return the positions of the parents of the commit at `pos`, and store
+ * their number in `nr`. The array stays valid as long as `t`.
+ */
+const uint32_t *commit_graph_topology_parents(struct commit_graph_topology *t,
+					      uint32_t pos, uint32_t *nr);
+
+/* Return the (possibly unparsed) commit at `pos`. */
+struct commit *commit_graph_topology_lookup(struct repository *r,
+					    struct commit_graph_topology *t,
+					    uint32_t pos);
+
 struct commit_graph {
 	const unsigned char *data;
 	size_t data_len;
@@ -108,9 +187,14 @@ struct commit_graph {
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
 	size_t chunk_bloom_data_size;
+	const unsigned char *chunk_changed_dirs_index;
+	const unsigned char *chunk_changed_dirs_data;
+	size_t chunk_changed_dirs_data_size;
+	const unsigned char *chunk_reachability_index;
 
 	struct topo_level_slab *topo_levels;
 	struct bloom_filter_settings *bloom_filter_settings;
+	struct commit_graph_topology *topology;
 };
 
 struct commit_graph *load_commit_graph_one_fd_st(struct repository *r,
@@ -10,6 +10,7 @@
 #include "ref-filter.h"
 #include "revision.h"
 #include "tag.h"
+#include "trace2.h"
 #include "commit-reach.h"
 #include "ewah/ewok.h"
 
@@ -51,6 +52,258 @@ static int queue_has_nonstale(struct prio_queue *queue)
 	return 0;
 }
 
+/*
+ * Walks over commit-graph positions, see "struct commit_graph_topology".
+ * They use their own flags, mirroring the commit flags above, in a byte
+ * per position.
+ */
+enum topology_walk_flags {
+	TOPOLOGY_PARENT1 = (1 << 0),
+	TOPOLOGY_PARENT2 = (1 << 1),
+	TOPOLOGY_STALE = (1 << 2),
+	TOPOLOGY_RESULT = (1 << 3),
+	TOPOLOGY_QUEUED = (1 << 6),
+	TOPOLOGY_DONE = (1 << 7),
+};
+
+struct topology_walk {
+	struct commit_graph_topology *t;
+	struct prio_queue queue;
+	unsigned char *flags;
+	struct bitmap **bitmaps;
+
+	/* The number of queued positions not marked TOPOLOGY_STALE. */
+	size_t queued_nonstale;
+
+	/*
+	 * Every position ever queued, which are the only ones with flags
+	 * or bitmaps, so that the arrays borrowed from the topology can be
+	 * reset without clearing them whole.
+	 */
+	uint32_t *touched;
+	size_t touched_nr, touched_alloc;
+	unsigned borrowed : 1;
+};
+
+static int compare_positions_by_generation(const void *va, const void *vb,
+					   void *data)
+{
+	struct commit_graph_topology *t = data;
+	timestamp_t a = commit_graph_topology_generation(t, (uintptr_t)va);
+	timestamp_t b = commit_graph_topology_generation(t, (uintptr_t)vb);
+
+	if (a > b)
+		return -1;
+	if (a < b)
+		return 1;
+	return 0;
+}
+
+/* Return -1 if one of `commits` is not in the commit-graph. */
+static int find_positions_in_graph(struct repository *r,
+				   struct commit **commits, size_t nr,
+				   uint32_t *pos)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+		if (!repo_find_commit_pos_in_graph(r, commits[i], &pos[i]))
+			return -1;
+	return 0;
+}
+
+static void init_topology_walk(struct topology_walk *w,
+			       struct commit_graph_topology *t)
+{
+	memset(w, 0, sizeof(*w));
+	w->t = t;
+	w->queue.compare = compare_positions_by_generation;
+	w->queue.cb_data = t;
+
+	/*
+	 * Reuse the arrays of the topology, unless another walk is using
+	 * them already.
+	 */
+	if (t->walk_in_use) {
+		CALLOC_ARRAY(w->flags, t->nr);
+		return;
+	}
+	if (!t->walk_flags)
+		CALLOC_ARRAY(t->walk_flags, t->nr);
+	w->flags = t->walk_flags;
+	w->borrowed = 1;
+	t->walk_in_use = 1;
+}
+
+/*
+ * Return an array of bitmaps indexed by position, all NULL to begin
+ * with. The walk has to free the bitmaps it puts there and reset their
+ * entries to NULL before clear_topology_walk().
+ */
+static struct bitmap **topology_walk_bitmaps(struct topology_walk *w)
+{
+	if (w->bitmaps)
+		return w->bitmaps;
+	if (!w->borrowed) {
+		CALLOC_ARRAY(w->bitmaps, w->t->nr);
+	} else {
+		if (!w->t->walk_bitmaps)
+			CALLOC_ARRAY(w->t->walk_bitmaps, w->t->nr);
+		w->bitmaps = w->t->walk_bitmaps;
+	}
+	return w->bitmaps;
+}
+
+static void clear_topology_walk(struct topology_walk *w)
+{
+	clear_prio_queue(&w->queue);
+	if (w->borrowed) {
+		for (size_t i = 0; i < w->touched_nr; i++)
+			w->flags[w->touched[i]] = 0;
+		w->t->walk_in_use = 0;
+	} else {
+		free(w->flags);
+		free(w->bitmaps);
+	}
+	w->flags = NULL;
+	w->bitmaps = NULL;
+	FREE_AND_NULL(w->touched);
+	w->touched_nr = w->touched_alloc = 0;
+}
+
+/*
+ * Add `flags` to the commit at `pos`, and queue it if it was not already.
+ * Since the queue is ordered by generation, the flags of a commit are
+ * final once it comes out of the queue.
+ */
+static void topology_walk_mark(struct topology_walk *w, uint32_t pos,
+			       unsigned char flags)
+{
+	unsigned char old = w->flags[pos];
+
+	/* Only possible with inconsistent generation numbers. */
+	if (old & TOPOLOGY_DONE)
+		return;
+
+	w->flags[pos] |= flags | TOPOLOGY_QUEUED;
+	if (!(old & TOPOLOGY_QUEUED)) {
+		ALLOC_GROW(w->touched, w->touched_nr + 1, w->touched_alloc);
+		w->touched[w->touched_nr++] = pos;
+		prio_queue_put(&w->queue, (void *)(uintptr_t)pos);
+		if (!(w->flags[pos] & TOPOLOGY_STALE))
+			w->queued_nonstale++;
+	} else if (!(old & TOPOLOGY_STALE) && (flags & TOPOLOGY_STALE)) {
+		w->queued_nonstale--;
+	}
+}
+
+static uint32_t topology_walk_next(struct topology_walk *w)
+{
+	uint32_t pos = (uintptr_t)prio_queue_get(&w->queue);
+
+	if (!(w->flags[pos] & TOPOLOGY_STALE))
+		w->queued_nonstale--;
+	w->flags[pos] |= TOPOLOGY_DONE;
+	return pos;
+}
+
+static unsigned topology_to_object_flags(unsigned char flags)
+{
+	return ((flags & TOPOLOGY_PARENT1) ? PARENT1 : 0) |
+	       ((flags & TOPOLOGY_PARENT2) ? PARENT2 : 0) |
+	       ((flags & TOPOLOGY_STALE) ? STALE : 0) |
+	       ((flags & TOPOLOGY_RESULT) ? RESULT : 0);
+}
+
+/*
+ * Like paint_down_to_common(), with commit-graph positions. The flags
+ * are only set on the input commits, and only the merge bases which are
+ * not stale are returned, which is all its callers look at.
+ *
+ * Return 1 without painting if the commit-graph cannot be used.
+ */
+static int paint_down_to_common_in_graph(struct repository *r,
+					 struct commit *one, int n,
+					 struct commit **twos,
+					 timestamp_t min_generation,
+					 struct commit_list **result)
+{
+	struct commit_graph_topology *t;
+	struct topology_walk w;
+	uint32_t *pos, *results = NULL;
+	size_t results_nr = 0, results_alloc = 0;
+	int i, ret = 1;
+
+	/* See paint_down_to_common() for the queue order without these. */
+	if (!min_generation && !corrected_commit_dates_enabled(r))
+		return 1;
+	t = repo_commit_graph_topology(r);
+	if (!t)
+		return 1;
+
+	ALLOC_ARRAY(pos, st_add(n, 1));
+	if (find_positions_in_graph(r, twos, n, pos) ||
+	    find_positions_in_graph(r, &one, 1, &pos[n]))
+		goto cleanup;
+	init_topology_walk(&w, t);
+
+	topology_walk_mark(&w, pos[n], TOPOLOGY_PARENT1);
+	for (i = 0; i < n; i++)
+		topology_walk_mark(&w, pos[i], TOPOLOGY_PARENT2);
+
+	while (w.queued_nonstale) {
+		uint32_t cur = topology_walk_next(&w);
+		unsigned char flags;
+		const uint32_t *parents;
+		uint32_t j, parents_nr;
+
+		if (commit_graph_topology_generation(t, cur) < min_generation)
+			break;
+
+		flags = w.flags[cur] &
+			(TOPOLOGY_PARENT1 | TOPOLOGY_PARENT2 | TOPOLOGY_STALE);
+		if (flags == (TOPOLOGY_PARENT1 | TOPOLOGY_PARENT2)) {
+			w.flags[cur] |= TOPOLOGY_RESULT;
+			ALLOC_GROW(results, results_nr + 1, results_alloc);
+			results[results_nr++] = cur;
+			/* Mark parents of a found merge stale */
+			flags |= TOPOLOGY_STALE;
+		}
+
+		parents = commit_graph_topology_parents(t, cur, &parents_nr);
+		for (j = 0; j < parents_nr; j++)
+			if ((w.flags[parents[j]] & flags) != flags)
+				topology_walk_mark(&w, parents[j], flags);
+	}
+
+	one->object.flags |= topology_to_object_flags(w.flags[pos[n]]);
+	for (i = 0; i < n; i++)
+		twos[i]->object.flags |= topology_to_object_flags(w.flags[pos[i]]);
+
+	ret = 0;
+	for (i = 0; i < results_nr; i++) {
+		struct commit *c;
+
+		if (w.flags[results[i]] & TOPOLOGY_STALE)
+			continue;
+		c = commit_graph_topology_lookup(r, t, results[i]);
+		if (!c || repo_parse_commit(r, c)) {
+			free_commit_list(*result);
+			*result = NULL;
+			ret = error(_("could not parse commit at commit-graph position %"PRIu32),
+				    results[i]);
+			break;
+		}
+		commit_list_insert_by_date(c, result);
+	}
+
+	clear_topology_walk(&w);
+cleanup:
+	free(results);
+	free(pos);
+	return ret;
+}
+
 /* all input commits in one and twos[] must have been parsed! */
 static int paint_down_to_common(struct repository *r,
 				struct commit *one, int n,
@@ -71,6 +324,12 @@ static int paint_down_to_common(struct repository *r,
 		commit_list_append(one, result);
 		return 0;
 	}
+
+	i = paint_down_to_common_in_graph(r, one, n, twos, min_generation,
+					  result);
+	if (i <= 0)
+		return i;
+
 	prio_queue_put(&queue, one);
 
 	for (i = 0; i < n; i++) {
@@ -497,9 +756,22 @@ int repo_is_descendant_of(struct repository *r,
 			  struct commit *commit,
 			  struct commit_list *with_commit)
 {
+	struct commit_list *p;
+	int unknown = 0;
+
 	if (!with_commit)
 		return 1;
 
+	for (p = with_commit; p; p = p->next) {
+		int reachable = commit_graph_reachable(r, commit, p->item);
+		if (reachable > 0)
+			return 1;
+		if (reachable < 0)
+			unknown = 1;
+	}
+	if (!unknown)
+		return 0;
+
 	if (generation_numbers_enabled(r)) {
 		struct commit_list *from_list = NULL;
 		int result;
@@ -530,7 +802,7 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 			     int ignore_missing_commits)
 {
 	struct commit_list *bases = NULL;
-	int ret = 0, i;
+	int ret = 0, i, unknown = 0;
 	timestamp_t generation, max_generation = GENERATION_NUMBER_ZERO;
 
 	if (repo_parse_commit(r, commit))
@@ -548,6 +820,16 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 	if (generation > max_generation)
 		return ret;
 
+	for (i = 0; i < nr_reference; i++) {
+		int reachable = commit_graph_reachable(r, reference[i], commit);
+		if (reachable > 0)
+			return 1;
+		if (reachable < 0)
+			unknown = 1;
+	}
+	if (!unknown)
+		return 0;
+
 	if (paint_down_to_common(r, commit,
 				 nr_reference, reference,
 				 generation, ignore_missing_commits, &bases))
@@ -690,6 +972,8 @@ static enum contains_result contains_test(struct commit *candidate,
 					  timestamp_t cutoff)
 {
 	enum contains_result *cached = contains_cache_at(cache, candidate);
+	const struct commit_list *p;
+	int unknown = 0;
 
 	/* If we already have the answer cached, return that. */
 	if (*cached)
@@ -707,6 +991,22 @@ static enum contains_result contains_test(struct commit *candidate,
 	if (commit_graph_generation(candidate) < cutoff)
 		return CONTAINS_NO;
 
+	/* unless the reachability index knows */
+	for (p = want; p; p = p->next) {
+		int reachable = commit_graph_reachable(the_repository,
+						       candidate, p->item);
+		if (reachable > 0) {
+			*cached = CONTAINS_YES;
+			return CONTAINS_YES;
+		}
+		if (reachable < 0)
+			unknown = 1;
+	}
+	if (!unknown) {
+		*cached = CONTAINS_NO;
+		return CONTAINS_NO;
+	}
+
 	return CONTAINS_UNKNOWN;
 }
 
@@ -773,6 +1073,11 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 int commit_contains(struct ref_filter *filter, struct commit *commit,
 		    struct commit_list *list, struct contains_cache *cache)
 {
+	enum contains_result *cached = contains_cache_peek(cache, commit);
+
+	/* The caller may have seeded the cache, e.g. from bitmaps. */
+	if (cached && *cached)
+		return *cached == CONTAINS_YES;
 	if (filter->with_commit_tag_algo)
 		return contains_tag_algo(commit, list, cache) == CONTAINS_YES;
 	return repo_is_descendant_of(the_repository, commit, list);
@@ -1039,6 +1344,89 @@ static void free_bit_array(struct commit *c)
 	*bitmap = NULL;
 }
 
+/*
+ * Like ahead_behind(), with commit-graph positions. Return -1 without
+ * counting if one of the commits is not in the commit-graph.
+ */
+static int ahead_behind_in_graph(struct repository *r,
+				 struct commit **commits, size_t commits_nr,
+				 struct ahead_behind_count *counts,
+				 size_t counts_nr)
+{
+	size_t width = DIV_ROUND_UP(commits_nr, BITS_IN_EWORD);
+	struct commit_graph_topology *t;
+	struct topology_walk w;
+	struct bitmap **bitmaps;
+	uint32_t *pos;
+
+	t = repo_commit_graph_topology(r);
+	if (!t)
+		return -1;
+
+	ALLOC_ARRAY(pos, commits_nr);
+	if (find_positions_in_graph(r, commits, commits_nr, pos)) {
+		free(pos);
+		return -1;
+	}
+	init_topology_walk(&w, t);
+	bitmaps = topology_walk_bitmaps(&w);
+
+	for (size_t i = 0; i < commits_nr; i++) {
+		if (!bitmaps[pos[i]])
+			bitmaps[pos[i]] = bitmap_word_alloc(width);
+		bitmap_set(bitmaps[pos[i]], i);
+		topology_walk_mark(&w, pos[i], 0);
+	}
+
+	while (w.queued_nonstale) {
+		uint32_t cur = topology_walk_next(&w);
+		struct bitmap *bitmap_c = bitmaps[cur];
+		const uint32_t *parents;
+		uint32_t parents_nr;
+
+		for (size_t i = 0; i < counts_nr; i++) {
+			int reach_from_tip = !!bitmap_get(bitmap_c, counts[i].tip_index);
+			int reach_from_base = !!bitmap_get(bitmap_c, counts[i].base_index);
+
+			if (reach_from_tip ^ reach_from_base) {
+				if (reach_from_base)
+					counts[i].behind++;
+				else
+					counts[i].ahead++;
+			}
+		}
+
+		parents = commit_graph_topology_parents(t, cur, &parents_nr);
+		for (uint32_t j = 0; j < parents_nr; j++) {
+			struct bitmap **bitmap_p = &bitmaps[parents[j]];
+
+			if (w.flags[parents[j]] & TOPOLOGY_DONE)
+				continue;
+			if (!*bitmap_p)
+				*bitmap_p = bitmap_word_alloc(width);
+			bitmap_or(*bitmap_p, bitmap_c);
+
+			/* See the STALE marking in ahead_behind(). */
+			topology_walk_mark(&w, parents[j],
+					   bitmap_popcount(*bitmap_p) == commits_nr ?
+					   TOPOLOGY_STALE : 0);
+		}
+
+		bitmap_free(bitmap_c);
+		bitmaps[cur] = NULL;
+	}
+
+	while (w.queue.nr) {
+		uint32_t cur = topology_walk_next(&w);
+
+		bitmap_free(bitmaps[cur]);
+		bitmaps[cur] = NULL;
+	}
+	clear_topology_walk(&w);
+	free(pos);
+	return 0;
+}
+
 void ahead_behind(struct repository *r,
 		  struct commit **commits, size_t commits_nr,
 		  struct ahead_behind_count *counts, size_t counts_nr)
@@ -1054,6 +1442,9 @@ void ahead_behind(struct repository *r,
 		counts[i].behind = 0;
 	}
 
+	if (!ahead_behind_in_graph(r, commits, commits_nr, counts, counts_nr))
+		return;
+
 	ensure_generations_valid(r, commits, commits_nr);
 
 	init_bit_arrays(&bit_arrays);
@@ -1356,3 +1747,66 @@ int get_branch_base_for_tip(struct repository *r,
 	clear_prio_queue(&queue);
 	return best_index > 0 ? best_index - 1 : -1;
 }
+
+int count_reachable_in_graph(struct repository *r,
+			     struct commit **tips, size_t tips_nr,
+			     struct commit **bottoms, size_t bottoms_nr,
+			     int first_parent_only, uint32_t *count)
+{
+	struct commit_graph_topology *t;
+	struct topology_walk w;
+	uint32_t *pos;
+	uint32_t walked = 0;
+	size_t i;
+
+	t = repo_commit_graph_topology(r);
+	if (!t)
+		return -1;
+
+	ALLOC_ARRAY(pos, st_add(tips_nr, bottoms_nr));
+	if (find_positions_in_graph(r, tips, tips_nr, pos) ||
+	    find_positions_in_graph(r, bottoms, bottoms_nr, pos + tips_nr)) {
+		free(pos);
+		return -1;
+	}
+	init_topology_walk(&w, t);
+
+	/*
+	 * Commits reachable from the tips are painted with PARENT1, and
+	 * those reachable from the bottoms with STALE, which stops the
+	 * walk once only they are left.
+	 */
+	for (i = 0; i < tips_nr; i++)
+		topology_walk_mark(&w, pos[i], TOPOLOGY_PARENT1);
+	for (i = 0; i < bottoms_nr; i++)
+		topology_walk_mark(&w, pos[tips_nr + i], TOPOLOGY_STALE);
+
+	*count = 0;
+	while (w.queued_nonstale) {
+		uint32_t cur = topology_walk_next(&w);
+		unsigned char flags = w.flags[cur];
+		const uint32_t *parents;
+		uint32_t j, parents_nr;
+
+		walked++;
+		if (flags & TOPOLOGY_STALE)
+			flags = TOPOLOGY_STALE;
+		else
+			(*count)++;
+
+		parents = commit_graph_topology_parents(t, cur, &parents_nr);
+		if (first_parent_only && !(flags & TOPOLOGY_STALE) &&
+		    parents_nr > 1)
+			parents_nr = 1;
+		for (j = 0; j < parents_nr; j++)
+			topology_walk_mark(&w, parents[j],
+					   flags & (TOPOLOGY_PARENT1 | TOPOLOGY_STALE));
+	}
+
+	trace2_data_intmax("commit-reach", r, "count_reachable_in_graph/walked",
+			   walked);
+
+	clear_topology_walk(&w);
+	free(pos);
+	return 0;
+}
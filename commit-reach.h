@@ -130,6 +130,20 @@ void ahead_behind(struct repository *r,
 		  struct commit **commits, size_t commits_nr,
 		  struct ahead_behind_count *counts, size_t counts_nr);
 
+/*
+ * Count the commits reachable from `tips` and not from `bottoms` into
+ * `count`, following only first parents from the tips if
+ * `first_parent_only` is set, like "git rev-list --count". The walk only
+ * uses the commit-graph, and never parses commits.
+ *
+ * Return -1 without counting if one of the commits is not in the
+ * commit-graph, or it has no generation numbers.
+ */
+int count_reachable_in_graph(struct repository *r,
+			     struct commit **tips, size_t tips_nr,
+			     struct commit **bottoms, size_t bottoms_nr,
+			     int first_parent_only, uint32_t *count);
+
 /*
  * For all tip commits, add 'mark' to their flags if and only if they
  * are reachable from one of the commits in 'bases'.
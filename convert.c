@@ -14,9 +14,12 @@
 #include "quote.h"
 #include "read-cache-ll.h"
 #include "sigchain.h"
+#include "strmap.h"
 #include "pkt-line.h"
 #include "sub-process.h"
+#include "thread-utils.h"
 #include "trace.h"
+#include "trace2.h"
 #include "utf8.h"
 #include "merge-ll.h"
 
@@ -793,135 +796,171 @@ static void handle_filter_error(const struct strbuf *filter_status,
 	}
 }
 
-static int apply_multi_file_filter(const char *path, const char *src, size_t len,
-				   int fd, struct strbuf *dst, const char *cmd,
-				   const unsigned int wanted_capability,
-				   const struct checkout_metadata *meta,
-				   struct delayed_checkout *dco)
+static int write_filter_request(struct child_process *process,
+				const char *path, const char *src, size_t len,
+				int fd, const char *filter_type,
+				const struct checkout_metadata *meta,
+				int can_delay)
 {
 	int err;
-	int can_delay = 0;
-	struct cmd2process *entry;
-	struct child_process *process;
-	struct strbuf nbuf = STRBUF_INIT;
-	struct strbuf filter_status = STRBUF_INIT;
-	const char *filter_type;
-
-	if (!subprocess_map_initialized) {
-		subprocess_map_initialized = 1;
-		hashmap_init(&subprocess_map, cmd2process_cmp, NULL, 0);
-		entry = NULL;
-	} else {
-		entry = (struct cmd2process *)subprocess_find_entry(&subprocess_map, cmd);
-	}
-
-	fflush(NULL);
-
-	if (!entry) {
-		entry = xmalloc(sizeof(*entry));
-		entry->supported_capabilities = 0;
-
-		if (subprocess_start(&subprocess_map, &entry->subprocess, cmd, start_multi_file_filter_fn)) {
-			free(entry);
-			return 0;
-		}
-	}
-	process = &entry->subprocess.process;
-
-	if (!(entry->supported_capabilities & wanted_capability))
-		return 0;
-
-	if (wanted_capability & CAP_CLEAN)
-		filter_type = "clean";
-	else if (wanted_capability & CAP_SMUDGE)
-		filter_type = "smudge";
-	else
-		die(_("unexpected filter type"));
-
-	sigchain_push(SIGPIPE, SIG_IGN);
 
 	assert(strlen(filter_type) < LARGE_PACKET_DATA_MAX - strlen("command=\n"));
 	err = packet_write_fmt_gently(process->in, "command=%s\n", filter_type);
 	if (err)
-		goto done;
+		return err;
 
 	err = strlen(path) > LARGE_PACKET_DATA_MAX - strlen("pathname=\n");
 	if (err) {
 		error(_("path name too long for external filter"));
-		goto done;
+		return err;
 	}
 
 	err = packet_write_fmt_gently(process->in, "pathname=%s\n", path);
 	if (err)
-		goto done;
+		return err;
 
 	if (meta && meta->refname) {
 		err = packet_write_fmt_gently(process->in, "ref=%s\n", meta->refname);
 		if (err)
-			goto done;
+			return err;
 	}
 
 	if (meta && !is_null_oid(&meta->treeish)) {
 		err = packet_write_fmt_gently(process->in, "treeish=%s\n", oid_to_hex(&meta->treeish));
 		if (err)
-			goto done;
+			return err;
 	}
 
 	if (meta && !is_null_oid(&meta->blob)) {
 		err = packet_write_fmt_gently(process->in, "blob=%s\n", oid_to_hex(&meta->blob));
 		if (err)
-			goto done;
+			return err;
 	}
 
-	if ((entry->supported_capabilities & CAP_DELAY) &&
-	    dco && dco->state == CE_CAN_DELAY) {
-		can_delay = 1;
+	if (can_delay) {
 		err = packet_write_fmt_gently(process->in, "can-delay=1\n");
 		if (err)
-			goto done;
+			return err;
 	}
 
 	err = packet_flush_gently(process->in);
 	if (err)
-		goto done;
+		return err;
 
 	if (fd >= 0)
 		err = write_packetized_from_fd_no_flush(fd, process->in);
 	else
 		err = write_packetized_from_buf_no_flush(src, len, process->in);
 	if (err)
-		goto done;
+		return err;
 
-	err = packet_flush_gently(process->in);
+	return packet_flush_gently(process->in);
+}
+
+/*
+ * Read the answer of the filter to a request sent with
+ * write_filter_request(). If `delayed` is not NULL, the filter may
+ * answer that it delayed the blob, in which case `*delayed` is set and
+ * `dst` is left empty.
+ */
+static int read_filter_response(struct child_process *process,
+				struct strbuf *dst, struct strbuf *filter_status,
+				int *delayed)
+{
+	int err;
+
+	err = subprocess_read_status(process->out, filter_status);
 	if (err)
-		goto done;
+		return err;
 
-	err = subprocess_read_status(process->out, &filter_status);
+	if (delayed && !strcmp(filter_status->buf, "delayed")) {
+		*delayed = 1;
+		return 0;
+	}
+
+	/* The filter got the blob and wants to send us a response. */
+	err = strcmp(filter_status->buf, "success");
 	if (err)
-		goto done;
+		return err;
 
-	if (can_delay && !strcmp(filter_status.buf, "delayed")) {
-		string_list_insert(&dco->filters, cmd);
-		string_list_insert(&dco->paths, path);
+	err = read_packetized_to_strbuf(process->out, dst,
+					PACKET_READ_GENTLE_ON_EOF) < 0;
+	if (err)
+		return err;
+
+	err = subprocess_read_status(process->out, filter_status);
+	if (err)
+		return err;
+
+	return strcmp(filter_status->buf, "success");
+}
+
+static const char *filter_type_name(const unsigned int wanted_capability)
+{
+	if (wanted_capability & CAP_CLEAN)
+		return "clean";
+	else if (wanted_capability & CAP_SMUDGE)
+		return "smudge";
+	else
+		die(_("unexpected filter type"));
+}
+
+static int apply_multi_file_filter(const char *path, const char *src, size_t len,
+				   int fd, struct strbuf *dst, const char *cmd,
+				   const unsigned int wanted_capability,
+				   const struct checkout_metadata *meta,
+				   struct delayed_checkout *dco)
+{
+	int err;
+	int can_delay = 0, delayed = 0;
+	struct cmd2process *entry;
+	struct child_process *process;
+	struct strbuf nbuf = STRBUF_INIT;
+	struct strbuf filter_status = STRBUF_INIT;
+	const char *filter_type;
+
+	if (!subprocess_map_initialized) {
+		subprocess_map_initialized = 1;
+		hashmap_init(&subprocess_map, cmd2process_cmp, NULL, 0);
+		entry = NULL;
 	} else {
-		/* The filter got the blob and wants to send us a response. */
-		err = strcmp(filter_status.buf, "success");
-		if (err)
-			goto done;
+		entry = (struct cmd2process *)subprocess_find_entry(&subprocess_map, cmd);
+	}
 
-		err = read_packetized_to_strbuf(process->out, &nbuf,
-						PACKET_READ_GENTLE_ON_EOF) < 0;
-		if (err)
-			goto done;
+	fflush(NULL);
 
-		err = subprocess_read_status(process->out, &filter_status);
-		if (err)
-			goto done;
+	if (!entry) {
+		entry = xmalloc(sizeof(*entry));
+		entry->supported_capabilities = 0;
 
-		err = strcmp(filter_status.buf, "success");
+		if (subprocess_start(&subprocess_map, &entry->subprocess, cmd, start_multi_file_filter_fn)) {
+			free(entry);
+			return 0;
+		}
+	}
+	process = &entry->subprocess.process;
+
+	if (!(entry->supported_capabilities & wanted_capability))
+		return 0;
+
+	filter_type = filter_type_name(wanted_capability);
+
+	if ((entry->supported_capabilities & CAP_DELAY) &&
+	    dco && dco->state == CE_CAN_DELAY)
+		can_delay = 1;
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = write_filter_request(process, path, src, len, fd, filter_type,
+				   meta, can_delay);
+	if (!err)
+		err = read_filter_response(process, &nbuf, &filter_status,
+					   can_delay ? &delayed : NULL);
+	if (!err && delayed) {
+		string_list_insert(&dco->filters, cmd);
+		string_list_insert(&dco->paths, path);
 	}
 
-done:
 	sigchain_pop(SIGPIPE);
 
 	if (err)
@@ -991,8 +1030,76 @@ static struct convert_driver {
 	char *clean;
 	char *process;
 	int required;
+	int parallel;
 } *user_convert, **user_convert_tail;
 
+/*
+ * Output of the clean filter for files of the working tree, computed
+ * ahead of time by convert_prefetch_clean() and keyed by path.
+ */
+struct precleaned_blob {
+	const char *cmd;
+	struct object_id src_oid;
+	struct strbuf dst;
+};
+
+static struct strmap precleaned = STRMAP_INIT;
+
+void discard_prefetched_clean(void)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&precleaned, &iter, e) {
+		struct precleaned_blob *blob = e->value;
+		strbuf_release(&blob->dst);
+		free(blob);
+	}
+	strmap_partial_clear(&precleaned, 0);
+}
+
+/*
+ * Clean `path` with the output convert_prefetch_clean() got for it, if
+ * the filter `cmd` was run on the same content, or else with `cmd`
+ * itself.
+ */
+static int apply_precleaned_filter(const char *path, const char *src,
+				   size_t len, int fd, struct strbuf *dst,
+				   const char *cmd)
+{
+	struct precleaned_blob *blob = strmap_get(&precleaned, path);
+	struct strbuf buf = STRBUF_INIT;
+	struct object_id oid;
+	int ret = 0;
+
+	strmap_remove(&precleaned, path, 0);
+
+	if (fd >= 0) {
+		if (strbuf_read(&buf, fd, 0) < 0)
+			error_errno(_("read error while reading %s"), path);
+		else
+			ret = 1;
+		src = buf.buf;
+		len = buf.len;
+	} else {
+		ret = 1;
+	}
+
+	if (ret) {
+		hash_object_file(the_hash_algo, src, len, OBJ_BLOB, &oid);
+		if (!strcmp(blob->cmd, cmd) && oideq(&oid, &blob->src_oid))
+			strbuf_swap(dst, &blob->dst);
+		else
+			ret = apply_multi_file_filter(path, src, len, -1, dst,
+						      cmd, CAP_CLEAN, NULL, NULL);
+	}
+
+	strbuf_release(&blob->dst);
+	free(blob);
+	strbuf_release(&buf);
+	return ret;
+}
+
 static int apply_filter(const char *path, const char *src, size_t len,
 			int fd, struct strbuf *dst, struct convert_driver *drv,
 			const unsigned int wanted_capability,
@@ -1014,9 +1121,14 @@ static int apply_filter(const char *path, const char *src, size_t len,
 
 	if (cmd && *cmd)
 		return apply_single_file_filter(path, src, len, fd, dst, cmd);
-	else if (drv->process && *drv->process)
+	else if (drv->process && *drv->process) {
+		if ((wanted_capability & CAP_CLEAN) &&
+		    strmap_contains(&precleaned, path))
+			return apply_precleaned_filter(path, src, len, fd, dst,
+						       drv->process);
 		return apply_multi_file_filter(path, src, len, fd, dst,
 			drv->process, wanted_capability, meta, dco);
+	}
 
 	return 0;
 }
@@ -1074,6 +1186,11 @@ static int read_convert_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (!strcmp("parallel", key)) {
+		drv->parallel = git_config_bool(var, value);
+		return 0;
+	}
+
 	return 0;
 }
 
@@ -1316,19 +1433,23 @@ static int git_path_check_ident(struct attr_check_item *check)
 
 static struct attr_check *check;
 
+static void init_convert_attrs(void)
+{
+	if (check)
+		return;
+	check = attr_check_initl("crlf", "ident", "filter",
+				 "eol", "text", "working-tree-encoding",
+				 NULL);
+	user_convert_tail = &user_convert;
+	git_config(read_convert_config, NULL);
+}
+
 void convert_attrs(struct index_state *istate,
 		   struct conv_attrs *ca, const char *path)
 {
 	struct attr_check_item *ccheck = NULL;
 
-	if (!check) {
-		check = attr_check_initl("crlf", "ident", "filter",
-					 "eol", "text", "working-tree-encoding",
-					 NULL);
-		user_convert_tail = &user_convert;
-		git_config(read_convert_config, NULL);
-	}
-
+	init_convert_attrs();
 	git_check_attr(istate, path, check);
 	ccheck = check->items;
 	ca->crlf_action = git_path_check_crlf(ccheck + 4);
@@ -1361,6 +1482,30 @@ void convert_attrs(struct index_state *istate,
 		ca->crlf_action = CRLF_AUTO_INPUT;
 }
 
+const char *conv_attrs_driver_name(const struct conv_attrs *ca)
+{
+	return ca->drv ? ca->drv->name : NULL;
+}
+
+int conv_attrs_set_driver(struct conv_attrs *ca, const char *name)
+{
+	struct convert_driver *drv;
+
+	init_convert_attrs();
+	for (drv = user_convert; drv; drv = drv->next) {
+		if (!strcmp(name, drv->name)) {
+			ca->drv = drv;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int conv_attrs_filter_is_parallel(const struct conv_attrs *ca)
+{
+	return ca->drv && ca->drv->parallel;
+}
+
 void reset_parsed_attributes(void)
 {
 	struct convert_driver *drv, *next;
@@ -1426,6 +1571,201 @@ const char *get_convert_attr_ascii(struct index_state *istate, const char *path)
 	return "";
 }
 
+/* Stop sending files to clean once this much output is waiting */
+#define PRECLEAN_MAX_BUFFERED (64 * 1024 * 1024)
+
+struct preclean_slot {
+	struct hashmap processes;
+	struct cmd2process *entry;
+	size_t job; /* the request in flight, or SIZE_MAX */
+	struct object_id src_oid;
+};
+
+static void preclean_send(struct preclean_slot *slot, const char **paths,
+			  const size_t *jobs, size_t jobs_nr, size_t *next)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	slot->job = SIZE_MAX;
+	if (!slot->entry ||
+	    !(slot->entry->supported_capabilities & CAP_CLEAN))
+		return;
+
+	while (*next < jobs_nr) {
+		const char *path = paths[jobs[(*next)++]];
+		struct stat st;
+
+		strbuf_reset(&buf);
+		if (lstat(path, &st) || !S_ISREG(st.st_mode) ||
+		    strbuf_read_file(&buf, path, st.st_size) < 0)
+			continue;
+
+		if (write_filter_request(&slot->entry->subprocess.process,
+					 path, buf.buf, buf.len, -1, "clean",
+					 NULL, 0)) {
+			/* Leave this and the next paths to the caller. */
+			slot->entry->supported_capabilities = 0;
+			break;
+		}
+		hash_object_file(the_hash_algo, buf.buf, buf.len, OBJ_BLOB,
+				 &slot->src_oid);
+		slot->job = *next - 1;
+		break;
+	}
+	strbuf_release(&buf);
+}
+
+static size_t preclean_receive(struct preclean_slot *slot, const char *path,
+			       const char *cmd)
+{
+	struct precleaned_blob *blob = xcalloc(1, sizeof(*blob));
+	struct strbuf filter_status = STRBUF_INIT;
+	size_t size = 0;
+
+	strbuf_init(&blob->dst, 0);
+	if (read_filter_response(&slot->entry->subprocess.process, &blob->dst,
+				 &filter_status, NULL)) {
+		/*
+		 * Stop using this process, whatever the problem. The
+		 * caller cleans the path on its own and reports it.
+		 */
+		slot->entry->supported_capabilities = 0;
+		strbuf_release(&blob->dst);
+		free(blob);
+	} else {
+		blob->cmd = cmd;
+		oidcpy(&blob->src_oid, &slot->src_oid);
+		size = blob->dst.len;
+		strmap_put(&precleaned, path, blob);
+	}
+	strbuf_release(&filter_status);
+	slot->job = SIZE_MAX;
+	return size;
+}
+
+static void preclean_stop(struct preclean_slot *slot)
+{
+	struct child_process *process;
+
+	if (!slot->entry)
+		goto out;
+	process = &slot->entry->subprocess.process;
+	if (slot->entry->supported_capabilities & CAP_CLEAN) {
+		/* Closing the pipes lets the filter shut down on its own. */
+		process->clean_on_exit = 0;
+		close(process->in);
+		close(process->out);
+		finish_command(process);
+		hashmap_remove(&slot->processes, &slot->entry->subprocess.ent,
+			       NULL);
+	} else {
+		subprocess_stop(&slot->processes, &slot->entry->subprocess);
+	}
+	free(slot->entry);
+out:
+	hashmap_clear(&slot->processes);
+}
+
+size_t convert_prefetch_clean(struct index_state *istate,
+			      const char **paths, size_t nr)
+{
+	int nr_processes;
+	const char *cmd = NULL;
+	size_t *jobs = NULL, jobs_nr = 0, jobs_alloc = 0;
+	size_t next = 0, buffered = 0, done = nr;
+	struct preclean_slot *slots;
+	int i, busy;
+
+	discard_prefetched_clean();
+
+	if (repo_config_get_int(istate->repo, "add.filterprefetch",
+				&nr_processes))
+		nr_processes = 1;
+	if (nr_processes < 1)
+		nr_processes = online_cpus();
+	if (nr_processes < 2)
+		return nr;
+
+	for (size_t j = 0; j < nr; j++) {
+		struct conv_attrs ca;
+
+		convert_attrs(istate, &ca, paths[j]);
+		if (!ca.drv || !ca.drv->parallel ||
+		    !ca.drv->process || !*ca.drv->process)
+			continue;
+		if (!cmd)
+			cmd = ca.drv->process;
+		else if (strcmp(cmd, ca.drv->process))
+			continue;
+		ALLOC_GROW(jobs, jobs_nr + 1, jobs_alloc);
+		jobs[jobs_nr++] = j;
+	}
+
+	if (jobs_nr < 2) {
+		free(jobs);
+		return nr;
+	}
+	if ((size_t)nr_processes > jobs_nr)
+		nr_processes = jobs_nr;
+
+	trace2_region_enter("convert", "prefetch_clean", istate->repo);
+
+	fflush(NULL);
+	CALLOC_ARRAY(slots, nr_processes);
+	for (i = 0; i < nr_processes; i++) {
+		struct cmd2process *entry = xmalloc(sizeof(*entry));
+
+		hashmap_init(&slots[i].processes, cmd2process_cmp, NULL, 0);
+		entry->supported_capabilities = 0;
+		if (subprocess_start(&slots[i].processes, &entry->subprocess,
+				     cmd, start_multi_file_filter_fn))
+			free(entry);
+		else
+			slots[i].entry = entry;
+	}
+
+	/*
+	 * Keep one request in flight per filter process, so that they all
+	 * work at the same time. Each filter reads its whole request
+	 * before answering, as when it is used from a single process.
+	 */
+	sigchain_push(SIGPIPE, SIG_IGN);
+	for (i = 0; i < nr_processes; i++)
+		preclean_send(&slots[i], paths, jobs, jobs_nr, &next);
+	do {
+		busy = 0;
+		for (i = 0; i < nr_processes; i++) {
+			struct preclean_slot *slot = &slots[i];
+
+			if (slot->job == SIZE_MAX)
+				continue;
+			buffered += preclean_receive(slot, paths[jobs[slot->job]],
+						     cmd);
+			if (buffered < PRECLEAN_MAX_BUFFERED)
+				preclean_send(slot, paths, jobs, jobs_nr, &next);
+			busy |= slot->job != SIZE_MAX;
+		}
+	} while (busy);
+	sigchain_pop(SIGPIPE);
+
+	/*
+	 * Each filter holds the pipes of the ones started before it, so they
+	 * can only see the end of their input in the reverse order.
+	 */
+	for (i = nr_processes - 1; i >= 0; i--)
+		preclean_stop(&slots[i]);
+	free(slots);
+
+	/* Past the budget, the paths not sent are left to the next call. */
+	if (next < jobs_nr && buffered >= PRECLEAN_MAX_BUFFERED)
+		done = jobs[next];
+	trace2_data_intmax("convert", istate->repo, "prefetch_clean/cleaned",
+			   strmap_get_size(&precleaned));
+	trace2_region_leave("convert", "prefetch_clean", istate->repo);
+	free(jobs);
+	return done;
+}
+
 int convert_to_git(struct index_state *istate,
 		   const char *path, const char *src, size_t len,
 		   struct strbuf *dst, int conv_flags)
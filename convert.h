@@ -91,6 +91,24 @@ struct conv_attrs {
 void convert_attrs(struct index_state *istate,
 		   struct conv_attrs *ca, const char *path);
 
+/*
+ * Return the name of the filter driver of `ca` (i.e. the value of the
+ * "filter" attribute, if such a driver is configured), or NULL.
+ */
+const char *conv_attrs_driver_name(const struct conv_attrs *ca);
+
+/*
+ * Set the filter driver of `ca` to the one configured as "filter.<name>".
+ * Return -1 if there is no such driver.
+ */
+int conv_attrs_set_driver(struct conv_attrs *ca, const char *name);
+
+/*
+ * Return 1 if the filter driver of `ca` allows several instances of its
+ * commands to run concurrently ("filter.<driver>.parallel").
+ */
+int conv_attrs_filter_is_parallel(const struct conv_attrs *ca);
+
 extern enum eol core_eol;
 extern char *check_roundtrip_encoding;
 const char *get_cached_convert_stats_ascii(struct index_state *istate,
@@ -99,6 +117,22 @@ const char *get_wt_convert_stats_ascii(const char *path);
 const char *get_convert_attr_ascii(struct index_state *istate,
 				   const char *path);
 
+/*
+ * Run the clean filter of the working tree files `paths` ahead of
+ * convert_to_git(), with several instances of the filter at once, when
+ * their filter driver is a `process` declared with
+ * "filter.<driver>.parallel" and "add.filterPrefetch" allows more than
+ * one.  The number of paths to hand to the filter in one go is limited
+ * by the memory taken by the outputs, which wait for convert_to_git().
+ * Returns how many paths at the front of `paths` were handled; the
+ * caller passes the others again once it has added these ones.
+ */
+size_t convert_prefetch_clean(struct index_state *istate,
+			      const char **paths, size_t nr);
+
+/* Drop the outputs of convert_prefetch_clean() that were not used. */
+void discard_prefetched_clean(void);
+
 /* returns 1 if *dst was used */
 int convert_to_git(struct index_state *istate,
 		   const char *path, const char *src, size_t len,
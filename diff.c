@@ -56,6 +56,7 @@
 static int diff_detect_rename_default;
 static int diff_indent_heuristic = 1;
 static int diff_rename_limit_default = 1000;
+static int diff_rename_cache_default;
 static int diff_suppress_blank_empty;
 static int diff_use_color_default = -1;
 static int diff_color_moved_default;
@@ -490,6 +491,11 @@ int git_diff_basic_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (!strcmp(var, "diff.renamecache")) {
+		diff_rename_cache_default = git_config_bool(var, value);
+		return 0;
+	}
+
 	if (userdiff_config(var, value) < 0)
 		return -1;
 
@@ -3426,6 +3432,13 @@ int diff_filespec_is_binary(struct repository *r,
 	return one->is_binary;
 }
 
+int diff_filespec_binary_attr(struct repository *r,
+			      struct diff_filespec *one)
+{
+	diff_filespec_load_driver(one, r->index);
+	return one->driver->binary;
+}
+
 static const struct userdiff_funcname *
 diff_funcname_pattern(struct diff_options *o, struct diff_filespec *one)
 {
@@ -4775,6 +4788,7 @@ void repo_diff_setup(struct repository *r, struct diff_options *options)
 	options->add_remove = diff_addremove;
 	options->use_color = diff_use_color_default;
 	options->detect_rename = diff_detect_rename_default;
+	options->rename_cache = diff_rename_cache_default;
 	options->xdl_opts |= diff_algorithm;
 	if (diff_indent_heuristic)
 		DIFF_XDL_SET(options, INDENT_HEURISTIC);
@@ -70,6 +70,7 @@ struct diff_options;
 struct diff_queue_struct;
 struct oid_array;
 struct option;
+struct rename_score_cache;
 struct repository;
 struct rev_info;
 struct userdiff_driver;
@@ -309,6 +310,20 @@ struct diff_options {
 	int rename_score;
 	int rename_limit;
 
+	/*
+	 * Remember the similarity scores computed during inexact rename
+	 * detection in refs/notes/renames (diff.renameCache).
+	 */
+	int rename_cache;
+
+	/*
+	 * If set, look up and remember similarity scores in this cache
+	 * instead, so that they are shared by all the rename detections
+	 * using it; see rename_score_cache_new().  It is owned by the
+	 * caller.
+	 */
+	struct rename_score_cache *rename_score_cache;
+
 	int needed_rename_limit;
 	int degraded_cc_to_c;
 	int show_rename_progress;
@@ -106,22 +106,58 @@ static struct spanhash_top *add_spanhash(struct spanhash_top *top,
 	}
 }
 
+/*
+ * The counted chunks of a buffer, once hashing is done: the distinct
+ * hash values in ascending order, followed by the count for each of
+ * them, in a single allocation so that it can be kept in (and freed
+ * from) diff_filespec.cnt_data.  Comparing two of them only has to walk
+ * the hash values, which are densely packed.
+ */
+struct spanhash_signature {
+	unsigned int nr;
+	unsigned long total; /* sum of all counts */
+	unsigned int data[FLEX_ARRAY]; /* nr hash values, then nr counts */
+};
+
 static int spanhash_cmp(const void *a_, const void *b_)
 {
 	const struct spanhash *a = a_;
 	const struct spanhash *b = b_;
 
-	/* A count of zero compares at the end.. */
-	if (!a->cnt)
-		return !b->cnt ? 0 : 1;
-	if (!b->cnt)
-		return -1;
 	return a->hashval < b->hashval ? -1 :
 		a->hashval > b->hashval ? 1 : 0;
 }
 
-static struct spanhash_top *hash_chars(struct repository *r,
-				       struct diff_filespec *one)
+static struct spanhash_signature *spanhash_signature(struct spanhash_top *top)
+{
+	struct spanhash_signature *sig;
+	unsigned int *hashval, *cnt;
+	size_t sz = (size_t)1 << top->alloc_log2;
+	size_t i, nr = 0;
+
+	/* Move the used buckets to the front, and sort them */
+	for (i = 0; i < sz; i++)
+		if (top->data[i].cnt)
+			top->data[nr++] = top->data[i];
+	QSORT(top->data, nr, spanhash_cmp);
+
+	sig = xmalloc(st_add(sizeof(*sig),
+			     st_mult(sizeof(*sig->data), st_mult(nr, 2))));
+	sig->nr = nr;
+	sig->total = 0;
+	hashval = sig->data;
+	cnt = sig->data + nr;
+	for (i = 0; i < nr; i++) {
+		hashval[i] = top->data[i].hashval;
+		cnt[i] = top->data[i].cnt;
+		sig->total += cnt[i];
+	}
+	free(top);
+	return sig;
+}
+
+static struct spanhash_signature *hash_chars(struct repository *r,
+					     struct diff_filespec *one)
 {
 	int i, n;
 	unsigned int accum1, accum2, hashval;
@@ -162,8 +198,71 @@ static struct spanhash_top *hash_chars(struct repository *r,
 		hashval = (accum1 + accum2 * 0x61) % HASHBASE;
 		hash = add_spanhash(hash, hashval, n);
 	}
-	QSORT(hash->data, (size_t)1ul << hash->alloc_log2, spanhash_cmp);
-	return hash;
+	return spanhash_signature(hash);
+}
+
+/*
+ * Return the index of the first of hashval[pos..nr) that is not below
+ * "want", given that hashval[pos] is.  Gallop, as the two buffers being
+ * compared often differ a lot in how many chunks they have.
+ */
+static size_t skip_below(const unsigned int *hashval, size_t pos, size_t nr,
+			 unsigned int want)
+{
+	size_t step = 1, lo = pos, hi;
+
+	while (lo + step < nr && hashval[lo + step] < want) {
+		lo += step;
+		step <<= 1;
+	}
+	hi = (lo + step < nr) ? lo + step : nr;
+
+	/* hashval[lo] < want, and hashval[hi] >= want if hi < nr */
+	while (lo + 1 < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		if (hashval[mi] < want)
+			lo = mi;
+		else
+			hi = mi;
+	}
+	return hi;
+}
+
+/*
+ * Sum, over the chunks the two buffers have in common, of the smaller
+ * of the two counts.
+ */
+static unsigned long count_common(const struct spanhash_signature *a,
+				  const struct spanhash_signature *b)
+{
+	const unsigned int *a_hash, *a_cnt, *b_hash, *b_cnt;
+	unsigned long common = 0;
+	size_t i, j;
+
+	if (a->nr > b->nr)
+		SWAP(a, b);
+	a_hash = a->data;
+	a_cnt = a->data + a->nr;
+	b_hash = b->data;
+	b_cnt = b->data + b->nr;
+
+	for (i = j = 0; i < a->nr && j < b->nr; i++) {
+		if (b_hash[j] < a_hash[i])
+			j = skip_below(b_hash, j, b->nr, a_hash[i]);
+		if (j < b->nr && b_hash[j] == a_hash[i]) {
+			common += (a_cnt[i] < b_cnt[j]) ? a_cnt[i] : b_cnt[j];
+			j++;
+		}
+	}
+	return common;
+}
+
+void diffcore_count_prepare(struct repository *r,
+			    struct diff_filespec *one,
+			    void **count_p)
+{
+	if (!*count_p)
+		*count_p = hash_chars(r, one);
 }
 
 int diffcore_count_changes(struct repository *r,
@@ -174,8 +273,7 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added)
 {
-	struct spanhash *s, *d;
-	struct spanhash_top *src_count, *dst_count;
+	struct spanhash_signature *src_count, *dst_count;
 	unsigned long sc, la;
 
 	src_count = dst_count = NULL;
@@ -193,38 +291,14 @@ int diffcore_count_changes(struct repository *r,
 		if (dst_count_p)
 			*dst_count_p = dst_count;
 	}
-	sc = la = 0;
-
-	s = src_count->data;
-	d = dst_count->data;
-	for (;;) {
-		unsigned dst_cnt, src_cnt;
-		if (!s->cnt)
-			break; /* we checked all in src */
-		while (d->cnt) {
-			if (d->hashval >= s->hashval)
-				break;
-			la += d->cnt;
-			d++;
-		}
-		src_cnt = s->cnt;
-		dst_cnt = 0;
-		if (d->cnt && d->hashval == s->hashval) {
-			dst_cnt = d->cnt;
-			d++;
-		}
-		if (src_cnt < dst_cnt) {
-			la += dst_cnt - src_cnt;
-			sc += src_cnt;
-		}
-		else
-			sc += dst_cnt;
-		s++;
-	}
-	while (d->cnt) {
-		la += d->cnt;
-		d++;
-	}
+
+	/*
+	 * For each chunk, the source copied as many instances of it as
+	 * the destination has, up to the number the source has itself;
+	 * whatever else is in the destination was added.
+	 */
+	sc = count_common(src_count, dst_count);
+	la = dst_count->total - sc;
 
 	if (!src_count_p)
 		free(src_count);
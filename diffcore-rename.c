@@ -8,14 +8,19 @@
 #include "git-compat-util.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "gettext.h"
 #include "object-store-ll.h"
 #include "hashmap.h"
+#include "khash.h"
 #include "mem-pool.h"
+#include "notes-cache.h"
 #include "oid-array.h"
+#include "parse.h"
 #include "progress.h"
 #include "promisor-remote.h"
 #include "string-list.h"
 #include "strmap.h"
+#include "thread-utils.h"
 #include "trace2.h"
 
 /* Table of rename/copy destinations */
@@ -129,6 +134,294 @@ static void inexact_prefetch(void *prefetch_options)
 	oid_array_clear(&to_fetch);
 }
 
+/*
+ * Similarity scores found by inexact rename detection. A cache is either
+ * handed in by the caller through diff_options.rename_score_cache, to
+ * share scores between many rename detections, or set up for a single
+ * one when diff.renameCache asks for the scores kept across processes
+ * in refs/notes/renames.
+ *
+ * There is one row per destination blob and list of source blobs it was
+ * compared with, keyed by a hash of both. Besides their object names,
+ * the hash covers what else the scores depend on: the modes, as only
+ * regular files are compared, and the "binary" attribute of the paths,
+ * which decides how their contents are split into chunks. A row only lists the sources
+ * that reached the minimum score in use when it was computed; all the
+ * others scored below that. This keeps the cache proportional to the
+ * number of destinations instead of the number of comparisons, most of
+ * which find nothing. In the notes, a row is the minimum score followed
+ * by a "<source index> <score>" line for each of these sources.
+ */
+struct rename_score_row {
+	int minimum_score;
+	size_t nr, alloc;
+	struct rename_score_entry {
+		int src;
+		int score;
+	} *entries;
+};
+
+struct rename_score_cache {
+	struct repository *repo;
+	kh_oid_map_t *memory;
+	struct notes_cache *notes;
+};
+
+static void free_rename_score_row(struct rename_score_row *row)
+{
+	if (!row)
+		return;
+	free(row->entries);
+	free(row);
+}
+
+struct rename_score_cache *rename_score_cache_new(struct repository *r,
+						  int use_notes)
+{
+	struct rename_score_cache *cache;
+
+	CALLOC_ARRAY(cache, 1);
+	cache->repo = r;
+	cache->memory = kh_init_oid_map();
+	if (use_notes) {
+		cache->notes = xmalloc(sizeof(*cache->notes));
+		notes_cache_init(r, cache->notes, "renames", "rename scores v3");
+	}
+	return cache;
+}
+
+void rename_score_cache_free(struct rename_score_cache *cache)
+{
+	struct rename_score_row *row;
+
+	if (!cache)
+		return;
+	if (cache->notes) {
+		notes_cache_write(cache->notes);
+		free_notes(&cache->notes->tree);
+		free(cache->notes->validity);
+		free(cache->notes);
+	}
+	kh_foreach_value(cache->memory, row, free_rename_score_row(row));
+	kh_destroy_oid_map(cache->memory);
+	free(cache);
+}
+
+static void hash_rename_filespec(struct repository *r, git_hash_ctx *ctx,
+				 struct diff_filespec *one)
+{
+	const struct git_hash_algo *algo = the_hash_algo;
+	unsigned char buf[8];
+
+	put_be32(buf, one->mode);
+	put_be32(buf + 4, diff_filespec_binary_attr(r, one));
+	algo->update_fn(ctx, buf, sizeof(buf));
+	algo->update_fn(ctx, one->oid.hash, algo->rawsz);
+}
+
+/*
+ * Hash the list of sources the destinations are compared with. Returns
+ * -1 if some of them are not known by their object name.
+ */
+static int rename_sources_digest(struct repository *r,
+				 struct object_id *digest, int skip_unmodified)
+{
+	const struct git_hash_algo *algo = the_hash_algo;
+	git_hash_ctx ctx;
+	int i;
+
+	algo->init_fn(&ctx);
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+
+		if (skip_unmodified && diff_unmodified_pair(rename_src[i].p)) {
+			algo->update_fn(&ctx, "-", 1);
+			continue;
+		}
+		if (!one->oid_valid)
+			return -1;
+		hash_rename_filespec(r, &ctx, one);
+	}
+	algo->final_oid_fn(digest, &ctx);
+	return 0;
+}
+
+static void rename_score_key(struct repository *r, struct object_id *key,
+			     const struct object_id *sources,
+			     struct diff_filespec *dst)
+{
+	const struct git_hash_algo *algo = the_hash_algo;
+	git_hash_ctx ctx;
+
+	algo->init_fn(&ctx);
+	algo->update_fn(&ctx, sources->hash, algo->rawsz);
+	hash_rename_filespec(r, &ctx, dst);
+	algo->final_oid_fn(key, &ctx);
+}
+
+static void add_rename_score(struct rename_score_row *row, int src, int score)
+{
+	ALLOC_GROW(row->entries, row->nr + 1, row->alloc);
+	row->entries[row->nr].src = src;
+	row->entries[row->nr].score = score;
+	row->nr++;
+}
+
+static struct rename_score_row *parse_rename_score_row(const char *buf)
+{
+	struct rename_score_row *row;
+	char *end;
+	long src, score;
+
+	CALLOC_ARRAY(row, 1);
+	row->minimum_score = strtol(buf, &end, 10);
+	if (end == buf || *end != '\n' ||
+	    row->minimum_score < 0 || row->minimum_score > MAX_SCORE)
+		goto invalid;
+	for (buf = end + 1; *buf; buf = end + 1) {
+		src = strtol(buf, &end, 10);
+		if (end == buf || *end != ' ' || src < 0 || src >= rename_src_nr ||
+		    (row->nr && src <= row->entries[row->nr - 1].src))
+			goto invalid;
+		buf = end + 1;
+		score = strtol(buf, &end, 10);
+		if (end == buf || *end != '\n' || score < 0 || score > MAX_SCORE)
+			goto invalid;
+		add_rename_score(row, src, score);
+	}
+	return row;
+
+invalid:
+	free_rename_score_row(row);
+	return NULL;
+}
+
+static void remember_rename_score_row(struct rename_score_cache *cache,
+				      const struct object_id *key,
+				      struct rename_score_row *row)
+{
+	khiter_t pos;
+	int hash_ret;
+
+	pos = kh_put_oid_map(cache->memory, *key, &hash_ret);
+	if (!hash_ret)
+		free_rename_score_row(kh_value(cache->memory, pos));
+	kh_value(cache->memory, pos) = row;
+}
+
+/*
+ * Return the cached row for "key", if there is one that lists all the
+ * sources scoring at least "minimum_score".
+ */
+static struct rename_score_row *get_rename_score_row(struct rename_score_cache *cache,
+						     const struct object_id *key,
+						     int minimum_score)
+{
+	struct rename_score_row *row = NULL;
+	khiter_t pos;
+	char *value;
+	size_t size;
+
+	pos = kh_get_oid_map(cache->memory, *key);
+	if (pos < kh_end(cache->memory)) {
+		row = kh_value(cache->memory, pos);
+	} else if (cache->notes) {
+		value = notes_cache_get(cache->notes, (struct object_id *)key,
+					&size);
+		if (value) {
+			row = parse_rename_score_row(value);
+			free(value);
+			if (row)
+				remember_rename_score_row(cache, key, row);
+		}
+	}
+	if (row && row->minimum_score > minimum_score)
+		return NULL;
+	return row;
+}
+
+static void put_rename_score_row(struct rename_score_cache *cache,
+				 const struct object_id *key,
+				 struct rename_score_row *row)
+{
+	struct strbuf buf = STRBUF_INIT;
+	size_t i;
+
+	remember_rename_score_row(cache, key, row);
+	if (!cache->notes)
+		return;
+
+	strbuf_addf(&buf, "%d\n", row->minimum_score);
+	for (i = 0; i < row->nr; i++)
+		strbuf_addf(&buf, "%d %d\n", row->entries[i].src,
+			    row->entries[i].score);
+	/* ignore errors, as we might be in a readonly repository */
+	notes_cache_put(cache->notes, (struct object_id *)key, buf.buf, buf.len);
+	strbuf_release(&buf);
+}
+
+/*
+ * The score of source "src" in "row", where "next" is the position in
+ * the row to continue from, as sources are looked up in order.
+ */
+static int rename_score_in_row(const struct rename_score_row *row, int src,
+			       size_t *next)
+{
+	while (*next < row->nr && row->entries[*next].src < src)
+		(*next)++;
+	if (*next < row->nr && row->entries[*next].src == src)
+		return row->entries[*next].score;
+	return 0;
+}
+
+/*
+ * We would not consider edits that change the file size so
+ * drastically.  delta_size must be smaller than
+ * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
+ *
+ * Note that base_size == 0 case is handled here already
+ * and the score computation in similarity_score() would not have a
+ * divide-by-zero issue.
+ */
+static int sizes_too_different(const struct diff_filespec *src,
+			       const struct diff_filespec *dst,
+			       int minimum_score)
+{
+	unsigned long max_size, delta_size, base_size;
+
+	max_size = ((src->size > dst->size) ? src->size : dst->size);
+	base_size = ((src->size < dst->size) ? src->size : dst->size);
+	delta_size = max_size - base_size;
+
+	return max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE;
+}
+
+/*
+ * Once both contents are loaded or their chunk counts are computed,
+ * how similar are they?  What percentage of material in dst are from
+ * source?
+ *
+ * This does not touch the object store nor the attributes when both
+ * src->cnt_data and dst->cnt_data are filled in, so it can be called
+ * from worker threads in that case.
+ */
+static int similarity_score(struct repository *r,
+			    struct diff_filespec *src,
+			    struct diff_filespec *dst)
+{
+	unsigned long max_size, src_copied, literal_added;
+
+	if (diffcore_count_changes(r, src, dst,
+				   &src->cnt_data, &dst->cnt_data,
+				   &src_copied, &literal_added))
+		return 0;
+
+	max_size = ((src->size > dst->size) ? src->size : dst->size);
+	if (!dst->size)
+		return 0; /* should not happen */
+	return (int)(src_copied * MAX_SCORE / max_size);
+}
+
 static int estimate_similarity(struct repository *r,
 			       struct diff_filespec *src,
 			       struct diff_filespec *dst,
@@ -148,9 +441,6 @@ static int estimate_similarity(struct repository *r,
 	 * match than anything else; the destination does not even
 	 * call into this function in that case.
 	 */
-	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
-	int score;
-
 	/* We deal only with regular files.  Symlink renames are handled
 	 * only when they are exact matches --- in other words, no edits
 	 * after renaming.
@@ -176,19 +466,7 @@ static int estimate_similarity(struct repository *r,
 	    diff_populate_filespec(r, dst, dpf_opt))
 		return 0;
 
-	max_size = ((src->size > dst->size) ? src->size : dst->size);
-	base_size = ((src->size < dst->size) ? src->size : dst->size);
-	delta_size = max_size - base_size;
-
-	/* We would not consider edits that change the file size so
-	 * drastically.  delta_size must be smaller than
-	 * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
-	 *
-	 * Note that base_size == 0 case is handled here already
-	 * and the final score computation below would not have a
-	 * divide-by-zero issue.
-	 */
-	if (max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE)
+	if (sizes_too_different(src, dst, minimum_score))
 		return 0;
 
 	dpf_opt->check_size_only = 0;
@@ -198,19 +476,7 @@ static int estimate_similarity(struct repository *r,
 	if (!dst->cnt_data && diff_populate_filespec(r, dst, dpf_opt))
 		return 0;
 
-	if (diffcore_count_changes(r, src, dst,
-				   &src->cnt_data, &dst->cnt_data,
-				   &src_copied, &literal_added))
-		return 0;
-
-	/* How similar are they?
-	 * what percentage of material in dst are from source?
-	 */
-	if (!dst->size)
-		score = 0; /* should not happen */
-	else
-		score = (int)(src_copied * MAX_SCORE / max_size);
-	return score;
+	return similarity_score(r, src, dst);
 }
 
 static void record_rename_pair(int dst_index, int src_index, int score)
@@ -1077,6 +1343,160 @@ static void record_if_better(struct diff_score m[], struct diff_score *o)
 		m[worst] = *o;
 }
 
+/*
+ * Filling the similarity matrix with worker threads: the main thread
+ * first computes the chunk counts of every remaining source and
+ * destination (which needs the object store and the attributes), then
+ * each thread fills the candidate lists of its own range of
+ * destinations, comparing only chunk counts.  Every destination's
+ * candidates are still considered in source order, so the matrix is
+ * the same as when it is filled serially.
+ */
+
+/* Do not bother with threads for fewer comparisons than this per thread */
+#define RENAME_MATRIX_THREAD_COST 20000
+
+struct rename_matrix_data {
+	pthread_t pthread;
+	struct diff_score *mx;
+	const int *rows; /* indices into rename_dst, one per matrix row */
+	int row_begin, row_end;
+	int minimum_score;
+	int skip_unmodified;
+};
+
+static int rename_matrix_threads(int num_destinations, int num_sources)
+{
+	uint64_t cost = (uint64_t)num_destinations * (uint64_t)num_sources;
+	int nr_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	nr_threads = git_env_ulong("GIT_TEST_RENAME_THREADS", 0);
+	if (nr_threads)
+		return nr_threads;
+
+	nr_threads = online_cpus();
+	if (nr_threads > num_destinations)
+		nr_threads = num_destinations;
+	if ((uint64_t)nr_threads * RENAME_MATRIX_THREAD_COST > cost)
+		nr_threads = cost / RENAME_MATRIX_THREAD_COST;
+	return nr_threads < 1 ? 1 : nr_threads;
+}
+
+static void prepare_rename_counts(struct repository *r,
+				  struct diff_filespec *one,
+				  struct diff_populate_filespec_options *dpf_opt)
+{
+	if (!S_ISREG(one->mode) || one->cnt_data)
+		return;
+	dpf_opt->check_size_only = 0;
+	if (diff_populate_filespec(r, one, dpf_opt))
+		return;
+	diffcore_count_prepare(r, one, &one->cnt_data);
+	diff_free_filespec_blob(one);
+}
+
+static void *fill_rename_matrix_thread(void *_data)
+{
+	struct rename_matrix_data *d = _data;
+	int row, j;
+
+	for (row = d->row_begin; row < d->row_end; row++) {
+		int i = d->rows[row];
+		struct diff_filespec *two = rename_dst[i].p->two;
+		struct diff_score *m = &d->mx[row * NUM_CANDIDATE_PER_DST];
+
+		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+			m[j].dst = -1;
+
+		for (j = 0; j < rename_src_nr; j++) {
+			struct diff_filespec *one = rename_src[j].p->one;
+			struct diff_score this_src;
+
+			if (d->skip_unmodified &&
+			    diff_unmodified_pair(rename_src[j].p))
+				continue;
+
+			/*
+			 * Same result as estimate_similarity(): files
+			 * whose contents could not be loaded have no
+			 * chunk counts and are not similar to anything.
+			 */
+			if (!S_ISREG(one->mode) || !S_ISREG(two->mode) ||
+			    !one->cnt_data || !two->cnt_data ||
+			    sizes_too_different(one, two, d->minimum_score))
+				this_src.score = 0;
+			else
+				this_src.score = similarity_score(NULL, one, two);
+			this_src.name_score = basename_same(one, two);
+			this_src.dst = i;
+			this_src.src = j;
+			record_if_better(m, &this_src);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Fill the candidate lists of all destinations not yet matched, using
+ * nr_threads threads; returns the number of rows filled.
+ */
+static int fill_rename_matrix_threaded(struct diff_options *options,
+				       struct diff_score *mx,
+				       int num_destinations,
+				       int minimum_score,
+				       int skip_unmodified,
+				       int nr_threads,
+				       struct diff_populate_filespec_options *dpf_opt)
+{
+	struct rename_matrix_data *data;
+	int *rows;
+	int i, t, nr_rows = 0;
+
+	ALLOC_ARRAY(rows, num_destinations);
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].is_rename)
+			continue; /* exact or basename match already handled */
+		rows[nr_rows++] = i;
+		prepare_rename_counts(options->repo, rename_dst[i].p->two,
+				      dpf_opt);
+	}
+	for (i = 0; i < rename_src_nr; i++) {
+		if (skip_unmodified && diff_unmodified_pair(rename_src[i].p))
+			continue;
+		prepare_rename_counts(options->repo, rename_src[i].p->one,
+				      dpf_opt);
+	}
+
+	if (nr_threads > nr_rows)
+		nr_threads = nr_rows;
+	CALLOC_ARRAY(data, nr_threads);
+	for (t = 0; t < nr_threads; t++) {
+		struct rename_matrix_data *d = &data[t];
+		int err;
+
+		d->mx = mx;
+		d->rows = rows;
+		d->row_begin = (uint64_t)nr_rows * t / nr_threads;
+		d->row_end = (uint64_t)nr_rows * (t + 1) / nr_threads;
+		d->minimum_score = minimum_score;
+		d->skip_unmodified = skip_unmodified;
+		err = pthread_create(&d->pthread, NULL,
+				     fill_rename_matrix_thread, d);
+		if (err)
+			die(_("unable to create rename detection thread: %s"),
+			    strerror(err));
+	}
+	for (t = 0; t < nr_threads; t++)
+		if (pthread_join(data[t].pthread, NULL))
+			die("unable to join rename detection thread");
+
+	free(data);
+	free(rows);
+	return nr_rows;
+}
+
 /*
  * Returns:
  * 0 if we are under the limit;
@@ -1391,8 +1811,9 @@ void diffcore_rename_extended(struct diff_options *options,
 	struct diff_score *mx;
 	int i, j, rename_count, skip_unmodified = 0;
 	int num_destinations, dst_cnt;
-	int num_sources, want_copies;
+	int num_sources, want_copies, nr_threads;
 	struct progress *progress = NULL;
+	struct rename_score_cache *score_cache, *local_score_cache = NULL;
 	struct mem_pool local_pool;
 	struct dir_rename_info info;
 	struct diff_populate_filespec_options dpf_options = {
@@ -1578,46 +1999,111 @@ void diffcore_rename_extended(struct diff_options *options,
 		dpf_options.missing_object_data = &prefetch_options;
 	}
 
+	score_cache = options->rename_score_cache;
+	if (score_cache && score_cache->repo != options->repo)
+		BUG("rename score cache used for another repository");
+	if (!score_cache && options->rename_cache &&
+	    options->repo == the_repository)
+		score_cache = local_score_cache =
+			rename_score_cache_new(options->repo, 1);
 	CALLOC_ARRAY(mx, st_mult(NUM_CANDIDATE_PER_DST, num_destinations));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].p->two;
-		struct diff_score *m;
-
-		if (rename_dst[i].is_rename)
-			continue; /* exact or basename match already handled */
-
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			assert(!one->rename_used || want_copies || break_idx);
 
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score,
-							     &dpf_options);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
-		}
-		dst_cnt++;
+	/*
+	 * Threads only compare chunk counts; when there is a cache of
+	 * scores, consulting it first is what saves the work.
+	 */
+	nr_threads = 1;
+	if (!score_cache)
+		nr_threads = rename_matrix_threads(num_destinations,
+						   num_sources);
+	if (nr_threads > 1) {
+		trace2_data_intmax("diff", options->repo,
+				   "inexact renames/threads", nr_threads);
+		dst_cnt = fill_rename_matrix_threaded(options, mx,
+						      num_destinations,
+						      minimum_score,
+						      skip_unmodified,
+						      nr_threads,
+						      &dpf_options);
 		display_progress(progress,
 				 (uint64_t)dst_cnt * (uint64_t)num_sources);
+	} else {
+		struct object_id sources;
+		int cache_hits = 0;
+
+		if (score_cache &&
+		    rename_sources_digest(options->repo, &sources,
+					  skip_unmodified) < 0)
+			score_cache = NULL;
+
+		for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
+			struct diff_filespec *two = rename_dst[i].p->two;
+			struct rename_score_row *cached = NULL, *fresh = NULL;
+			struct object_id key;
+			size_t next = 0;
+			struct diff_score *m;
+
+			if (rename_dst[i].is_rename)
+				continue; /* exact or basename match already handled */
+
+			m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
+			for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+				m[j].dst = -1;
+
+			if (score_cache && two->oid_valid) {
+				rename_score_key(options->repo, &key, &sources, two);
+				cached = get_rename_score_row(score_cache, &key,
+							      minimum_score);
+				if (cached) {
+					cache_hits++;
+				} else {
+					CALLOC_ARRAY(fresh, 1);
+					fresh->minimum_score = minimum_score;
+				}
+			}
+
+			for (j = 0; j < rename_src_nr; j++) {
+				struct diff_filespec *one = rename_src[j].p->one;
+				struct diff_score this_src;
+
+				assert(!one->rename_used || want_copies || break_idx);
+
+				if (skip_unmodified &&
+				    diff_unmodified_pair(rename_src[j].p))
+					continue;
+
+				if (cached) {
+					this_src.score = rename_score_in_row(cached, j,
+									     &next);
+				} else {
+					this_src.score = estimate_similarity(options->repo,
+									     one, two,
+									     minimum_score,
+									     &dpf_options);
+					if (fresh && this_src.score >= minimum_score)
+						add_rename_score(fresh, j,
+								 this_src.score);
+				}
+				this_src.name_score = basename_same(one, two);
+				this_src.dst = i;
+				this_src.src = j;
+				record_if_better(m, &this_src);
+				/*
+				 * Once we run estimate_similarity,
+				 * We do not need the text anymore.
+				 */
+				diff_free_filespec_blob(one);
+				diff_free_filespec_blob(two);
+			}
+			if (fresh)
+				put_rename_score_row(score_cache, &key, fresh);
+			dst_cnt++;
+			display_progress(progress,
+					 (uint64_t)dst_cnt * (uint64_t)num_sources);
+		}
+		if (score_cache)
+			trace2_data_intmax("diff", options->repo,
+					   "inexact renames/cached", cache_hits);
 	}
 	stop_progress(&progress);
 
@@ -1633,6 +2119,8 @@ void diffcore_rename_extended(struct diff_options *options,
 	trace2_region_leave("diff", "inexact renames", options->repo);
 
  cleanup:
+	rename_score_cache_free(local_score_cache);
+
 	/* At this point, we have found some renames and copies and they
 	 * are recorded in rename_dst.  The original list is still in *q.
 	 */
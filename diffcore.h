@@ -9,6 +9,7 @@
 struct diff_options;
 struct mem_pool;
 struct oid_array;
+struct rename_score_cache;
 struct repository;
 struct strintmap;
 struct strmap;
@@ -92,6 +93,13 @@ void diff_free_filespec_data(struct diff_filespec *);
 void diff_free_filespec_blob(struct diff_filespec *);
 int diff_filespec_is_binary(struct repository *, struct diff_filespec *);
 
+/*
+ * The "binary" setting of the diff driver of a filespec, from the
+ * attributes of its path: 1 or 0, or -1 if diff_filespec_is_binary()
+ * looks at the contents instead.
+ */
+int diff_filespec_binary_attr(struct repository *, struct diff_filespec *);
+
 /**
  * This records a pair of `struct diff_filespec`; the filespec for a file in
  * the "old" set (i.e. preimage) is called `one`, and the filespec for a file
@@ -188,6 +196,18 @@ void diffcore_rename_extended(struct diff_options *options,
 			      struct strmap *dir_rename_count,
 			      struct strmap *cached_pairs);
 void diffcore_merge_broken(void);
+
+/*
+ * A cache of the similarity scores found by inexact rename detection,
+ * to be shared between the diffs set up with it in
+ * diff_options.rename_score_cache.  With "use_notes", the scores are
+ * also read from and, when the cache is freed, written to
+ * refs/notes/renames.
+ */
+struct rename_score_cache *rename_score_cache_new(struct repository *r,
+						  int use_notes);
+void rename_score_cache_free(struct rename_score_cache *cache);
+
 void diffcore_pickaxe(struct diff_options *);
 void diffcore_order(const char *orderfile);
 void diffcore_rotate(struct diff_options *);
@@ -225,6 +245,15 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added);
 
+/*
+ * Compute the chunk counts that diffcore_count_changes() would compute
+ * for the (populated) filespec "one" and store them in *count_p, so
+ * that later comparisons need neither its contents nor its attributes.
+ */
+void diffcore_count_prepare(struct repository *r,
+			    struct diff_filespec *one,
+			    void **count_p);
+
 /*
  * If filespec contains an OID and if that object is missing from the given
  * repository, add that OID to to_fetch.
@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "object-store-ll.h"
+#include "blob-cache.h"
 #include "dir.h"
 #include "environment.h"
 #include "gettext.h"
@@ -174,21 +175,17 @@ static int string_is_not_null(struct string_list_item *item, void *data UNUSED)
 	return !!item->string;
 }
 
-int finish_delayed_checkout(struct checkout *state, int show_progress)
+int finish_delayed_checkout_fn(struct checkout *state,
+			       delayed_checkout_fn fn, void *data)
 {
 	int errs = 0;
-	unsigned processed_paths = 0;
-	off_t filtered_bytes = 0;
 	struct string_list_item *filter, *path;
-	struct progress *progress = NULL;
 	struct delayed_checkout *dco = state->delayed_checkout;
 
 	if (!state->delayed_checkout)
 		return errs;
 
 	dco->state = CE_RETRY;
-	if (show_progress)
-		progress = start_delayed_progress(_("Filtering content"), dco->paths.nr);
 	while (dco->filters.nr > 0) {
 		for_each_string_list_item(filter, &dco->filters) {
 			struct string_list available_paths = STRING_LIST_INIT_DUP;
@@ -219,8 +216,6 @@ int finish_delayed_checkout(struct checkout *state, int show_progress)
 				&remove_available_paths, &available_paths);
 
 			for_each_string_list_item(path, &available_paths) {
-				struct cache_entry* ce;
-
 				if (!path->util) {
 					error("external filter '%s' signaled that '%s' "
 					      "is now available although it has not been "
@@ -235,15 +230,7 @@ int finish_delayed_checkout(struct checkout *state, int show_progress)
 					filter->string = NULL;
 					continue;
 				}
-				ce = index_file_exists(state->istate, path->string,
-						       strlen(path->string), 0);
-				if (ce) {
-					display_progress(progress, ++processed_paths);
-					errs |= checkout_entry(ce, state, NULL, path->util);
-					filtered_bytes += ce->ce_stat_data.sd_size;
-					display_throughput(progress, filtered_bytes);
-				} else
-					errs = 1;
+				errs |= fn(path->string, path->util, data);
 			}
 
 			string_list_clear(&available_paths, 0);
@@ -251,7 +238,6 @@ int finish_delayed_checkout(struct checkout *state, int show_progress)
 
 		filter_string_list(&dco->filters, 0, string_is_not_null, NULL);
 	}
-	stop_progress(&progress);
 	string_list_clear(&dco->filters, 0);
 
 	/* At this point we should not have any delayed paths anymore. */
@@ -267,6 +253,48 @@ int finish_delayed_checkout(struct checkout *state, int show_progress)
 	return errs;
 }
 
+struct delayed_index_checkout {
+	struct checkout *state;
+	struct progress *progress;
+	unsigned processed_paths;
+	off_t filtered_bytes;
+};
+
+static int checkout_delayed_index_entry(const char *path, void *util,
+					void *data)
+{
+	struct delayed_index_checkout *d = data;
+	struct cache_entry *ce;
+	int errs;
+
+	ce = index_file_exists(d->state->istate, path, strlen(path), 0);
+	if (!ce)
+		return 1;
+
+	display_progress(d->progress, ++d->processed_paths);
+	errs = checkout_entry(ce, d->state, NULL, util);
+	d->filtered_bytes += ce->ce_stat_data.sd_size;
+	display_throughput(d->progress, d->filtered_bytes);
+	return errs;
+}
+
+int finish_delayed_checkout(struct checkout *state, int show_progress)
+{
+	struct delayed_index_checkout d = { .state = state };
+	int errs;
+
+	if (!state->delayed_checkout)
+		return 0;
+
+	if (show_progress)
+		d.progress = start_delayed_progress(_("Filtering content"),
+						    state->delayed_checkout->paths.nr);
+	errs = finish_delayed_checkout_fn(state, checkout_delayed_index_entry,
+					  &d);
+	stop_progress(&d.progress);
+	return errs;
+}
+
 void update_ce_after_write(const struct checkout *state, struct cache_entry *ce,
 			   struct stat *st)
 {
@@ -300,12 +328,20 @@ static int write_entry(struct cache_entry *ce, char *path, struct conv_attrs *ca
 	clone_checkout_metadata(&meta, &state->meta, &ce->oid);
 
 	if (ce_mode_s_ifmt == S_IFREG) {
-		struct stream_filter *filter = get_stream_filter_ca(ca, &ce->oid);
+		struct stream_filter *filter;
+
+		if (!to_tempfile && !blob_cache_checkout(ce, ca, path))
+			goto finish;
+
+		filter = get_stream_filter_ca(ca, &ce->oid);
 		if (filter &&
 		    !streaming_write_entry(ce, path, filter,
 					   state, to_tempfile,
-					   &fstat_done, &st))
+					   &fstat_done, &st)) {
+			if (!to_tempfile)
+				blob_cache_add(ce, ca, path);
 			goto finish;
+		}
 	}
 
 	switch (ce_mode_s_ifmt) {
@@ -390,6 +426,8 @@ static int write_entry(struct cache_entry *ce, char *path, struct conv_attrs *ca
 		free(new_blob);
 		if (wrote < 0)
 			return error("unable to write file %s", path);
+		if (ce_mode_s_ifmt == S_IFREG && !to_tempfile)
+			blob_cache_add(ce, ca, path);
 		break;
 
 	case S_IFGITLINK:
@@ -48,6 +48,15 @@ static inline int checkout_entry(struct cache_entry *ce,
 void enable_delayed_checkout(struct checkout *state);
 int finish_delayed_checkout(struct checkout *state, int show_progress);
 
+/*
+ * Like finish_delayed_checkout(), but instead of checking out the index
+ * entry of each delayed path, call `fn` with it and with the `util` it
+ * was delayed with, as soon as its filter makes it available.
+ */
+typedef int (*delayed_checkout_fn)(const char *path, void *util, void *data);
+int finish_delayed_checkout_fn(struct checkout *state,
+			       delayed_checkout_fn fn, void *data);
+
 /*
  * Unlink the last component and schedule the leading directories for
  * removal, such that empty directories get removed.
@@ -267,6 +267,36 @@ void ewah_each_bit(struct ewah_bitmap *self, void (*callback)(size_t, void*), vo
 	}
 }
 
+int ewah_bitmap_any_set(struct ewah_bitmap *self,
+			const size_t *pos, size_t nr)
+{
+	size_t word = 0;
+	size_t pointer = 0;
+	size_t i = 0, k;
+
+	while (pointer < self->buffer_size && i < nr) {
+		eword_t *rlw = &self->buffer[pointer];
+		size_t run_end = word + rlw_get_running_len(rlw);
+
+		for (; i < nr && pos[i] / BITS_IN_EWORD < run_end; i++)
+			if (rlw_get_run_bit(rlw))
+				return 1;
+		word = run_end;
+
+		++pointer;
+
+		for (k = 0; k < rlw_get_literal_words(rlw); ++k, ++word) {
+			eword_t literal = self->buffer[pointer++];
+
+			for (; i < nr && pos[i] / BITS_IN_EWORD == word; i++)
+				if (literal & ((eword_t)1 << (pos[i] % BITS_IN_EWORD)))
+					return 1;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Clear all the bits in the bitmap. Does not free or resize
  * memory.
@@ -95,6 +95,16 @@ uint32_t ewah_checksum(struct ewah_bitmap *self);
  */
 void ewah_each_bit(struct ewah_bitmap *self, ewah_callback callback, void *payload);
 
+/**
+ * Return 1 if any of the `nr` bits at the positions in `pos`, which must
+ * be sorted in increasing order, is set on the bitmap.
+ *
+ * Like `ewah_each_bit()`, this skips over runs of words without
+ * decompressing them.
+ */
+int ewah_bitmap_any_set(struct ewah_bitmap *self,
+			const size_t *pos, size_t nr);
+
 /**
  * Set a given bit on the bitmap.
  *
@@ -1,5 +1,6 @@
 #include "git-compat-util.h"
 #include "fetch-negotiator.h"
+#include "negotiator/bloom.h"
 #include "negotiator/default.h"
 #include "negotiator/skipping.h"
 #include "negotiator/noop.h"
@@ -8,6 +9,7 @@
 void fetch_negotiator_init(struct repository *r,
 			   struct fetch_negotiator *negotiator)
 {
+	memset(negotiator, 0, sizeof(*negotiator));
 	prepare_repo_settings(r);
 	switch(r->settings.fetch_negotiation_algorithm) {
 	case FETCH_NEGOTIATION_SKIPPING:
@@ -21,10 +23,15 @@ void fetch_negotiator_init(struct repository *r,
 	case FETCH_NEGOTIATION_CONSECUTIVE:
 		default_negotiator_init(negotiator);
 		return;
+
+	case FETCH_NEGOTIATION_BLOOM:
+		bloom_negotiator_init(negotiator);
+		return;
 	}
 }
 
 void fetch_negotiator_init_noop(struct fetch_negotiator *negotiator)
 {
+	memset(negotiator, 0, sizeof(*negotiator));
 	noop_negotiator_init(negotiator);
 }
@@ -1,7 +1,10 @@
 #ifndef FETCH_NEGOTIATOR_H
 #define FETCH_NEGOTIATOR_H
 
+struct bloom_filter;
+struct bloom_filter_settings;
 struct commit;
+struct object_id;
 struct repository;
 
 /*
@@ -47,6 +50,23 @@ struct fetch_negotiator {
 	 */
 	int (*ack)(struct fetch_negotiator *, struct commit *);
 
+	/*
+	 * Optional. Before the first "have" line is sent, fill in "filter"
+	 * with the commits the negotiator would like to know whether the
+	 * server has, so that the server can point out candidates without
+	 * waiting for individual "have" lines. Returns the number of commits
+	 * in the filter; 0 means that no summary should be sent.
+	 */
+	size_t (*summarize)(struct fetch_negotiator *, struct bloom_filter *filter,
+			    const struct bloom_filter_settings *settings);
+
+	/*
+	 * Optional. Inform the negotiator that the server has a commit that
+	 * matches the summary. The negotiator may then return it from next().
+	 */
+	void (*add_candidate)(struct fetch_negotiator *,
+			      const struct object_id *);
+
 	void (*release)(struct fetch_negotiator *);
 
 	/* internal use */
@@ -3,6 +3,7 @@
 
 #include "git-compat-util.h"
 #include "repository.h"
+#include "bloom.h"
 #include "config.h"
 #include "date.h"
 #include "environment.h"
@@ -44,6 +45,7 @@ static int deepen_since_ok;
 static int deepen_not_ok;
 static int fetch_fsck_objects = -1;
 static int transfer_fsck_objects = -1;
+static int fetch_uri_jobs = 4;
 static int agent_supported;
 static int server_supports_filtering;
 static int advertise_sid;
@@ -912,16 +914,148 @@ static void add_index_pack_keep_option(struct strvec *args)
 }
 
 /*
- * If packfile URIs were provided, pass a non-NULL pointer to index_pack_args.
- * The strings to pass as the --index-pack-arg arguments to http-fetch will be
- * stored there. (It must be freed by the caller.)
+ * Packs that the server told us to download from URIs instead of sending
+ * them in its response (see "packfile-uris" in gitprotocol-v2(5)).
+ */
+struct packfile_uri_downloads {
+	struct string_list uris;	/* "<pack-hash> <uri>" */
+	struct strvec index_pack_args;
+	struct child_process *cmds;
+	int started;
+};
+
+#define PACKFILE_URI_DOWNLOADS_INIT { \
+	.uris = STRING_LIST_INIT_DUP, \
+	.index_pack_args = STRVEC_INIT, \
+}
+
+static void start_packfile_uri_download(struct packfile_uri_downloads *d)
+{
+	struct child_process *cmd = &d->cmds[d->started];
+	const char *hash = d->uris.items[d->started].string;
+	const char *uri = hash + the_hash_algo->hexsz + 1;
+	int j;
+
+	child_process_init(cmd);
+	strvec_push(&cmd->args, "http-fetch");
+	strvec_pushf(&cmd->args, "--packfile=%.*s",
+		     (int) the_hash_algo->hexsz, hash);
+	for (j = 0; j < d->index_pack_args.nr; j++)
+		strvec_pushf(&cmd->args, "--index-pack-arg=%s",
+			     d->index_pack_args.v[j]);
+	strvec_push(&cmd->args, uri);
+	cmd->git_cmd = 1;
+	cmd->no_stdin = 1;
+	cmd->out = -1;
+	cmd->clean_on_exit = 1;
+	if (start_command(cmd))
+		die("fetch-pack: unable to spawn http-fetch");
+	d->started++;
+}
+
+/*
+ * Start up to "fetch.uriJobs" http-fetch at once. Each of them downloads
+ * and indexes its pack independently, so the downloads overlap with each
+ * other and with the indexing of the pack sent by the server.
+ */
+static void start_packfile_uri_downloads(struct packfile_uri_downloads *d)
+{
+	int jobs = fetch_pack_uri_jobs();
+
+	CALLOC_ARRAY(d->cmds, d->uris.nr);
+	while (d->started < d->uris.nr && d->started < jobs)
+		start_packfile_uri_download(d);
+}
+
+/*
+ * Wait for the downloads in the order the server listed them, so that the
+ * lockfiles are recorded in the same order as if they had been done one
+ * after another. Each download that ends lets the next one start.
+ */
+static void finish_packfile_uri_downloads(struct packfile_uri_downloads *d,
+					  struct string_list *pack_lockfiles,
+					  struct oidset *gitmodules_oids)
+{
+	int i;
+
+	for (i = 0; i < d->uris.nr; i++) {
+		struct child_process *cmd = &d->cmds[i];
+		char packname[GIT_MAX_HEXSZ + 1];
+		const char *uri = d->uris.items[i].string +
+			the_hash_algo->hexsz + 1;
+
+		if (read_in_full(cmd->out, packname, 5) < 0 ||
+		    memcmp(packname, "keep\t", 5))
+			die("fetch-pack: expected keep then TAB at start of http-fetch output");
+
+		if (read_in_full(cmd->out, packname,
+				 the_hash_algo->hexsz + 1) < 0 ||
+		    packname[the_hash_algo->hexsz] != '\n')
+			die("fetch-pack: expected hash then LF at end of http-fetch output");
+
+		packname[the_hash_algo->hexsz] = '\0';
+
+		parse_gitmodules_oids(cmd->out, gitmodules_oids);
+
+		close(cmd->out);
+
+		if (finish_command(cmd))
+			die("fetch-pack: unable to finish http-fetch");
+		if (d->started < d->uris.nr)
+			start_packfile_uri_download(d);
+
+		if (memcmp(d->uris.items[i].string, packname,
+			   the_hash_algo->hexsz))
+			die("fetch-pack: pack downloaded from %s does not match expected hash %.*s",
+			    uri, (int) the_hash_algo->hexsz,
+			    d->uris.items[i].string);
+
+		string_list_append_nodup(pack_lockfiles,
+					 xstrfmt("%s/pack/pack-%s.keep",
+						 repo_get_object_directory(the_repository),
+						 packname));
+	}
+}
+
+static void packfile_uri_downloads_clear(struct packfile_uri_downloads *d)
+{
+	string_list_clear(&d->uris, 0);
+	strvec_clear(&d->index_pack_args);
+	free(d->cmds);
+}
+
+static void start_sideband_demux(struct async *demux, int xd[2])
+{
+	if (use_sideband) {
+		/* xd[] is talking with upload-pack; subprocess reads from
+		 * xd[0], spits out band#2 to stderr, and feeds us band#1
+		 * through demux->out.
+		 */
+		demux->proc = sideband_demux;
+		demux->data = xd;
+		demux->out = -1;
+		demux->isolate_sigpipe = 1;
+		if (start_async(demux))
+			die(_("fetch-pack: unable to fork off sideband demultiplexer"));
+	}
+	else
+		demux->out = xd[0];
+}
+
+/*
+ * If packfile URIs were provided, pass them in "downloads". They are
+ * downloaded with the same index-pack arguments as the pack we receive,
+ * starting before that pack is received; the caller has to call
+ * finish_packfile_uri_downloads() afterwards.
  */
 static int get_pack(struct fetch_pack_args *args,
 		    int xd[2], struct string_list *pack_lockfiles,
-		    struct strvec *index_pack_args,
+		    struct packfile_uri_downloads *downloads,
 		    struct ref **sought, int nr_sought,
 		    struct oidset *gitmodules_oids)
 {
+	struct strvec *index_pack_args =
+		downloads ? &downloads->index_pack_args : NULL;
 	struct async demux;
 	int do_keep = args->keep_pack;
 	const char *cmd_name;
@@ -932,20 +1066,14 @@ static int get_pack(struct fetch_pack_args *args,
 	int ret;
 
 	memset(&demux, 0, sizeof(demux));
-	if (use_sideband) {
-		/* xd[] is talking with upload-pack; subprocess reads from
-		 * xd[0], spits out band#2 to stderr, and feeds us band#1
-		 * through demux->out.
-		 */
-		demux.proc = sideband_demux;
-		demux.data = xd;
-		demux.out = -1;
-		demux.isolate_sigpipe = 1;
-		if (start_async(&demux))
-			die(_("fetch-pack: unable to fork off sideband demultiplexer"));
-	}
-	else
-		demux.out = xd[0];
+	/*
+	 * With packfile URIs, the demultiplexer is only started once the
+	 * downloads are, so that the http-fetch processes do not inherit
+	 * the end of the pipe it writes to. Index-pack would otherwise not
+	 * see the end of the pack before all downloads are done.
+	 */
+	if (!downloads)
+		start_sideband_demux(&demux, xd);
 
 	if (!args->keep_pack && unpack_limit && !index_pack_args) {
 
@@ -1028,6 +1156,8 @@ static int get_pack(struct fetch_pack_args *args,
 
 		for (i = 0; i < cmd.args.nr; i++)
 			strvec_push(index_pack_args, cmd.args.v[i]);
+		start_packfile_uri_downloads(downloads);
+		start_sideband_demux(&demux, xd);
 	}
 
 	sigchain_push(SIGPIPE, SIG_IGN);
@@ -1319,6 +1449,33 @@ static int add_haves(struct fetch_negotiator *negotiator,
 	return haves_added;
 }
 
+static void add_bloom_haves(struct fetch_negotiator *negotiator,
+			    struct strbuf *req_buf)
+{
+	struct bloom_filter_settings settings = BLOOM_HAVES_FILTER_SETTINGS;
+	struct bloom_filter filter = { 0 };
+	struct strbuf hex = STRBUF_INIT;
+	size_t nr, i;
+
+	if (!negotiator->summarize ||
+	    !server_supports_feature("fetch", "bloom-haves", 0))
+		return;
+
+	nr = negotiator->summarize(negotiator, &filter, &settings);
+	if (!nr)
+		return;
+
+	for (i = 0; i < filter.len; i++)
+		strbuf_addf(&hex, "%02x", filter.data[i]);
+	packet_buf_write(req_buf, "bloom-haves %"PRIu32" %s\n",
+			 settings.num_hashes, hex.buf);
+	trace2_data_intmax("negotiation_v2", the_repository,
+			   "bloom_haves_summarized", nr);
+
+	strbuf_release(&hex);
+	free(filter.to_free);
+}
+
 static void write_fetch_command_and_capabilities(struct strbuf *req_buf,
 						 const struct string_list *server_options)
 {
@@ -1410,6 +1567,9 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 	/* Add all of the common commits we've found in previous rounds */
 	add_common(&req_buf, common);
 
+	/* Summarize our recent history, if both sides support it */
+	add_bloom_haves(negotiator, &req_buf);
+
 	haves_added = add_haves(negotiator, &req_buf, haves_to_send);
 	*in_vain += haves_added;
 	trace2_data_intmax("negotiation_v2", the_repository, "haves_added", haves_added);
@@ -1612,6 +1772,28 @@ static void receive_wanted_refs(struct packet_reader *reader,
 		die(_("error processing wanted refs: %d"), reader->status);
 }
 
+static void receive_bloom_candidates(struct fetch_negotiator *negotiator,
+				     struct packet_reader *reader)
+{
+	int nr = 0;
+
+	process_section_header(reader, "bloom-candidates", 0);
+	while (packet_reader_read(reader) == PACKET_READ_NORMAL) {
+		struct object_id oid;
+
+		if (get_oid_hex(reader->line, &oid))
+			die(_("expected bloom candidate, got '%s'"), reader->line);
+		if (negotiator->add_candidate)
+			negotiator->add_candidate(negotiator, &oid);
+		nr++;
+	}
+
+	if (reader->status != PACKET_READ_DELIM)
+		die(_("error processing bloom candidates: %d"), reader->status);
+	trace2_data_intmax("negotiation_v2", the_repository,
+			   "bloom_candidates", nr);
+}
+
 static void receive_packfile_uris(struct packet_reader *reader,
 				  struct string_list *uris)
 {
@@ -1663,9 +1845,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 	int seen_ack = 0;
 	struct object_id common_oid;
 	int received_ready = 0;
-	struct string_list packfile_uris = STRING_LIST_INIT_DUP;
-	int i;
-	struct strvec index_pack_args = STRVEC_INIT;
+	struct packfile_uri_downloads downloads = PACKFILE_URI_DOWNLOADS_INIT;
 
 	negotiator = &negotiator_alloc;
 	if (args->refetch)
@@ -1731,6 +1911,10 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 				state = FETCH_PROCESS_ACKS;
 			break;
 		case FETCH_PROCESS_ACKS:
+			/* Process suggestions made from our summary, if any */
+			if (process_section_header(&reader, "bloom-candidates", 1))
+				receive_bloom_candidates(negotiator, &reader);
+
 			/* Process ACKs/NAKs */
 			process_section_header(&reader, "acknowledgments", 0);
 			while (process_ack(negotiator, &reader, &common_oid,
@@ -1770,7 +1954,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			if (git_env_bool("GIT_TRACE_REDACT", 1))
 				reader.options |= PACKET_READ_REDACT_URI_PATH;
 			if (process_section_header(&reader, "packfile-uris", 1))
-				receive_packfile_uris(&reader, &packfile_uris);
+				receive_packfile_uris(&reader, &downloads.uris);
 			/* We don't expect more URIs. Reset to avoid expensive URI check. */
 			reader.options &= ~PACKET_READ_REDACT_URI_PATH;
 
@@ -1785,7 +1969,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			fd[1] = -1;
 
 			if (get_pack(args, fd, pack_lockfiles,
-				     packfile_uris.nr ? &index_pack_args : NULL,
+				     downloads.uris.nr ? &downloads : NULL,
 				     sought, nr_sought, &fsck_options.gitmodules_found))
 				die(_("git fetch-pack: fetch failed."));
 			do_check_stateless_delimiter(args->stateless_rpc, &reader);
@@ -1797,58 +1981,10 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 		}
 	}
 
-	for (i = 0; i < packfile_uris.nr; i++) {
-		int j;
-		struct child_process cmd = CHILD_PROCESS_INIT;
-		char packname[GIT_MAX_HEXSZ + 1];
-		const char *uri = packfile_uris.items[i].string +
-			the_hash_algo->hexsz + 1;
-
-		strvec_push(&cmd.args, "http-fetch");
-		strvec_pushf(&cmd.args, "--packfile=%.*s",
-			     (int) the_hash_algo->hexsz,
-			     packfile_uris.items[i].string);
-		for (j = 0; j < index_pack_args.nr; j++)
-			strvec_pushf(&cmd.args, "--index-pack-arg=%s",
-				     index_pack_args.v[j]);
-		strvec_push(&cmd.args, uri);
-		cmd.git_cmd = 1;
-		cmd.no_stdin = 1;
-		cmd.out = -1;
-		if (start_command(&cmd))
-			die("fetch-pack: unable to spawn http-fetch");
-
-		if (read_in_full(cmd.out, packname, 5) < 0 ||
-		    memcmp(packname, "keep\t", 5))
-			die("fetch-pack: expected keep then TAB at start of http-fetch output");
-
-		if (read_in_full(cmd.out, packname,
-				 the_hash_algo->hexsz + 1) < 0 ||
-		    packname[the_hash_algo->hexsz] != '\n')
-			die("fetch-pack: expected hash then LF at end of http-fetch output");
-
-		packname[the_hash_algo->hexsz] = '\0';
-
-		parse_gitmodules_oids(cmd.out, &fsck_options.gitmodules_found);
-
-		close(cmd.out);
-
-		if (finish_command(&cmd))
-			die("fetch-pack: unable to finish http-fetch");
-
-		if (memcmp(packfile_uris.items[i].string, packname,
-			   the_hash_algo->hexsz))
-			die("fetch-pack: pack downloaded from %s does not match expected hash %.*s",
-			    uri, (int) the_hash_algo->hexsz,
-			    packfile_uris.items[i].string);
-
-		string_list_append_nodup(pack_lockfiles,
-					 xstrfmt("%s/pack/pack-%s.keep",
-						 repo_get_object_directory(the_repository),
-						 packname));
-	}
-	string_list_clear(&packfile_uris, 0);
-	strvec_clear(&index_pack_args);
+	if (downloads.uris.nr)
+		finish_packfile_uri_downloads(&downloads, pack_lockfiles,
+					      &fsck_options.gitmodules_found);
+	packfile_uri_downloads_clear(&downloads);
 
 	if (fsck_finish(&fsck_options))
 		die("fsck failed");
@@ -1908,6 +2044,9 @@ static void fetch_pack_config(void)
 	git_config_get_bool("fetch.fsckobjects", &fetch_fsck_objects);
 	git_config_get_bool("transfer.fsckobjects", &transfer_fsck_objects);
 	git_config_get_bool("transfer.advertisesid", &advertise_sid);
+	if (!git_config_get_int("fetch.urijobs", &fetch_uri_jobs) &&
+	    fetch_uri_jobs < 1)
+		fetch_uri_jobs = online_cpus();
 	if (!uri_protocols.nr) {
 		char *str;
 
@@ -2062,6 +2201,12 @@ static const struct object_id *iterate_ref_map(void *cb_data)
 	return &ref->old_oid;
 }
 
+int fetch_pack_uri_jobs(void)
+{
+	fetch_pack_setup();
+	return fetch_uri_jobs;
+}
+
 int fetch_pack_fsck_objects(void)
 {
 	fetch_pack_setup();
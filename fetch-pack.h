@@ -106,6 +106,12 @@ int report_unmatched_refs(struct ref **sought, int nr_sought);
  */
 int fetch_pack_fsck_objects(void);
 
+/*
+ * Return how many packfile URIs or bundle URIs may be downloaded at the
+ * same time ("fetch.uriJobs").
+ */
+int fetch_pack_uri_jobs(void);
+
 /*
  * Check if the provided config variable pertains to fetch fsck and if so append
  * the configuration to the provided strbuf.
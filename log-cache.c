@@ -0,0 +1,249 @@
+#define DISABLE_SIGN_COMPARE_WARNINGS
+
+#include "git-compat-util.h"
+#include "log-cache.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "gettext.h"
+#include "hash.h"
+#include "hex.h"
+#include "lockfile.h"
+#include "object-file.h"
+#include "oid-array.h"
+#include "path.h"
+#include "pathspec.h"
+#include "repository.h"
+#include "revision.h"
+#include "trace2.h"
+
+#define LOG_CACHE_SIGNATURE "log-cache v1"
+
+struct log_cache {
+	struct repository *r;
+	char *path;
+
+	/* The tip of this walk, and the commits it showed so far. */
+	struct object_id new_tip;
+	struct oid_array shown;
+
+	/* The tip of the cached walk, and the commits it showed. */
+	struct object_id tip;
+	struct oid_array cached;
+
+	int replaying;
+	size_t replay_pos, replay_prefix;
+	int finished;
+};
+
+/*
+ * Whether the output of the walk prepared in `revs` only depends on its
+ * tip, the pathspec and the commit objects.
+ */
+static int log_cache_compatible(struct rev_info *revs)
+{
+	if (!revs->prune || !revs->dense || !revs->simplify_history ||
+	    revs->limited || revs->topo_order || revs->no_walk ||
+	    revs->reflog_info || revs->remove_empty_trees ||
+	    revs->show_pulls || revs->simplify_merges ||
+	    revs->simplify_by_decoration || revs->unpacked ||
+	    revs->no_kept_objects || revs->boundary ||
+	    revs->rewrite_parents || revs->children.name ||
+	    revs->first_parent_only || revs->line_level_traverse ||
+	    revs->track_linear || revs->ignore_missing_links ||
+	    revs->exclude_promisor_objects || revs->include_check)
+		return 0;
+	if (revs->max_age != -1 || revs->min_age != -1 ||
+	    revs->max_age_as_filter != -1 ||
+	    revs->min_parents || revs->max_parents >= 0)
+		return 0;
+	if (revs->grep_filter.pattern_list || revs->grep_filter.header_list)
+		return 0;
+	if (revs->prune_data.magic & PATHSPEC_ATTR)
+		return 0;
+
+	/* A single tip, without negative revisions. */
+	if (!revs->commits || revs->commits->next ||
+	    revs->commits->item->object.flags & UNINTERESTING)
+		return 0;
+
+	return commit_graph_compatible(revs->repo);
+}
+
+static char *log_cache_path(struct rev_info *revs)
+{
+	const struct git_hash_algo *algop = revs->repo->hash_algo;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct strbuf key = STRBUF_INIT;
+	git_hash_ctx ctx;
+	int i;
+
+	for (i = 0; i < revs->prune_data.nr; i++) {
+		const struct pathspec_item *item = &revs->prune_data.items[i];
+
+		strbuf_addf(&key, "%u:", item->magic);
+		strbuf_add(&key, item->match, item->len);
+		strbuf_addch(&key, '\0');
+	}
+
+	algop->init_fn(&ctx);
+	algop->update_fn(&ctx, key.buf, key.len);
+	algop->final_fn(hash, &ctx);
+	strbuf_release(&key);
+
+	return repo_git_path(revs->repo, "log-cache/%s",
+			     hash_to_hex_algop(hash, algop));
+}
+
+static void read_log_cache(struct log_cache *lc)
+{
+	const struct git_hash_algo *algop = lc->r->hash_algo;
+	struct strbuf line = STRBUF_INIT;
+	struct object_id oid;
+	const char *end;
+	FILE *fp;
+
+	fp = fopen(lc->path, "r");
+	if (!fp)
+		return;
+
+	if (strbuf_getline(&line, fp) ||
+	    strcmp(line.buf, LOG_CACHE_SIGNATURE) ||
+	    strbuf_getline(&line, fp) ||
+	    parse_oid_hex_algop(line.buf, &lc->tip, &end, algop) || *end)
+		goto invalid;
+	while (!strbuf_getline(&line, fp)) {
+		if (parse_oid_hex_algop(line.buf, &oid, &end, algop) || *end)
+			goto invalid;
+		oid_array_append(&lc->cached, &oid);
+	}
+	goto out;
+
+invalid:
+	oidclr(&lc->tip, algop);
+	oid_array_clear(&lc->cached);
+out:
+	fclose(fp);
+	strbuf_release(&line);
+}
+
+struct log_cache *prepare_log_cache(struct rev_info *revs)
+{
+	struct log_cache *lc;
+
+	if (!log_cache_compatible(revs))
+		return NULL;
+
+	CALLOC_ARRAY(lc, 1);
+	lc->r = revs->repo;
+	lc->path = log_cache_path(revs);
+	oidcpy(&lc->new_tip, &revs->commits->item->object.oid);
+	read_log_cache(lc);
+	return lc;
+}
+
+/*
+ * Whether this walk already went through some of the cached commits
+ * below the tip, e.g. via another parent of a merge with a commit date
+ * that is out of order. Replaying would show them a second time.
+ */
+static int log_cache_overlaps_walk(struct log_cache *lc)
+{
+	size_t i;
+
+	for (i = 0; i < lc->cached.nr; i++) {
+		const struct object_id *oid = &lc->cached.oid[i];
+		struct object *o;
+
+		if (oideq(oid, &lc->tip))
+			continue;
+		o = lookup_object(lc->r, oid);
+		if (o && (o->flags & (SEEN | SHOWN)))
+			return 1;
+	}
+	return 0;
+}
+
+int log_cache_start_replay(struct log_cache *lc, struct commit *c,
+			   int queue_empty)
+{
+	if (lc->replaying || !queue_empty || is_null_oid(&lc->tip) ||
+	    !oideq(&c->object.oid, &lc->tip))
+		return 0;
+	if (log_cache_overlaps_walk(lc)) {
+		trace2_data_string("log-cache", lc->r, "overlap",
+				   oid_to_hex(&lc->tip));
+		return 0;
+	}
+
+	lc->replaying = 1;
+	lc->replay_prefix = lc->shown.nr;
+	trace2_data_intmax("log-cache", lc->r, "replayed", lc->cached.nr);
+	return 1;
+}
+
+struct commit *log_cache_next(struct log_cache *lc)
+{
+	const struct object_id *oid;
+	struct commit *c;
+
+	if (!lc->replaying || lc->replay_pos >= lc->cached.nr)
+		return NULL;
+
+	oid = &lc->cached.oid[lc->replay_pos++];
+	c = lookup_commit(lc->r, oid);
+	if (!c || repo_parse_commit(lc->r, c))
+		die(_("unable to parse commit %s from the log cache"),
+		    oid_to_hex(oid));
+	oid_array_append(&lc->shown, oid);
+	return c;
+}
+
+void log_cache_add(struct log_cache *lc, struct commit *c)
+{
+	oid_array_append(&lc->shown, &c->object.oid);
+}
+
+void log_cache_finish(struct log_cache *lc)
+{
+	struct lock_file lk = LOCK_INIT;
+	FILE *fp;
+	size_t i;
+
+	if (lc->finished)
+		return;
+	lc->finished = 1;
+
+	/* Nothing new if the cached walk was replayed from its tip. */
+	if (lc->replaying && !lc->replay_prefix &&
+	    oideq(&lc->tip, &lc->new_tip))
+		return;
+
+	/*
+	 * The cache is only an optimization, so do not complain if it
+	 * cannot be written, e.g. in a read-only repository.
+	 */
+	if (safe_create_leading_directories(lc->path) != SCLD_OK ||
+	    hold_lock_file_for_update(&lk, lc->path, 0) < 0)
+		return;
+	fp = fdopen_lock_file(&lk, "w");
+	if (!fp) {
+		rollback_lock_file(&lk);
+		return;
+	}
+	fprintf(fp, "%s\n%s\n", LOG_CACHE_SIGNATURE, oid_to_hex(&lc->new_tip));
+	for (i = 0; i < lc->shown.nr; i++)
+		fprintf(fp, "%s\n", oid_to_hex(&lc->shown.oid[i]));
+	if (commit_lock_file(&lk))
+		return;
+	trace2_data_intmax("log-cache", lc->r, "written", lc->shown.nr);
+}
+
+void free_log_cache(struct log_cache *lc)
+{
+	if (!lc)
+		return;
+	free(lc->path);
+	oid_array_clear(&lc->shown);
+	oid_array_clear(&lc->cached);
+	free(lc);
+}
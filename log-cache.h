@@ -0,0 +1,54 @@
+#ifndef LOG_CACHE_H
+#define LOG_CACHE_H
+
+struct commit;
+struct log_cache;
+struct rev_info;
+
+/*
+ * The log cache remembers, for a pathspec, the commits a default
+ * "git log -- <pathspec>" from a single tip showed, in
+ * "$GIT_DIR/log-cache". When the same pathspec is walked again from that
+ * tip, or from a descendant reaching it as the only commit left to walk
+ * (e.g. after new commits on a branch without merges), the walk stops
+ * there and the rest of its output is replayed from the cache, which is
+ * then updated for the new tip.
+ *
+ * It is only used for walks whose output only depends on the commit
+ * objects and the pathspec, i.e. without options which limit, reorder
+ * or rewrite the history, and only where the commit-graph could be used
+ * (no replace refs, grafts or shallow history), since those change the
+ * parents of commits.
+ */
+
+/*
+ * Return a cache for the walk `revs` is prepared for, or NULL if the
+ * walk cannot use one. Called by prepare_revision_walk() when
+ * `revs->use_log_cache` is set.
+ */
+struct log_cache *prepare_log_cache(struct rev_info *revs);
+
+/*
+ * Called with each commit `c` popped from the walk queue. Return 1 if
+ * the cached output from `c` is valid for the rest of the walk, i.e. if
+ * `c` is the cached tip and the queue is otherwise empty, in which case
+ * the caller should get the rest of its output from log_cache_next().
+ */
+int log_cache_start_replay(struct log_cache *lc, struct commit *c,
+			   int queue_empty);
+
+/*
+ * Return the next commit of the replayed output, or NULL if the cache is
+ * not being replayed or is exhausted.
+ */
+struct commit *log_cache_next(struct log_cache *lc);
+
+/* Record that the walk showed `c`. */
+void log_cache_add(struct log_cache *lc, struct commit *c);
+
+/* Called when the walk is complete, to update the cache. */
+void log_cache_finish(struct log_cache *lc);
+
+void free_log_cache(struct log_cache *lc);
+
+#endif /* LOG_CACHE_H */
@@ -403,6 +403,38 @@ static void normalize_file(mmfile_t *mm, const char *path, struct index_state *i
 	}
 }
 
+static const struct ll_merge_driver *find_merge_driver(struct index_state *istate,
+							const char *path,
+							const struct ll_merge_options *opts,
+							int *marker_size)
+{
+	struct attr_check *check = load_merge_attributes();
+	const char *ll_driver_name = NULL;
+	const struct ll_merge_driver *driver;
+
+	git_check_attr(istate, path, check);
+	ll_driver_name = check->items[0].value;
+	*marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
+	if (check->items[1].value) {
+		if (strtol_i(check->items[1].value, 10, marker_size)) {
+			*marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
+			warning(_("invalid marker-size '%s', expecting an integer"), check->items[1].value);
+		}
+		if (*marker_size <= 0)
+			*marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
+	}
+	driver = find_ll_merge_driver(ll_driver_name);
+
+	if (opts->virtual_ancestor) {
+		if (driver->recursive)
+			driver = find_ll_merge_driver(driver->recursive);
+	}
+	if (opts->extra_marker_size) {
+		*marker_size += opts->extra_marker_size;
+	}
+	return driver;
+}
+
 enum ll_merge_result ll_merge(mmbuffer_t *result_buf,
 	     const char *path,
 	     mmfile_t *ancestor, const char *ancestor_label,
@@ -411,10 +443,8 @@ enum ll_merge_result ll_merge(mmbuffer_t *result_buf,
 	     struct index_state *istate,
 	     const struct ll_merge_options *opts)
 {
-	struct attr_check *check = load_merge_attributes();
 	static const struct ll_merge_options default_opts = LL_MERGE_OPTIONS_INIT;
-	const char *ll_driver_name = NULL;
-	int marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
+	int marker_size;
 	const struct ll_merge_driver *driver;
 
 	if (!opts)
@@ -426,25 +456,36 @@ enum ll_merge_result ll_merge(mmbuffer_t *result_buf,
 		normalize_file(theirs, path, istate);
 	}
 
-	git_check_attr(istate, path, check);
-	ll_driver_name = check->items[0].value;
-	if (check->items[1].value) {
-		if (strtol_i(check->items[1].value, 10, &marker_size)) {
-			marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
-			warning(_("invalid marker-size '%s', expecting an integer"), check->items[1].value);
-		}
-		if (marker_size <= 0)
-			marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
-	}
-	driver = find_ll_merge_driver(ll_driver_name);
+	driver = find_merge_driver(istate, path, opts, &marker_size);
+	return driver->fn(driver, result_buf, path, ancestor, ancestor_label,
+			  ours, our_label, theirs, their_label,
+			  opts, marker_size);
+}
 
-	if (opts->virtual_ancestor) {
-		if (driver->recursive)
-			driver = find_ll_merge_driver(driver->recursive);
-	}
-	if (opts->extra_marker_size) {
-		marker_size += opts->extra_marker_size;
-	}
+const struct ll_merge_driver *ll_merge_builtin_driver(struct index_state *istate,
+						      const char *path,
+						      const struct ll_merge_options *opts,
+						      int *marker_size)
+{
+	const struct ll_merge_driver *driver;
+
+	if (opts->renormalize)
+		return NULL;
+	driver = find_merge_driver(istate, path, opts, marker_size);
+	if (driver->fn == ll_ext_merge)
+		return NULL;
+	return driver;
+}
+
+enum ll_merge_result ll_merge_with_driver(const struct ll_merge_driver *driver,
+					  int marker_size,
+					  mmbuffer_t *result_buf,
+					  const char *path,
+					  mmfile_t *ancestor, const char *ancestor_label,
+					  mmfile_t *ours, const char *our_label,
+					  mmfile_t *theirs, const char *their_label,
+					  const struct ll_merge_options *opts)
+{
 	return driver->fn(driver, result_buf, path, ancestor, ancestor_label,
 			  ours, our_label, theirs, their_label,
 			  opts, marker_size);
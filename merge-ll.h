@@ -108,6 +108,29 @@ enum ll_merge_result ll_merge(mmbuffer_t *result_buf,
 	     struct index_state *istate,
 	     const struct ll_merge_options *opts);
 
+/**
+ * Look up the merge driver and conflict marker size that `ll_merge()`
+ * would use for `path`, without merging anything.  Returns NULL unless
+ * the driver is one of the built-in ones and no renormalization is
+ * requested; only in that case can the merge itself be performed later
+ * by `ll_merge_with_driver()`, which neither consults the attributes nor
+ * runs external commands and is therefore safe to call from a worker
+ * thread.
+ */
+struct ll_merge_driver;
+const struct ll_merge_driver *ll_merge_builtin_driver(struct index_state *istate,
+						      const char *path,
+						      const struct ll_merge_options *opts,
+						      int *marker_size);
+enum ll_merge_result ll_merge_with_driver(const struct ll_merge_driver *driver,
+					  int marker_size,
+					  mmbuffer_t *result_buf,
+					  const char *path,
+					  mmfile_t *ancestor, const char *ancestor_label,
+					  mmfile_t *ours, const char *our_label,
+					  mmfile_t *theirs, const char *their_label,
+					  const struct ll_merge_options *opts);
+
 int ll_merge_marker_size(struct index_state *istate, const char *path);
 void reset_merge_attributes(void);
 
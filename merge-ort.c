@@ -46,6 +46,7 @@
 #include "revision.h"
 #include "sparse-index.h"
 #include "strmap.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "unpack-trees.h"
@@ -401,6 +402,13 @@ struct merge_options_internal {
 	/* call_depth: recursion level counter for merging merge bases */
 	int call_depth;
 
+	/*
+	 * content_merges: three-way content merges already performed by
+	 * worker threads, for process_entry() to pick up in path order;
+	 * only non-NULL during process_entries().
+	 */
+	struct content_merge_batch *content_merges;
+
 	/* field that holds submodule conflict information */
 	struct string_list conflicted_submodules;
 };
@@ -2046,55 +2054,141 @@ static void initialize_attr_index(struct merge_options *opt)
 	}
 }
 
-static int merge_3way(struct merge_options *opt,
-		      const char *path,
-		      const struct object_id *o,
-		      const struct object_id *a,
-		      const struct object_id *b,
-		      const char *pathnames[3],
-		      const int extra_marker_size,
-		      mmbuffer_t *result_buf)
-{
-	mmfile_t orig, src1, src2;
-	struct ll_merge_options ll_opts = LL_MERGE_OPTIONS_INIT;
+/*
+ * A three-way content merge that process_entries() determined it will
+ * need, so that the blobs can be read and the attributes consulted up
+ * front, and the merge itself can be run in a worker thread.  Nothing
+ * visible to the user (writing the result, conflict messages) happens
+ * until process_entry() consumes the job, so the output does not depend
+ * on the order in which the threads finish.
+ */
+struct content_merge_job {
+	const char *path;
+	const struct conflict_info *ci;
+	const char *pathnames[3];
+	struct object_id o, a, b;
+
+	/* NULL if the merge must be performed by merge_3way() itself */
+	const struct ll_merge_driver *driver;
+	int marker_size;
+
 	char *base, *name1, *name2;
-	enum ll_merge_result merge_status;
+	mmfile_t orig, src1, src2;
+	mmbuffer_t result;
+	enum ll_merge_result status;
+};
 
-	if (!opt->priv->attr_index.initialized)
-		initialize_attr_index(opt);
+struct content_merge_batch {
+	struct content_merge_job *jobs;
+	size_t nr, alloc;
+	size_t consumed; /* jobs[0..consumed) were handed to process_entry() */
+	size_t done; /* jobs[0..done) have been merged */
+	int nr_threads;
+	struct ll_merge_options ll_opts;
+};
 
-	ll_opts.renormalize = opt->renormalize;
-	ll_opts.extra_marker_size = extra_marker_size;
-	ll_opts.xdl_opts = opt->xdl_opts;
-	ll_opts.conflict_style = opt->conflict_style;
+static void setup_ll_merge_options(struct merge_options *opt,
+				   const int extra_marker_size,
+				   struct ll_merge_options *ll_opts)
+{
+	ll_opts->renormalize = opt->renormalize;
+	ll_opts->extra_marker_size = extra_marker_size;
+	ll_opts->xdl_opts = opt->xdl_opts;
+	ll_opts->conflict_style = opt->conflict_style;
 
 	if (opt->priv->call_depth) {
-		ll_opts.virtual_ancestor = 1;
-		ll_opts.variant = 0;
+		ll_opts->virtual_ancestor = 1;
+		ll_opts->variant = 0;
 	} else {
 		switch (opt->recursive_variant) {
 		case MERGE_VARIANT_OURS:
-			ll_opts.variant = XDL_MERGE_FAVOR_OURS;
+			ll_opts->variant = XDL_MERGE_FAVOR_OURS;
 			break;
 		case MERGE_VARIANT_THEIRS:
-			ll_opts.variant = XDL_MERGE_FAVOR_THEIRS;
+			ll_opts->variant = XDL_MERGE_FAVOR_THEIRS;
 			break;
 		default:
-			ll_opts.variant = 0;
+			ll_opts->variant = 0;
 			break;
 		}
 	}
+}
 
+static void get_merge_labels(struct merge_options *opt,
+			     const char *pathnames[3],
+			     char **base, char **name1, char **name2)
+{
 	assert(pathnames[0] && pathnames[1] && pathnames[2] && opt->ancestor);
 	if (pathnames[0] == pathnames[1] && pathnames[1] == pathnames[2]) {
-		base  = mkpathdup("%s", opt->ancestor);
-		name1 = mkpathdup("%s", opt->branch1);
-		name2 = mkpathdup("%s", opt->branch2);
+		*base  = mkpathdup("%s", opt->ancestor);
+		*name1 = mkpathdup("%s", opt->branch1);
+		*name2 = mkpathdup("%s", opt->branch2);
 	} else {
-		base  = mkpathdup("%s:%s", opt->ancestor, pathnames[0]);
-		name1 = mkpathdup("%s:%s", opt->branch1,  pathnames[1]);
-		name2 = mkpathdup("%s:%s", opt->branch2,  pathnames[2]);
+		*base  = mkpathdup("%s:%s", opt->ancestor, pathnames[0]);
+		*name1 = mkpathdup("%s:%s", opt->branch1,  pathnames[1]);
+		*name2 = mkpathdup("%s:%s", opt->branch2,  pathnames[2]);
 	}
+}
+
+static struct content_merge_job *find_content_merge_job(struct merge_options *opt,
+							 const char *path,
+							 const struct object_id *o,
+							 const struct object_id *a,
+							 const struct object_id *b,
+							 const char *pathnames[3],
+							 const int extra_marker_size)
+{
+	struct content_merge_batch *batch = opt->priv->content_merges;
+	struct content_merge_job *job;
+
+	if (!batch || batch->consumed >= batch->done)
+		return NULL;
+	job = &batch->jobs[batch->consumed];
+	if (!job->driver ||
+	    extra_marker_size != batch->ll_opts.extra_marker_size ||
+	    strcmp(job->path, path) ||
+	    !oideq(&job->o, o) || !oideq(&job->a, a) || !oideq(&job->b, b) ||
+	    job->pathnames[0] != pathnames[0] ||
+	    job->pathnames[1] != pathnames[1] ||
+	    job->pathnames[2] != pathnames[2])
+		return NULL;
+	return job;
+}
+
+static int merge_3way(struct merge_options *opt,
+		      const char *path,
+		      const struct object_id *o,
+		      const struct object_id *a,
+		      const struct object_id *b,
+		      const char *pathnames[3],
+		      const int extra_marker_size,
+		      mmbuffer_t *result_buf)
+{
+	mmfile_t orig, src1, src2;
+	struct ll_merge_options ll_opts = LL_MERGE_OPTIONS_INIT;
+	struct content_merge_job *job;
+	char *base, *name1, *name2;
+	enum ll_merge_result merge_status;
+
+	job = find_content_merge_job(opt, path, o, a, b, pathnames,
+				     extra_marker_size);
+	if (job) {
+		*result_buf = job->result;
+		job->result.ptr = NULL;
+		merge_status = job->status;
+		if (merge_status == LL_MERGE_BINARY_CONFLICT)
+			path_msg(opt, CONFLICT_BINARY, 0,
+				 path, NULL, NULL, NULL,
+				 "warning: Cannot merge binary files: %s (%s vs. %s)",
+				 path, job->name1, job->name2);
+		return merge_status;
+	}
+
+	if (!opt->priv->attr_index.initialized)
+		initialize_attr_index(opt);
+
+	setup_ll_merge_options(opt, extra_marker_size, &ll_opts);
+	get_merge_labels(opt, pathnames, &base, &name1, &name2);
 
 	read_mmblob(&orig, o);
 	read_mmblob(&src1, a);
@@ -3346,6 +3440,8 @@ static int detect_regular_renames(struct merge_options *opt,
 	if (opt->rename_limit <= 0)
 		diff_opts.rename_limit = 7000;
 	diff_opts.rename_score = opt->rename_score;
+	diff_opts.rename_cache = opt->rename_cache;
+	diff_opts.rename_score_cache = opt->rename_score_cache;
 	diff_opts.show_rename_progress = opt->show_rename_progress;
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
 	diff_setup_done(&diff_opts);
@@ -4370,6 +4466,191 @@ static void prefetch_for_content_merges(struct merge_options *opt,
 	oid_array_clear(&to_fetch);
 }
 
+/*
+ * Number of content merges each thread is handed at a time; this bounds
+ * how many blobs and merge results are held in memory at once.
+ */
+#define CONTENT_MERGES_PER_THREAD 16
+
+static void collect_content_merges(struct string_list *plist,
+				   struct content_merge_batch *batch)
+{
+	struct string_list_item *e;
+
+	/* Same order in which process_entries() will visit the entries */
+	for (e = &plist->items[plist->nr-1]; e >= plist->items; --e) {
+		struct conflict_info *ci = e->util;
+		struct version_info *o = &ci->stages[0];
+		struct version_info *a = &ci->stages[1];
+		struct version_info *b = &ci->stages[2];
+		struct content_merge_job *job;
+
+		if (ci->merged.clean)
+			continue;
+
+		/*
+		 * Only the entries for which process_entry() will end up
+		 * calling merge_3way(); see handle_content_merge().
+		 */
+		if (ci->match_mask || ci->filemask < 6 ||
+		    !S_ISREG(a->mode) || !S_ISREG(b->mode) ||
+		    oideq(&a->oid, &b->oid) ||
+		    oideq(&a->oid, &o->oid) || oideq(&b->oid, &o->oid))
+			continue;
+
+		ALLOC_GROW(batch->jobs, batch->nr + 1, batch->alloc);
+		job = &batch->jobs[batch->nr++];
+		memset(job, 0, sizeof(*job));
+		job->path = e->string;
+		job->ci = ci;
+		memcpy(job->pathnames, ci->pathnames, sizeof(job->pathnames));
+		if ((S_IFMT & o->mode) != (S_IFMT & a->mode))
+			oidcpy(&job->o, null_oid());
+		else
+			oidcpy(&job->o, &o->oid);
+		oidcpy(&job->a, &a->oid);
+		oidcpy(&job->b, &b->oid);
+	}
+}
+
+struct content_merge_thread_data {
+	pthread_t pthread;
+	struct content_merge_batch *batch;
+	size_t offset, end;
+};
+
+static void *run_content_merges_thread(void *_data)
+{
+	struct content_merge_thread_data *p = _data;
+	struct content_merge_batch *batch = p->batch;
+	size_t i;
+
+	for (i = p->offset; i < p->end; i += batch->nr_threads) {
+		struct content_merge_job *job = &batch->jobs[i];
+
+		if (!job->driver)
+			continue;
+		job->status = ll_merge_with_driver(job->driver, job->marker_size,
+						   &job->result, job->path,
+						   &job->orig, job->base,
+						   &job->src1, job->name1,
+						   &job->src2, job->name2,
+						   &batch->ll_opts);
+	}
+	return NULL;
+}
+
+static void run_content_merges(struct merge_options *opt,
+			       struct content_merge_batch *batch)
+{
+	struct content_merge_thread_data *data;
+	size_t i, end;
+	int t;
+
+	end = st_add(batch->done,
+		     st_mult(batch->nr_threads, CONTENT_MERGES_PER_THREAD));
+	if (end > batch->nr)
+		end = batch->nr;
+
+	/*
+	 * Reading objects and looking up attributes is not thread-safe,
+	 * so do both here; the workers only run the merge driver.
+	 */
+	if (!opt->priv->attr_index.initialized)
+		initialize_attr_index(opt);
+	for (i = batch->done; i < end; i++) {
+		struct content_merge_job *job = &batch->jobs[i];
+
+		job->driver = ll_merge_builtin_driver(&opt->priv->attr_index,
+						      job->path, &batch->ll_opts,
+						      &job->marker_size);
+		if (!job->driver)
+			continue;
+		get_merge_labels(opt, job->pathnames,
+				 &job->base, &job->name1, &job->name2);
+		read_mmblob(&job->orig, &job->o);
+		read_mmblob(&job->src1, &job->a);
+		read_mmblob(&job->src2, &job->b);
+	}
+
+	trace2_region_enter("merge", "content merges", opt->repo);
+	CALLOC_ARRAY(data, batch->nr_threads);
+	for (t = 0; t < batch->nr_threads; t++) {
+		struct content_merge_thread_data *p = &data[t];
+		int err;
+
+		p->batch = batch;
+		p->offset = batch->done + t;
+		p->end = end;
+		err = pthread_create(&p->pthread, NULL,
+				     run_content_merges_thread, p);
+		if (err)
+			die(_("unable to create content merge thread: %s"),
+			    strerror(err));
+	}
+	for (t = 0; t < batch->nr_threads; t++) {
+		if (pthread_join(data[t].pthread, NULL))
+			die("unable to join content merge thread");
+	}
+	free(data);
+	trace2_data_intmax("merge", opt->repo, "content merges",
+			   end - batch->done);
+	trace2_region_leave("merge", "content merges", opt->repo);
+
+	for (i = batch->done; i < end; i++) {
+		struct content_merge_job *job = &batch->jobs[i];
+
+		FREE_AND_NULL(job->orig.ptr);
+		FREE_AND_NULL(job->src1.ptr);
+		FREE_AND_NULL(job->src2.ptr);
+	}
+	batch->done = end;
+}
+
+static void release_content_merge_job(struct content_merge_job *job)
+{
+	free(job->base);
+	free(job->name1);
+	free(job->name2);
+	free(job->orig.ptr);
+	free(job->src1.ptr);
+	free(job->src2.ptr);
+	free(job->result.ptr);
+}
+
+static void init_content_merges(struct merge_options *opt,
+				struct string_list *plist,
+				struct content_merge_batch *batch)
+{
+	struct ll_merge_options ll_opts = LL_MERGE_OPTIONS_INIT;
+
+	memset(batch, 0, sizeof(*batch));
+	batch->nr_threads = opt->threads ? opt->threads : online_cpus();
+	if (!HAVE_THREADS || opt->renormalize || batch->nr_threads < 2)
+		return;
+
+	collect_content_merges(plist, batch);
+	if (batch->nr < 2)
+		return;
+	if (batch->nr_threads > batch->nr)
+		batch->nr_threads = batch->nr;
+
+	setup_ll_merge_options(opt, opt->priv->call_depth * 2, &ll_opts);
+	batch->ll_opts = ll_opts;
+	opt->priv->content_merges = batch;
+}
+
+static void clear_content_merges(struct merge_options *opt,
+				 struct content_merge_batch *batch)
+{
+	size_t i;
+
+	for (i = batch->consumed; i < batch->nr; i++)
+		release_content_merge_job(&batch->jobs[i]);
+	free(batch->jobs);
+	opt->priv->content_merges = NULL;
+}
+
 static int process_entries(struct merge_options *opt,
 			   struct object_id *result_oid)
 {
@@ -4380,6 +4661,7 @@ static int process_entries(struct merge_options *opt,
 	struct directory_versions dir_metadata = { STRING_LIST_INIT_NODUP,
 						   STRING_LIST_INIT_NODUP,
 						   NULL, 0 };
+	struct content_merge_batch content_merges = { 0 };
 	int ret = 0;
 
 	trace2_region_enter("merge", "process_entries setup", opt->repo);
@@ -4418,6 +4700,7 @@ static int process_entries(struct merge_options *opt,
 	 */
 	trace2_region_enter("merge", "processing", opt->repo);
 	prefetch_for_content_merges(opt, &plist);
+	init_content_merges(opt, &plist, &content_merges);
 	for (entry = &plist.items[plist.nr-1]; entry >= plist.items; --entry) {
 		char *path = entry->string;
 		/*
@@ -4436,10 +4719,23 @@ static int process_entries(struct merge_options *opt,
 			record_entry_for_tree(&dir_metadata, path, mi);
 		else {
 			struct conflict_info *ci = (struct conflict_info *)mi;
+			struct content_merge_job *job = NULL;
+
+			if (opt->priv->content_merges &&
+			    content_merges.consumed < content_merges.nr &&
+			    content_merges.jobs[content_merges.consumed].ci == ci) {
+				if (content_merges.consumed == content_merges.done)
+					run_content_merges(opt, &content_merges);
+				job = &content_merges.jobs[content_merges.consumed];
+			}
 			if (process_entry(opt, path, ci, &dir_metadata) < 0) {
 				ret = -1;
 				goto cleanup;
 			};
+			if (job) {
+				release_content_merge_job(job);
+				content_merges.consumed++;
+			}
 		}
 	}
 	trace2_region_leave("merge", "processing", opt->repo);
@@ -4458,6 +4754,7 @@ static int process_entries(struct merge_options *opt,
 		       opt->repo->hash_algo->rawsz) < 0)
 		ret = -1;
 cleanup:
+	clear_content_merges(opt, &content_merges);
 	string_list_clear(&plist, 0);
 	string_list_clear(&dir_metadata.versions, 0);
 	string_list_clear(&dir_metadata.offsets, 0);
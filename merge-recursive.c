@@ -3929,8 +3929,13 @@ static void merge_recursive_config(struct merge_options *opt, int ui)
 	git_config_get_int("merge.verbosity", &opt->verbosity);
 	git_config_get_int("diff.renamelimit", &opt->rename_limit);
 	git_config_get_int("merge.renamelimit", &opt->rename_limit);
+	git_config_get_bool("diff.renamecache", &opt->rename_cache);
 	git_config_get_bool("merge.renormalize", &renormalize);
 	opt->renormalize = renormalize;
+	if (!git_config_get_int("merge.threads", &opt->threads) &&
+	    opt->threads < 0)
+		die(_("invalid number of threads specified (%d) for %s"),
+		    opt->threads, "merge.threads");
 	if (!git_config_get_string("diff.renames", &value)) {
 		opt->detect_renames = git_config_rename("diff.renames", value);
 		free(value);
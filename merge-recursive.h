@@ -6,6 +6,7 @@
 struct commit;
 struct commit_list;
 struct object_id;
+struct rename_score_cache;
 struct repository;
 struct tree;
 
@@ -27,6 +28,8 @@ struct merge_options {
 	} detect_directory_renames;
 	int rename_limit;
 	int rename_score;
+	int rename_cache;
+	struct rename_score_cache *rename_score_cache;
 	int show_rename_progress;
 
 	/* xdiff-related options (patience, ignore whitespace, ours/theirs) */
@@ -49,6 +52,7 @@ struct merge_options {
 	unsigned renormalize : 1;
 	unsigned record_conflict_msgs_as_headers : 1;
 	const char *msg_header_prefix;
+	int threads; /* for content merges; 0 means one per CPU */
 
 	/* internal fields used by the implementation */
 	struct merge_options_internal *priv;
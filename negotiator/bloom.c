@@ -0,0 +1,183 @@
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "git-compat-util.h"
+#include "bloom.h"
+#include "default.h"
+#include "../bloom.h"
+#include "../commit.h"
+#include "../fetch-negotiator.h"
+#include "../oidset.h"
+#include "../prio-queue.h"
+#include "../repository.h"
+
+/*
+ * How many of the most recent commits reachable from the tips are
+ * summarized for the server. At the default of 10 bits per entry, the
+ * hex-encoded filter still fits into a single pkt-line.
+ */
+#define MAX_SUMMARIZED_COMMITS 8192
+
+/*
+ * This negotiator sends the same "have" lines as the "consecutive" one,
+ * but it lets the server point out the commits it has among the most
+ * recent ones we summarized, and sends those first.
+ */
+struct bloom_negotiator {
+	struct fetch_negotiator consecutive;
+
+	struct commit_list *tips;
+	struct oidset summarized;
+	unsigned summary_sent : 1;
+
+	struct commit **candidates;
+	size_t candidates_nr, candidates_alloc, candidates_pos;
+
+	/*
+	 * Every "have" we sent or queued as a candidate. The consecutive
+	 * negotiator does not know about the candidates, and would send
+	 * them again once its walk gets to them.
+	 */
+	struct oidset haves;
+};
+
+static void known_common(struct fetch_negotiator *n, struct commit *c)
+{
+	struct bloom_negotiator *bn = n->data;
+	bn->consecutive.known_common(&bn->consecutive, c);
+}
+
+static void add_tip(struct fetch_negotiator *n, struct commit *c)
+{
+	struct bloom_negotiator *bn = n->data;
+
+	n->known_common = NULL;
+	commit_list_insert(c, &bn->tips);
+	bn->consecutive.add_tip(&bn->consecutive, c);
+}
+
+static const struct object_id *next(struct fetch_negotiator *n)
+{
+	struct bloom_negotiator *bn = n->data;
+	const struct object_id *oid;
+
+	n->known_common = NULL;
+	n->add_tip = NULL;
+	if (bn->candidates_pos < bn->candidates_nr)
+		return &bn->candidates[bn->candidates_pos++]->object.oid;
+	while ((oid = bn->consecutive.next(&bn->consecutive)) &&
+	       oidset_insert(&bn->haves, oid))
+		; /* already sent as a candidate */
+	return oid;
+}
+
+static int ack(struct fetch_negotiator *n, struct commit *c)
+{
+	struct bloom_negotiator *bn = n->data;
+	return bn->consecutive.ack(&bn->consecutive, c);
+}
+
+static size_t summarize(struct fetch_negotiator *n, struct bloom_filter *filter,
+			const struct bloom_filter_settings *settings)
+{
+	struct bloom_negotiator *bn = n->data;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct oidset queued = OIDSET_INIT;
+	struct commit_list *p;
+	struct commit *c;
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	size_t nr;
+
+	if (bn->summary_sent)
+		return 0;
+	bn->summary_sent = 1;
+
+	for (p = bn->tips; p; p = p->next)
+		if (!oidset_insert(&queued, &p->item->object.oid))
+			prio_queue_put(&queue, p->item);
+
+	while ((c = prio_queue_get(&queue)) &&
+	       oidset_size(&bn->summarized) < MAX_SUMMARIZED_COMMITS) {
+		oidset_insert(&bn->summarized, &c->object.oid);
+		if (repo_parse_commit(the_repository, c))
+			continue;
+		for (p = c->parents; p; p = p->next)
+			if (!oidset_insert(&queued, &p->item->object.oid))
+				prio_queue_put(&queue, p->item);
+	}
+	clear_prio_queue(&queue);
+	oidset_clear(&queued);
+
+	nr = oidset_size(&bn->summarized);
+	if (!nr)
+		return 0;
+
+	filter->len = (nr * settings->bits_per_entry + BITS_PER_WORD - 1) /
+		BITS_PER_WORD;
+	filter->to_free = filter->data = xcalloc(filter->len, 1);
+
+	oidset_iter_init(&bn->summarized, &iter);
+	while ((oid = oidset_iter_next(&iter))) {
+		struct bloom_key key;
+
+		fill_bloom_key((const char *)oid->hash, the_hash_algo->rawsz,
+			       &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+
+	return nr;
+}
+
+static void add_candidate(struct fetch_negotiator *n,
+			  const struct object_id *oid)
+{
+	struct bloom_negotiator *bn = n->data;
+	struct commit *c;
+
+	/*
+	 * The server only knows that the commit matches our filter; trust
+	 * it only if it is one of the commits we actually summarized.
+	 */
+	if (!oidset_contains(&bn->summarized, oid))
+		return;
+	c = lookup_commit(the_repository, oid);
+	if (!c)
+		return;
+	/* Do not send a "have" twice. */
+	if (oidset_insert(&bn->haves, oid))
+		return;
+
+	ALLOC_GROW(bn->candidates, bn->candidates_nr + 1, bn->candidates_alloc);
+	bn->candidates[bn->candidates_nr++] = c;
+}
+
+static void release(struct fetch_negotiator *n)
+{
+	struct bloom_negotiator *bn = n->data;
+
+	bn->consecutive.release(&bn->consecutive);
+	free_commit_list(bn->tips);
+	oidset_clear(&bn->summarized);
+	free(bn->candidates);
+	oidset_clear(&bn->haves);
+	FREE_AND_NULL(n->data);
+}
+
+void bloom_negotiator_init(struct fetch_negotiator *negotiator)
+{
+	struct bloom_negotiator *bn;
+
+	negotiator->known_common = known_common;
+	negotiator->add_tip = add_tip;
+	negotiator->next = next;
+	negotiator->ack = ack;
+	negotiator->summarize = summarize;
+	negotiator->add_candidate = add_candidate;
+	negotiator->release = release;
+	negotiator->data = CALLOC_ARRAY(bn, 1);
+
+	default_negotiator_init(&bn->consecutive);
+	oidset_init(&bn->summarized, 0);
+	oidset_init(&bn->haves, 0);
+}
@@ -0,0 +1,8 @@
+#ifndef NEGOTIATOR_BLOOM_H
+#define NEGOTIATOR_BLOOM_H
+
+struct fetch_negotiator;
+
+void bloom_negotiator_init(struct fetch_negotiator *negotiator);
+
+#endif
@@ -23,6 +23,7 @@
 #include "midx.h"
 #include "config.h"
 #include "pseudo-merge.h"
+#include "tree.h"
 
 /*
  * An entry on the bitmap index, representing the bitmap for a given
@@ -2884,6 +2885,107 @@ void free_bitmap_index(struct bitmap_index *b)
 	free(b);
 }
 
+/*
+ * Clear the flags that find_objects() left on the commits it walked
+ * from "commit", and on their root trees.
+ */
+static void clear_reachable_marks(struct commit *commit)
+{
+	struct commit_list *stack = NULL;
+
+	commit_list_insert(commit, &stack);
+	while (stack) {
+		struct commit_list *p;
+
+		commit = pop_commit(&stack);
+		commit->object.flags &= ~ALL_REV_FLAGS;
+		if (commit->maybe_tree)
+			commit->maybe_tree->object.flags &= ~ALL_REV_FLAGS;
+		for (p = commit->parents; p; p = p->next)
+			if (p->item->object.flags & ALL_REV_FLAGS)
+				commit_list_insert(p->item, &stack);
+	}
+}
+
+struct bitmap *bitmap_reachable_from(struct bitmap_index *bitmap_git,
+				     struct commit *commit)
+{
+	struct repository *repo = bitmap_repo(bitmap_git);
+	struct object_list *roots = NULL;
+	struct rev_info revs;
+	struct bitmap *result;
+
+	if (repo_parse_commit(repo, commit))
+		return NULL;
+
+	/*
+	 * We only care about commits; trees and blobs come along for free
+	 * from the stored bitmaps, but we do not walk them ourselves.
+	 */
+	repo_init_revisions(repo, &revs, NULL);
+	revs.tree_objects = 0;
+	revs.blob_objects = 0;
+	object_list_insert(&commit->object, &roots);
+
+	result = find_objects(bitmap_git, &revs, roots, NULL);
+
+	object_list_free(&roots);
+	release_revisions(&revs);
+	clear_reachable_marks(commit);
+
+	return result;
+}
+
+int bitmap_object_position(struct bitmap_index *bitmap_git,
+			   const struct object_id *oid)
+{
+	return bitmap_position(bitmap_git, oid);
+}
+
+static int ewah_intersects(struct ewah_bitmap *ewah, struct bitmap *other)
+{
+	struct ewah_iterator it;
+	eword_t word;
+	size_t i;
+
+	ewah_iterator_init(&it, ewah);
+	for (i = 0; i < other->word_alloc && ewah_iterator_next(&word, &it); i++)
+		if (word & other->words[i])
+			return 1;
+	return 0;
+}
+
+struct bitmap *bitmap_of_commits(struct bitmap_index *bitmap_git,
+				 const struct commit_list *list)
+{
+	struct bitmap *result = bitmap_new();
+
+	for (; list; list = list->next) {
+		int pos = bitmap_position(bitmap_git, &list->item->object.oid);
+
+		/*
+		 * Objects outside of the bitmapped pack do not have a bit
+		 * in any of the stored bitmaps.
+		 */
+		if (pos < 0 || pos >= bitmap_num_objects(bitmap_git)) {
+			bitmap_free(result);
+			return NULL;
+		}
+		bitmap_set(result, pos);
+	}
+	return result;
+}
+
+int bitmap_commit_reaches(struct bitmap_index *bitmap_git,
+			  struct commit *commit, struct bitmap *wants)
+{
+	struct ewah_bitmap *stored = bitmap_for_commit(bitmap_git, commit);
+
+	if (!stored)
+		return -1;
+	return ewah_intersects(stored, wants);
+}
+
 int bitmap_has_oid_in_uninteresting(struct bitmap_index *bitmap_git,
 				    const struct object_id *oid)
 {
@@ -8,6 +8,7 @@
 #include "string-list.h"
 
 struct commit;
+struct commit_list;
 struct repository;
 struct rev_info;
 
@@ -94,6 +95,40 @@ void free_bitmap_index(struct bitmap_index *);
 int bitmap_walk_contains(struct bitmap_index *,
 			 struct bitmap *bitmap, const struct object_id *oid);
 
+/*
+ * Return a newly allocated bitmap with the positions of all commits
+ * reachable from "commit" set (trees and blobs may be set, too), or NULL
+ * if the commit cannot be parsed. Unlike prepare_bitmap_walk(), this
+ * does not modify the state of "bitmap_git" beyond extending its index
+ * with commits outside of the bitmapped pack, so it can be called
+ * repeatedly. Test membership with bitmap_walk_contains().
+ */
+struct bitmap *bitmap_reachable_from(struct bitmap_index *bitmap_git,
+				     struct commit *commit);
+
+/*
+ * Return the position of "oid" in the bitmaps of "bitmap_git", including
+ * the commits added by bitmap_reachable_from(), or -1 if it has none.
+ */
+int bitmap_object_position(struct bitmap_index *bitmap_git,
+			   const struct object_id *oid);
+
+/*
+ * Return a newly allocated bitmap with the positions of the commits in
+ * "list" set, or NULL if some of them are not in the bitmapped pack(s),
+ * and so cannot be found in any stored bitmap.
+ */
+struct bitmap *bitmap_of_commits(struct bitmap_index *bitmap_git,
+				 const struct commit_list *list);
+
+/*
+ * Tell from the stored bitmap of "commit" whether any of the objects set
+ * in "wants" is reachable from it: 1 if so, 0 if not, and -1 if "commit"
+ * has no stored bitmap. Only the bitmap of "commit" is loaded.
+ */
+int bitmap_commit_reaches(struct bitmap_index *bitmap_git,
+			  struct commit *commit, struct bitmap *wants);
+
 /*
  * After a traversal has been performed by prepare_bitmap_walk(), this can be
  * queried to see if a particular object was reachable from any of the
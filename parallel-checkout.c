@@ -2,18 +2,24 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "blob-cache.h"
 #include "config.h"
 #include "entry.h"
+#include "environment.h"
 #include "gettext.h"
 #include "hash.h"
 #include "hex.h"
+#include "object-store-ll.h"
+#include "packfile.h"
 #include "parallel-checkout.h"
+#include "parse.h"
 #include "pkt-line.h"
 #include "progress.h"
 #include "read-cache-ll.h"
 #include "run-command.h"
 #include "sigchain.h"
 #include "streaming.h"
+#include "strmap.h"
 #include "symlinks.h"
 #include "thread-utils.h"
 #include "trace2.h"
@@ -99,7 +105,8 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 		return 0;
 
 	packed_item_size = sizeof(struct pc_item_fixed_portion) + ce->ce_namelen +
-		(ca->working_tree_encoding ? strlen(ca->working_tree_encoding) : 0);
+		(ca->working_tree_encoding ? strlen(ca->working_tree_encoding) : 0) +
+		(ca->drv ? strlen(conv_attrs_driver_name(ca)) : 0);
 
 	/*
 	 * The amount of data we send to the workers per checkout item is
@@ -117,31 +124,28 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 
 	case CA_CLASS_INCORE_FILTER:
 		/*
-		 * It would be safe to allow concurrent instances of
-		 * single-file smudge filters, like rot13, but we should not
-		 * assume that all filters are parallel-process safe. So we
-		 * don't allow this.
+		 * It is safe to allow concurrent instances of single-file
+		 * smudge filters, like rot13, but we should not assume that
+		 * all filters are parallel-process safe. So we only do this
+		 * if the user told us so.
 		 */
-		return 0;
+		return conv_attrs_filter_is_parallel(ca);
 
 	case CA_CLASS_INCORE_PROCESS:
 		/*
-		 * The parallel queue and the delayed queue are not compatible,
-		 * so they must be kept completely separated. And we can't tell
-		 * if a long-running process will delay its response without
-		 * actually asking it to perform the filtering. Therefore, this
-		 * type of filter is not allowed in parallel checkout.
-		 *
-		 * Furthermore, there should only be one instance of the
+		 * By default, there should only be one instance of the
 		 * long-running process filter as we don't know how it is
-		 * managing its own concurrency. So, spreading the entries that
-		 * requisite such a filter among the parallel workers would
-		 * require a lot more inter-process communication. We would
-		 * probably have to designate a single process to interact with
-		 * the filter and send all the necessary data to it, for each
-		 * entry.
+		 * managing its own concurrency. But the user may tell us
+		 * that several instances can run at the same time, in which
+		 * case each worker starts its own, giving a pool of filter
+		 * processes that the entries are spread over.
+		 *
+		 * Their filter processes may delay entries like the one of
+		 * the sequential checkout, in which case each worker asks
+		 * its own process for them once it has gone through all its
+		 * other entries.
 		 */
-		return 0;
+		return conv_attrs_filter_is_parallel(ca);
 
 	case CA_CLASS_STREAMABLE:
 		return 1;
@@ -213,6 +217,13 @@ static int handle_results(struct checkout *state)
 			if (pc_item->checkout_counter)
 				(*pc_item->checkout_counter)++;
 			break;
+		case PC_ITEM_DELAYED:
+			/*
+			 * The filter delayed the entry, which is checked out
+			 * by finish_delayed_checkout() like the ones delayed
+			 * by the sequential checkout.
+			 */
+			break;
 		case PC_ITEM_COLLIDED:
 			/*
 			 * The entry could not be checked out due to a path
@@ -266,15 +277,81 @@ static int reset_fd(int fd, const char *path)
 	return 0;
 }
 
-static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
-			       const char *path)
+/*
+ * Read the blob of pc_item and convert it to its working tree form. Return
+ * NULL if the blob cannot be read or, when `delayed` is given, if the
+ * filter of the item delayed its conversion, in which case `*delayed` is
+ * set.
+ */
+static char *read_pc_item_content(struct parallel_checkout_item *pc_item,
+				  const struct checkout *state, size_t *size,
+				  int *delayed)
 {
+	static int scratch_nr_checkouts;
+	struct delayed_checkout *dco = delayed ? state->delayed_checkout : NULL;
+	struct strbuf buf = STRBUF_INIT;
+	struct checkout_metadata meta;
+	char *blob = NULL;
 	int ret;
+
+	/*
+	 * We do not send the blob in case of a retry, so do not bother
+	 * reading it at all.
+	 */
+	if (dco && dco->state == CE_RETRY) {
+		*size = 0;
+	} else {
+		blob = read_blob_entry(pc_item->ce, size);
+		if (!blob)
+			return NULL;
+	}
+
+	/*
+	 * checkout metadata is used to give context for external process
+	 * filters. The workers receive it from the main process on their
+	 * command line.
+	 */
+	clone_checkout_metadata(&meta, &state->meta, &pc_item->ce->oid);
+	if (dco && dco->state != CE_NO_DELAY) {
+		ret = async_convert_to_working_tree_ca(&pc_item->ca,
+						       pc_item->ce->name,
+						       blob, *size, &buf,
+						       &meta, dco);
+		if (ret) {
+			struct string_list_item *item =
+				string_list_lookup(&dco->paths,
+						   pc_item->ce->name);
+			if (item) {
+				item->util = pc_item->checkout_counter ?
+					pc_item->checkout_counter :
+					&scratch_nr_checkouts;
+				free(blob);
+				strbuf_release(&buf);
+				*delayed = 1;
+				return NULL;
+			}
+		}
+	} else {
+		ret = convert_to_working_tree_ca(&pc_item->ca,
+						 pc_item->ce->name, blob,
+						 *size, &buf, &meta);
+	}
+	if (ret) {
+		free(blob);
+		blob = strbuf_detach(&buf, size);
+	}
+
+	return blob;
+}
+
+static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
+			       const char *path, const struct checkout *state)
+{
 	struct stream_filter *filter;
-	struct strbuf buf = STRBUF_INIT;
 	char *blob;
 	size_t size;
 	ssize_t wrote;
+	int delayed = 0;
 
 	/* Sanity check */
 	assert(is_eligible_for_parallel_checkout(pc_item->ce, &pc_item->ca));
@@ -290,27 +367,13 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 		}
 	}
 
-	blob = read_blob_entry(pc_item->ce, &size);
+	blob = read_pc_item_content(pc_item, state, &size, &delayed);
+	if (delayed)
+		return 1;
 	if (!blob)
 		return error("cannot read object %s '%s'",
 			     oid_to_hex(&pc_item->ce->oid), pc_item->ce->name);
 
-	/*
-	 * checkout metadata is used to give context for external process
-	 * filters. Files requiring such filters are not eligible for parallel
-	 * checkout, so pass NULL. Note: if that changes, the metadata must also
-	 * be passed from the main process to the workers.
-	 */
-	ret = convert_to_working_tree_ca(&pc_item->ca, pc_item->ce->name,
-					 blob, size, &buf, NULL);
-
-	if (ret) {
-		size_t newsize;
-		free(blob);
-		blob = strbuf_detach(&buf, &newsize);
-		size = newsize;
-	}
-
 	wrote = write_in_full(fd, blob, size);
 	free(blob);
 	if (wrote < 0)
@@ -331,11 +394,43 @@ static int close_and_clear(int *fd)
 	return ret;
 }
 
-void write_pc_item(struct parallel_checkout_item *pc_item,
-		   struct checkout *state)
+/*
+ * The working tree content of an item, prepared ahead of the write by the
+ * decoding thread of write_pc_items(). Items which are not `ready` (e.g.
+ * large blobs, which are better streamed) are read by the writer itself.
+ */
+struct pc_item_content {
+	char *buf;
+	size_t size;
+	int ready;
+};
+
+static int write_pc_item_content(struct parallel_checkout_item *pc_item,
+				 int fd, const char *path,
+				 const struct checkout *state,
+				 const struct pc_item_content *content)
+{
+	int ret;
+
+	if (content && content->ready) {
+		if (write_in_full(fd, content->buf, content->size) < 0)
+			return error("unable to write file '%s'", path);
+		return 0;
+	}
+
+	/* The decoding thread may be reading objects concurrently. */
+	obj_read_lock();
+	ret = write_pc_item_to_fd(pc_item, fd, path, state);
+	obj_read_unlock();
+	return ret;
+}
+
+static void write_pc_item_1(struct parallel_checkout_item *pc_item,
+			    struct checkout *state,
+			    const struct pc_item_content *content)
 {
 	unsigned int mode = (pc_item->ce->ce_mode & 0100) ? 0777 : 0666;
-	int fd = -1, fstat_done = 0;
+	int fd = -1, fstat_done = 0, ret;
 	struct strbuf path = STRBUF_INIT;
 	const char *dir_sep;
 
@@ -357,6 +452,9 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
+	if (!blob_cache_checkout(pc_item->ce, &pc_item->ca, path.buf))
+		goto written;
+
 	fd = open(path.buf, O_WRONLY | O_CREAT | O_EXCL, mode);
 
 	if (fd < 0) {
@@ -378,11 +476,12 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
-	if (write_pc_item_to_fd(pc_item, fd, path.buf)) {
-		/* Error was already reported. */
-		pc_item->status = PC_ITEM_FAILED;
+	ret = write_pc_item_content(pc_item, fd, path.buf, state, content);
+	if (ret) {
 		close_and_clear(&fd);
 		unlink(path.buf);
+		/* An error was already reported. */
+		pc_item->status = ret > 0 ? PC_ITEM_DELAYED : PC_ITEM_FAILED;
 		goto out;
 	}
 
@@ -394,6 +493,9 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
+	blob_cache_add(pc_item->ce, &pc_item->ca, path.buf);
+
+written:
 	if (state->refresh_cache && !fstat_done && lstat(path.buf, &pc_item->st) < 0) {
 		error_errno("unable to stat just-written file '%s'",  path.buf);
 		pc_item->status = PC_ITEM_FAILED;
@@ -406,22 +508,320 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 	strbuf_release(&path);
 }
 
+void write_pc_item(struct parallel_checkout_item *pc_item,
+		   struct checkout *state)
+{
+	write_pc_item_1(pc_item, state, NULL);
+}
+
+/*
+ * Number of items, and of bytes of working tree content, that the decoding
+ * thread of write_pc_items() may prepare ahead of the writer.
+ */
+#define PC_PIPELINE_DEPTH 64
+#define PC_PIPELINE_MAX_BYTES (32 * 1024 * 1024)
+
+struct pc_pipeline {
+	struct parallel_checkout_item *items;
+	size_t nr;
+	const struct checkout *state;
+	struct pc_item_content content[PC_PIPELINE_DEPTH];
+
+	/*
+	 * Items [0, decoded) have been prepared and items [0, written) have
+	 * been written. `pending_bytes` is the size of the prepared content
+	 * not yet written.
+	 */
+	size_t decoded, written, pending_bytes;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static void decode_pc_item(struct parallel_checkout_item *pc_item,
+			   const struct checkout *state,
+			   struct pc_item_content *content)
+{
+	unsigned long size;
+
+	memset(content, 0, sizeof(*content));
+
+	/*
+	 * Filter drivers run external commands, which must not be started
+	 * from several threads: leave them to the writer.
+	 */
+	if (conv_attrs_driver_name(&pc_item->ca))
+		return;
+
+	/*
+	 * Leave large blobs to write_pc_item_to_fd(), which can stream them
+	 * without holding the whole content in memory. The same goes for
+	 * blobs we fail to read, so that the error is reported in order.
+	 */
+	if (oid_object_info(the_repository, &pc_item->ce->oid, &size) != OBJ_BLOB ||
+	    size > big_file_threshold)
+		return;
+
+	content->buf = read_pc_item_content(pc_item, state, &content->size,
+					    NULL);
+	if (content->buf)
+		content->ready = 1;
+}
+
+static void *decode_pc_items(void *data)
+{
+	struct pc_pipeline *pp = data;
+	size_t i;
+
+	for (i = 0; i < pp->nr; i++) {
+		struct pc_item_content *content = &pp->content[i % PC_PIPELINE_DEPTH];
+
+		pthread_mutex_lock(&pp->mutex);
+		while (i - pp->written >= PC_PIPELINE_DEPTH ||
+		       (i > pp->written && pp->pending_bytes >= PC_PIPELINE_MAX_BYTES))
+			pthread_cond_wait(&pp->cond, &pp->mutex);
+		pthread_mutex_unlock(&pp->mutex);
+
+		decode_pc_item(&pp->items[i], pp->state, content);
+
+		pthread_mutex_lock(&pp->mutex);
+		pp->decoded = i + 1;
+		pp->pending_bytes += content->size;
+		pthread_cond_signal(&pp->cond);
+		pthread_mutex_unlock(&pp->mutex);
+	}
+
+	return NULL;
+}
+
+static int checkout_pipeline_enabled(void)
+{
+	int enabled;
+
+	if (!HAVE_THREADS)
+		return 0;
+	enabled = git_env_bool("GIT_TEST_CHECKOUT_PIPELINE", -1);
+	if (enabled < 0 && git_config_get_bool("checkout.pipeline", &enabled))
+		enabled = 0;
+	return enabled;
+}
+
+static int use_checkout_pipeline(size_t nr)
+{
+	return nr >= 2 && checkout_pipeline_enabled();
+}
+
+int use_parallel_checkout(int num_workers)
+{
+	return num_workers > 1 || checkout_pipeline_enabled();
+}
+
+void write_pc_items(struct parallel_checkout_item *items, size_t nr,
+		    struct checkout *state, pc_item_done_fn done, void *data)
+{
+	struct pc_pipeline pp = { .items = items, .nr = nr, .state = state };
+	pthread_t decoder;
+	size_t i;
+	int err;
+
+	/*
+	 * Entries found in the blob cache do not need their blobs to be
+	 * read, so the decoding thread would mostly waste work.
+	 */
+	if (!use_checkout_pipeline(nr) || blob_cache_enabled())
+		goto sequential;
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&pp.mutex, NULL);
+	pthread_cond_init(&pp.cond, NULL);
+
+	err = pthread_create(&decoder, NULL, decode_pc_items, &pp);
+	if (err) {
+		warning(_("unable to create checkout thread: %s"), strerror(err));
+		pthread_cond_destroy(&pp.cond);
+		pthread_mutex_destroy(&pp.mutex);
+		disable_obj_read_lock();
+		goto sequential;
+	}
+
+	trace2_region_enter("pcheckout", "pipeline", NULL);
+	for (i = 0; i < nr; i++) {
+		struct pc_item_content *content = &pp.content[i % PC_PIPELINE_DEPTH];
+
+		pthread_mutex_lock(&pp.mutex);
+		while (pp.decoded <= i)
+			pthread_cond_wait(&pp.cond, &pp.mutex);
+		pthread_mutex_unlock(&pp.mutex);
+
+		write_pc_item_1(&items[i], state, content);
+		free(content->buf);
+
+		pthread_mutex_lock(&pp.mutex);
+		pp.written = i + 1;
+		pp.pending_bytes -= content->size;
+		pthread_cond_signal(&pp.cond);
+		pthread_mutex_unlock(&pp.mutex);
+
+		done(&items[i], data);
+	}
+	trace2_region_leave("pcheckout", "pipeline", NULL);
+
+	pthread_join(decoder, NULL);
+	pthread_cond_destroy(&pp.cond);
+	pthread_mutex_destroy(&pp.mutex);
+	disable_obj_read_lock();
+	return;
+
+sequential:
+	for (i = 0; i < nr; i++) {
+		write_pc_item(&items[i], state);
+		done(&items[i], data);
+	}
+}
+
+struct delayed_pc_items {
+	struct strmap items;
+	struct checkout *state;
+	pc_item_done_fn done;
+	void *data;
+};
+
+static int write_delayed_pc_item(const char *path, void *util UNUSED,
+				 void *data)
+{
+	struct delayed_pc_items *d = data;
+	struct parallel_checkout_item *pc_item = strmap_get(&d->items, path);
+
+	if (!pc_item)
+		return 1;
+	write_pc_item(pc_item, d->state);
+	d->done(pc_item, d->data);
+	return pc_item->status != PC_ITEM_WRITTEN;
+}
+
+void write_delayed_pc_items(struct parallel_checkout_item *items, size_t nr,
+			    struct checkout *state, pc_item_done_fn done,
+			    void *data)
+{
+	struct delayed_pc_items d = {
+		.state = state,
+		.done = done,
+		.data = data,
+	};
+	size_t i;
+
+	strmap_init(&d.items);
+	for (i = 0; i < nr; i++)
+		if (items[i].status == PC_ITEM_DELAYED)
+			strmap_put(&d.items, items[i].ce->name, &items[i]);
+
+	finish_delayed_checkout_fn(state, write_delayed_pc_item, &d);
+
+	for (i = 0; i < nr; i++) {
+		if (items[i].status != PC_ITEM_DELAYED)
+			continue;
+		items[i].status = PC_ITEM_FAILED;
+		done(&items[i], data);
+	}
+	strmap_clear(&d.items, 0);
+}
+
+struct pc_item_pack_pos {
+	uintptr_t pack; /* 0 for objects not found in a pack */
+	off_t offset;
+	size_t pos;
+};
+
+static int pack_pos_cmp(const void *va, const void *vb)
+{
+	const struct pc_item_pack_pos *a = va, *b = vb;
+
+	if (a->pack != b->pack) {
+		if (!a->pack)
+			return 1;
+		if (!b->pack)
+			return -1;
+		return a->pack < b->pack ? -1 : 1;
+	}
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/*
+ * Reorder the queue so that the blobs are read in pack order: this turns
+ * the object reads of each worker (which gets a contiguous slice of the
+ * queue) into a mostly sequential scan of a region of the pack, and makes
+ * the delta bases of one item likely to still be in the delta base cache
+ * when the next item is read. Objects which are not in any pack come last.
+ *
+ * The `id` of each item is left untouched, so that the original order can
+ * be restored with restore_queue_order().
+ */
+static void sort_queue_by_pack_position(void)
+{
+	struct pc_item_pack_pos *pos;
+	struct parallel_checkout_item *sorted;
+	size_t i;
+
+	if (parallel_checkout.nr < 2)
+		return;
+
+	trace2_region_enter("pcheckout", "sort-by-pack", NULL);
+	ALLOC_ARRAY(pos, parallel_checkout.nr);
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct pack_entry e;
+
+		pos[i].pos = i;
+		if (find_pack_entry(the_repository,
+				    &parallel_checkout.items[i].ce->oid, &e)) {
+			pos[i].pack = (uintptr_t)e.p;
+			pos[i].offset = e.offset;
+		} else {
+			pos[i].pack = 0;
+			pos[i].offset = 0;
+		}
+	}
+	QSORT(pos, parallel_checkout.nr, pack_pos_cmp);
+
+	ALLOC_ARRAY(sorted, parallel_checkout.alloc);
+	for (i = 0; i < parallel_checkout.nr; i++)
+		sorted[i] = parallel_checkout.items[pos[i].pos];
+	free(parallel_checkout.items);
+	parallel_checkout.items = sorted;
+
+	free(pos);
+	trace2_region_leave("pcheckout", "sort-by-pack", NULL);
+}
+
+static int item_id_cmp(const void *va, const void *vb)
+{
+	const struct parallel_checkout_item *a = va, *b = vb;
+	return a->id < b->id ? -1 : a->id > b->id;
+}
+
+static void restore_queue_order(void)
+{
+	QSORT(parallel_checkout.items, parallel_checkout.nr, item_id_cmp);
+}
+
 static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 {
 	size_t len_data;
 	char *data, *variant;
 	struct pc_item_fixed_portion *fixed_portion;
 	const char *working_tree_encoding = pc_item->ca.working_tree_encoding;
+	const char *driver_name = conv_attrs_driver_name(&pc_item->ca);
 	size_t name_len = pc_item->ce->ce_namelen;
 	size_t working_tree_encoding_len = working_tree_encoding ?
 					   strlen(working_tree_encoding) : 0;
+	size_t driver_name_len = driver_name ? strlen(driver_name) : 0;
 
 	/*
 	 * Any changes in the calculation of the message size must also be made
 	 * in is_eligible_for_parallel_checkout().
 	 */
 	len_data = sizeof(struct pc_item_fixed_portion) + name_len +
-		   working_tree_encoding_len;
+		   working_tree_encoding_len + driver_name_len;
 
 	data = xmalloc(len_data);
 
@@ -432,6 +832,7 @@ static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 	fixed_portion->ident = pc_item->ca.ident;
 	fixed_portion->name_len = name_len;
 	fixed_portion->working_tree_encoding_len = working_tree_encoding_len;
+	fixed_portion->driver_name_len = driver_name_len;
 	oidcpy(&fixed_portion->oid, &pc_item->ce->oid);
 
 	variant = data + sizeof(*fixed_portion);
@@ -439,6 +840,10 @@ static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 		memcpy(variant, working_tree_encoding, working_tree_encoding_len);
 		variant += working_tree_encoding_len;
 	}
+	if (driver_name_len) {
+		memcpy(variant, driver_name, driver_name_len);
+		variant += driver_name_len;
+	}
 	memcpy(variant, pc_item->ce->name, name_len);
 
 	packet_write(fd, data, len_data);
@@ -475,6 +880,14 @@ static struct pc_worker *setup_workers(struct checkout *state, int num_workers)
 		strvec_push(&cp->args, "checkout--worker");
 		if (state->base_dir_len)
 			strvec_pushf(&cp->args, "--prefix=%s", state->base_dir);
+		if (state->meta.refname)
+			strvec_pushf(&cp->args, "--refname=%s",
+				     state->meta.refname);
+		if (!is_null_oid(&state->meta.treeish))
+			strvec_pushf(&cp->args, "--treeish=%s",
+				     oid_to_hex(&state->meta.treeish));
+		if (state->delayed_checkout)
+			strvec_push(&cp->args, "--delay");
 		if (start_command(cp))
 			die("failed to spawn checkout worker");
 	}
@@ -564,14 +977,19 @@ static void parse_and_save_result(const char *buffer, int len,
 
 	if (!worker->nr_items_to_complete)
 		BUG("received result from supposedly finished checkout worker");
-	if (res->id != worker->next_item_to_complete)
+
+	/*
+	 * The queue may have been reordered, so `id` is not the position of
+	 * the item in it. But the worker still handles its slice in order.
+	 */
+	pc_item = &parallel_checkout.items[worker->next_item_to_complete];
+	if (res->id != pc_item->id)
 		BUG("unexpected item id from checkout worker (got %"PRIuMAX", exp %"PRIuMAX")",
-		    (uintmax_t)res->id, (uintmax_t)worker->next_item_to_complete);
+		    (uintmax_t)res->id, (uintmax_t)pc_item->id);
 
 	worker->next_item_to_complete++;
 	worker->nr_items_to_complete--;
 
-	pc_item = &parallel_checkout.items[res->id];
 	pc_item->status = res->status;
 	if (st)
 		pc_item->st = *st;
@@ -635,17 +1053,18 @@ static void gather_results_from_workers(struct pc_worker *workers,
 	free(pfds);
 }
 
-static void write_items_sequentially(struct checkout *state)
+static void item_written(struct parallel_checkout_item *pc_item,
+			 void *data UNUSED)
 {
-	size_t i;
+	if (pc_item->status != PC_ITEM_COLLIDED)
+		advance_progress_meter();
+}
 
+static void write_items_sequentially(struct checkout *state)
+{
 	flush_fscache();
-	for (i = 0; i < parallel_checkout.nr; i++) {
-		struct parallel_checkout_item *pc_item = &parallel_checkout.items[i];
-		write_pc_item(pc_item, state);
-		if (pc_item->status != PC_ITEM_COLLIDED)
-			advance_progress_meter();
-	}
+	write_pc_items(parallel_checkout.items, parallel_checkout.nr, state,
+		       item_written, NULL);
 }
 
 int run_parallel_checkout(struct checkout *state, int num_workers, int threshold,
@@ -663,14 +1082,23 @@ int run_parallel_checkout(struct checkout *state, int num_workers, int threshold
 	if (parallel_checkout.nr < num_workers)
 		num_workers = parallel_checkout.nr;
 
+	sort_queue_by_pack_position();
+
 	if (num_workers <= 1 || parallel_checkout.nr < threshold) {
 		write_items_sequentially(state);
 	} else {
-		struct pc_worker *workers = setup_workers(state, num_workers);
+		struct pc_worker *workers;
+
+		/* Report invalid blob cache settings here, not in each worker. */
+		blob_cache_enabled();
+
+		workers = setup_workers(state, num_workers);
 		gather_results_from_workers(workers, num_workers);
 		finish_workers(workers, num_workers);
 	}
 
+	restore_queue_order();
+
 	ret = handle_results(state);
 
 	finish_parallel_checkout();
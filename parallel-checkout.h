@@ -20,6 +20,15 @@ enum pc_status {
 enum pc_status parallel_checkout_status(void);
 void get_parallel_checkout_configs(int *num_workers, int *threshold);
 
+/*
+ * Return 1 if the entries to check out should be queued for
+ * run_parallel_checkout(), given the number of workers from
+ * get_parallel_checkout_configs(). This is also the case with a single
+ * worker when "checkout.pipeline" is set, as only the queued entries have
+ * their blobs read ahead of the writes; see write_pc_items().
+ */
+int use_parallel_checkout(int num_workers);
+
 /*
  * Put parallel checkout into the PC_ACCEPTING_ENTRIES state. Should be used
  * only when in the PC_UNINITIALIZED state.
@@ -59,6 +68,11 @@ enum pc_item_status {
 	 */
 	PC_ITEM_COLLIDED,
 	PC_ITEM_FAILED,
+	/*
+	 * The filter of the entry delayed it. Workers write such entries
+	 * with write_delayed_pc_items() before reporting them.
+	 */
+	PC_ITEM_DELAYED,
 };
 
 struct parallel_checkout_item {
@@ -68,7 +82,7 @@ struct parallel_checkout_item {
 	 */
 	struct cache_entry *ce;
 	struct conv_attrs ca;
-	size_t id; /* position in parallel_checkout.items[] of main process */
+	size_t id; /* enqueue position in parallel_checkout.items[] of main process */
 	int *checkout_counter;
 
 	/* Output fields, sent from workers. */
@@ -78,9 +92,9 @@ struct parallel_checkout_item {
 
 /*
  * The fixed-size portion of `struct parallel_checkout_item` that is sent to the
- * workers. Following this will be 2 strings: ca.working_tree_encoding and
- * ce.name; These are NOT null terminated, since we have the size in the fixed
- * portion.
+ * workers. Following this will be 3 strings: ca.working_tree_encoding, the
+ * name of the filter driver in ca.drv, and ce.name; These are NOT null
+ * terminated, since we have the size in the fixed portion.
  *
  * Note that not all fields of conv_attrs and cache_entry are passed, only the
  * ones that will be required by the workers to smudge and write the entry.
@@ -92,6 +106,7 @@ struct pc_item_fixed_portion {
 	enum convert_crlf_action crlf_action;
 	int ident;
 	size_t working_tree_encoding_len;
+	size_t driver_name_len;
 	size_t name_len;
 };
 
@@ -110,4 +125,25 @@ struct pc_item_result {
 void write_pc_item(struct parallel_checkout_item *pc_item,
 		   struct checkout *state);
 
+typedef void (*pc_item_done_fn)(struct parallel_checkout_item *pc_item,
+				void *data);
+
+/*
+ * Write the given items in order, as write_pc_item() does, calling `done`
+ * after each one. When threads are available, the blobs are read and
+ * converted to their working tree form in a separate thread, so that this
+ * work overlaps with the writing of the previous items.
+ */
+void write_pc_items(struct parallel_checkout_item *items, size_t nr,
+		    struct checkout *state, pc_item_done_fn done, void *data);
+
+/*
+ * Write the items left PC_ITEM_DELAYED by write_pc_items(), as their
+ * filters make them available, calling `done` after each one. The items
+ * which are not made available are marked as PC_ITEM_FAILED.
+ */
+void write_delayed_pc_items(struct parallel_checkout_item *items, size_t nr,
+			    struct checkout *state, pc_item_done_fn done,
+			    void *data);
+
 #endif /* PARALLEL_CHECKOUT_H */
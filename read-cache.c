@@ -10,6 +10,7 @@
 #include "git-compat-util.h"
 #include "bulk-checkin.h"
 #include "config.h"
+#include "convert.h"
 #include "date.h"
 #include "diff.h"
 #include "diffcore.h"
@@ -3941,11 +3942,22 @@ static void update_callback(struct diff_queue_struct *q,
 {
 	int i;
 	struct update_callback_data *data = cbdata;
+	const char **paths;
+	size_t prefetched = 0;
+
+	ALLOC_ARRAY(paths, q->nr);
+	for (i = 0; i < q->nr; i++)
+		paths[i] = q->queue[i]->one->path;
 
 	for (i = 0; i < q->nr; i++) {
 		struct diff_filepair *p = q->queue[i];
 		const char *path = p->one->path;
 
+		if ((size_t)i == prefetched && !(data->flags & ADD_CACHE_PRETEND))
+			prefetched += convert_prefetch_clean(data->index,
+							     paths + i,
+							     q->nr - i);
+
 		if (!data->include_sparse &&
 		    !path_in_sparse_checkout(path, data->index))
 			continue;
@@ -3971,6 +3983,8 @@ static void update_callback(struct diff_queue_struct *q,
 			break;
 		}
 	}
+	discard_prefetched_clean();
+	free(paths);
 }
 
 int add_files_to_cache(struct repository *repo, const char *prefix,
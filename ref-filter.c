@@ -14,9 +14,11 @@
 #include "object-name.h"
 #include "object-store-ll.h"
 #include "oid-array.h"
+#include "pack-bitmap.h"
 #include "repo-settings.h"
 #include "repository.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "mailmap.h"
 #include "ident.h"
 #include "remote.h"
@@ -33,6 +35,7 @@
 #include "commit-reach.h"
 #include "worktree.h"
 #include "hashmap.h"
+#include "trace2.h"
 
 static struct ref_msg {
 	const char *gone;
@@ -2839,6 +2842,69 @@ static int filter_ref_kind(struct ref_filter *filter, const char *refname)
 	return ref_kind_from_refname(refname);
 }
 
+/*
+ * The stored reachability bitmaps answer "--contains" and "--no-contains"
+ * with a single lookup for the refs that point at a bitmapped commit,
+ * loading only the bitmaps of those commits. They describe the history as
+ * it was written, so they are not used when replace refs, grafts or a
+ * shallow clone change it.
+ */
+static void prepare_contains_bitmaps(struct ref_filter *filter)
+{
+	struct bitmap_index *bitmap_git;
+
+	if (!filter->with_commit && !filter->no_commit)
+		return;
+	if (!commit_graph_compatible(the_repository))
+		return;
+	bitmap_git = prepare_bitmap_git(the_repository);
+	if (!bitmap_git)
+		return;
+
+	filter->internal.bitmap_git = bitmap_git;
+	if (filter->with_commit)
+		filter->internal.contains_bitmap =
+			bitmap_of_commits(bitmap_git, filter->with_commit);
+	if (filter->no_commit)
+		filter->internal.no_contains_bitmap =
+			bitmap_of_commits(bitmap_git, filter->no_commit);
+}
+
+static void contains_from_bitmap(struct ref_filter *filter,
+				 struct commit *commit, struct bitmap *wants,
+				 struct contains_cache *cache)
+{
+	enum contains_result *cached;
+	int reaches;
+
+	if (!wants)
+		return;
+	cached = contains_cache_at(cache, commit);
+	if (*cached)
+		return;
+	reaches = bitmap_commit_reaches(filter->internal.bitmap_git,
+					commit, wants);
+	if (reaches < 0)
+		return;
+	*cached = reaches ? CONTAINS_YES : CONTAINS_NO;
+	filter->internal.bitmapped_nr++;
+}
+
+static void clear_contains_bitmaps(struct ref_filter *filter)
+{
+	if (filter->internal.bitmapped_nr)
+		trace2_data_intmax("ref-filter", the_repository,
+				   "contains/bitmapped",
+				   filter->internal.bitmapped_nr);
+	bitmap_free(filter->internal.contains_bitmap);
+	bitmap_free(filter->internal.no_contains_bitmap);
+	free_bitmap_index(filter->internal.bitmap_git);
+	filter->internal.contains_bitmap = NULL;
+	filter->internal.no_contains_bitmap = NULL;
+	filter->internal.bitmap_git = NULL;
+	filter->internal.bitmapped_nr = 0;
+}
+
 static struct ref_array_item *apply_ref_filter(const char *refname, const char *referent, const struct object_id *oid,
 			    int flag, struct ref_filter *filter)
 {
@@ -2889,6 +2955,12 @@ static struct ref_array_item *apply_ref_filter(const char *refname, const char *
 		commit = lookup_commit_reference_gently(the_repository, oid, 1);
 		if (!commit)
 			return NULL;
+		contains_from_bitmap(filter, commit,
+				     filter->internal.contains_bitmap,
+				     &filter->internal.contains_cache);
+		contains_from_bitmap(filter, commit,
+				     filter->internal.no_contains_bitmap,
+				     &filter->internal.no_contains_cache);
 		/* We perform the filtering for the '--contains' option... */
 		if (filter->with_commit &&
 		    !commit_contains(filter, commit, filter->with_commit, &filter->internal.contains_cache))
@@ -3038,6 +3110,63 @@ void ref_array_clear(struct ref_array *array)
 
 #define EXCLUDE_REACHED 0
 #define INCLUDE_REACHED 1
+
+/*
+ * Like reach_filter(), but with a single bitmap of everything reachable
+ * from "check_reachable", so that each ref is a lookup instead of being
+ * part of a walk. Returns -1 if bitmaps are not available.
+ */
+static int reach_filter_bitmap(struct ref_array *array,
+			       struct commit_list *check_reachable,
+			       int include_reached)
+{
+	struct bitmap_index *bitmap_git;
+	struct bitmap *reachable = NULL;
+	struct commit_list *p;
+	int i, old_nr, ret = -1;
+
+	/* See prepare_contains_bitmaps(). */
+	if (!commit_graph_compatible(the_repository))
+		return -1;
+	bitmap_git = prepare_bitmap_git(the_repository);
+	if (!bitmap_git)
+		return -1;
+
+	trace2_region_enter("ref-filter", "reach_filter/bitmap", the_repository);
+	for (p = check_reachable; p; p = p->next) {
+		struct bitmap *one = bitmap_reachable_from(bitmap_git, p->item);
+
+		if (!one)
+			goto cleanup;
+		if (!reachable) {
+			reachable = one;
+		} else {
+			bitmap_or(reachable, one);
+			bitmap_free(one);
+		}
+	}
+
+	old_nr = array->nr;
+	array->nr = 0;
+	for (i = 0; i < old_nr; i++) {
+		struct ref_array_item *item = array->items[i];
+		int is_merged = bitmap_walk_contains(bitmap_git, reachable,
+						     &item->commit->object.oid);
+
+		if (is_merged == include_reached)
+			array->items[array->nr++] = item;
+		else
+			free_array_item(item);
+	}
+	ret = 0;
+
+cleanup:
+	trace2_region_leave("ref-filter", "reach_filter/bitmap", the_repository);
+	bitmap_free(reachable);
+	free_bitmap_index(bitmap_git);
+	return ret;
+}
+
 static void reach_filter(struct ref_array *array,
 			 struct commit_list **check_reachable,
 			 int include_reached)
@@ -3048,6 +3177,12 @@ static void reach_filter(struct ref_array *array,
 	if (!*check_reachable)
 		return;
 
+	if (!reach_filter_bitmap(array, *check_reachable, include_reached)) {
+		free_commit_list(*check_reachable);
+		*check_reachable = NULL;
+		return;
+	}
+
 	CALLOC_ARRAY(to_clear, array->nr);
 	for (i = 0; i < array->nr; i++) {
 		struct ref_array_item *item = array->items[i];
@@ -3195,6 +3330,7 @@ static int do_filter_refs(struct ref_filter *filter, unsigned int type, each_ref
 
 	init_contains_cache(&filter->internal.contains_cache);
 	init_contains_cache(&filter->internal.no_contains_cache);
+	prepare_contains_bitmaps(filter);
 
 	/*  Simple per-ref filtering */
 	if (!filter->kind)
@@ -3233,6 +3369,7 @@ static int do_filter_refs(struct ref_filter *filter, unsigned int type, each_ref
 
 	clear_contains_cache(&filter->internal.contains_cache);
 	clear_contains_cache(&filter->internal.no_contains_cache);
+	clear_contains_bitmaps(filter);
 
 	return ret;
 }
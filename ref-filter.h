@@ -30,6 +30,8 @@
 struct atom_value;
 struct ref_sorting;
 struct ahead_behind_count;
+struct bitmap;
+struct bitmap_index;
 struct option;
 
 enum ref_sorting_order {
@@ -83,6 +85,12 @@ struct ref_filter {
 	struct {
 		struct contains_cache contains_cache;
 		struct contains_cache no_contains_cache;
+
+		/* see prepare_contains_bitmaps() */
+		struct bitmap_index *bitmap_git;
+		struct bitmap *contains_bitmap;
+		struct bitmap *no_contains_bitmap;
+		int bitmapped_nr;
 	} internal;
 };
 
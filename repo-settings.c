@@ -115,6 +115,8 @@ void prepare_repo_settings(struct repository *r)
 			r->settings.fetch_negotiation_algorithm = FETCH_NEGOTIATION_NOOP;
 		else if (!strcasecmp(strval, "consecutive"))
 			r->settings.fetch_negotiation_algorithm = FETCH_NEGOTIATION_CONSECUTIVE;
+		else if (!strcasecmp(strval, "bloom"))
+			r->settings.fetch_negotiation_algorithm = FETCH_NEGOTIATION_BLOOM;
 		else if (!strcasecmp(strval, "default"))
 			r->settings.fetch_negotiation_algorithm = fetch_default;
 		else
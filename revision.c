@@ -44,6 +44,8 @@
 #include "hashmap.h"
 #include "utf8.h"
 #include "bloom.h"
+#include "changed-dirs.h"
+#include "log-cache.h"
 #include "json-writer.h"
 #include "list-objects-filter-options.h"
 #include "resolve-undo.h"
@@ -783,6 +785,92 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 	free(path_alloc);
 }
 
+static int changed_dirs_atexit_registered;
+static unsigned int count_changed_dirs_maybe;
+static unsigned int count_changed_dirs_definitely_not;
+static unsigned int count_changed_dirs_false_positive;
+static unsigned int count_changed_dirs_not_present;
+
+static void trace2_changed_dirs_statistics_atexit(void)
+{
+	struct json_writer jw = JSON_WRITER_INIT;
+
+	jw_object_begin(&jw, 0);
+	jw_object_intmax(&jw, "summary_not_present", count_changed_dirs_not_present);
+	jw_object_intmax(&jw, "maybe", count_changed_dirs_maybe);
+	jw_object_intmax(&jw, "definitely_not", count_changed_dirs_definitely_not);
+	jw_object_intmax(&jw, "false_positive", count_changed_dirs_false_positive);
+	jw_end(&jw);
+
+	trace2_data_json("changed-dirs", the_repository, "statistics", &jw);
+
+	jw_release(&jw);
+}
+
+/*
+ * Changed-directory summaries can be used with any pathspec, including
+ * the wildcard ones for which Bloom filters are forbidden, as long as
+ * the paths it matches are known to start with some literal components.
+ */
+static void prepare_to_use_changed_dirs(struct rev_info *revs)
+{
+	struct pathspec *spec = &revs->prune_data;
+	int i;
+
+	if (!revs->commits || !spec->nr)
+		return;
+
+	repo_parse_commit(revs->repo, revs->commits->item);
+	if (!repo_has_changed_dirs(revs->repo))
+		return;
+	revs->use_changed_dirs = 1;
+
+	if (trace2_is_enabled() && !changed_dirs_atexit_registered) {
+		atexit(trace2_changed_dirs_statistics_atexit);
+		changed_dirs_atexit_registered = 1;
+	}
+
+	ALLOC_ARRAY(revs->changed_dirs_keys, spec->nr);
+	for (i = 0; i < spec->nr; i++) {
+		if (fill_changed_dirs_key(&spec->items[i],
+					  &revs->changed_dirs_keys[i])) {
+			FREE_AND_NULL(revs->changed_dirs_keys);
+			return;
+		}
+	}
+	revs->changed_dirs_keys_nr = spec->nr;
+}
+
+static int check_maybe_different_in_changed_dirs(struct rev_info *revs,
+						 struct commit *commit)
+{
+	struct changed_dirs dirs;
+	int result = 0, j;
+
+	if (commit_graph_generation(commit) == GENERATION_NUMBER_INFINITY)
+		return -1;
+
+	if (!load_changed_dirs(revs->repo, commit, &dirs)) {
+		count_changed_dirs_not_present++;
+		return -1;
+	}
+
+	/* A commit changing nothing is TREESAME whatever the pathspec. */
+	if (changed_dirs_root_changes(&dirs)) {
+		result = !revs->changed_dirs_keys_nr;
+		for (j = 0; !result && j < revs->changed_dirs_keys_nr; j++)
+			result = changed_dirs_contains(&dirs,
+						       &revs->changed_dirs_keys[j]);
+	}
+
+	if (result)
+		count_changed_dirs_maybe++;
+	else
+		count_changed_dirs_definitely_not++;
+
+	return result;
+}
+
 static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 						 struct commit *commit)
 {
@@ -822,6 +910,7 @@ static int rev_compare_tree(struct rev_info *revs,
 	struct tree *t1 = repo_get_commit_tree(the_repository, parent);
 	struct tree *t2 = repo_get_commit_tree(the_repository, commit);
 	int bloom_ret = 1;
+	int dirs_ret = -1;
 
 	if (!t1)
 		return REV_TREE_NEW;
@@ -853,13 +942,23 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	if (revs->use_changed_dirs && !nth_parent) {
+		dirs_ret = check_maybe_different_in_changed_dirs(revs, commit);
+
+		if (dirs_ret == 0)
+			return REV_TREE_SAME;
+	}
+
 	tree_difference = REV_TREE_SAME;
 	revs->pruning.flags.has_changes = 0;
 	diff_tree_oid(&t1->object.oid, &t2->object.oid, "", &revs->pruning);
 
-	if (!nth_parent)
-		if (bloom_ret == 1 && tree_difference == REV_TREE_SAME)
+	if (!nth_parent && tree_difference == REV_TREE_SAME) {
+		if (bloom_ret == 1)
 			count_bloom_filter_false_positive++;
+		if (dirs_ret == 1)
+			count_changed_dirs_false_positive++;
+	}
 
 	return tree_difference;
 }
@@ -869,6 +968,7 @@ static int rev_same_tree_as_empty(struct rev_info *revs, struct commit *commit,
 {
 	struct tree *t1 = repo_get_commit_tree(the_repository, commit);
 	int bloom_ret = -1;
+	int dirs_ret = -1;
 
 	if (!t1)
 		return 0;
@@ -879,12 +979,23 @@ static int rev_same_tree_as_empty(struct rev_info *revs, struct commit *commit,
 			return 1;
 	}
 
+	/* The summary of a root commit is relative to the empty tree. */
+	if (!nth_parent && revs->use_changed_dirs && !commit->parents) {
+		dirs_ret = check_maybe_different_in_changed_dirs(revs, commit);
+		if (!dirs_ret)
+			return 1;
+	}
+
 	tree_difference = REV_TREE_SAME;
 	revs->pruning.flags.has_changes = 0;
 	diff_tree_oid(NULL, &t1->object.oid, "", &revs->pruning);
 
-	if (bloom_ret == 1 && tree_difference == REV_TREE_SAME)
-		count_bloom_filter_false_positive++;
+	if (tree_difference == REV_TREE_SAME) {
+		if (bloom_ret == 1)
+			count_bloom_filter_false_positive++;
+		if (dirs_ret == 1)
+			count_changed_dirs_false_positive++;
+	}
 
 	return tree_difference == REV_TREE_SAME;
 }
@@ -3249,6 +3360,10 @@ void release_revisions(struct rev_info *revs)
 		clear_bloom_key(&revs->bloom_keys[i]);
 	FREE_AND_NULL(revs->bloom_keys);
 	revs->bloom_keys_nr = 0;
+	FREE_AND_NULL(revs->changed_dirs_keys);
+	revs->changed_dirs_keys_nr = 0;
+	free_log_cache(revs->log_cache);
+	revs->log_cache = NULL;
 }
 
 static void add_child(struct rev_info *revs, struct commit *parent, struct commit *child)
@@ -3941,10 +4056,14 @@ int prepare_revision_walk(struct rev_info *revs)
 				       FOR_EACH_OBJECT_PROMISOR_ONLY);
 	}
 
-	if (!revs->reflog_info)
+	if (!revs->reflog_info) {
 		prepare_to_use_bloom_filter(revs);
+		prepare_to_use_changed_dirs(revs);
+	}
 	if (!revs->unsorted_input)
 		commit_list_sort_by_date(&revs->commits);
+	if (revs->use_log_cache)
+		revs->log_cache = prepare_log_cache(revs);
 	if (revs->no_walk)
 		return 0;
 	if (revs->limited) {
@@ -4302,6 +4421,12 @@ static struct commit *get_revision_1(struct rev_info *revs)
 	while (1) {
 		struct commit *commit;
 
+		if (revs->log_cache) {
+			commit = log_cache_next(revs->log_cache);
+			if (commit)
+				return commit;
+		}
+
 		if (revs->reflog_info)
 			commit = next_reflog_entry(revs->reflog_info);
 		else if (revs->topo_walk_info)
@@ -4309,8 +4434,20 @@ static struct commit *get_revision_1(struct rev_info *revs)
 		else
 			commit = pop_commit(&revs->commits);
 
-		if (!commit)
+		if (!commit) {
+			if (revs->log_cache)
+				log_cache_finish(revs->log_cache);
 			return NULL;
+		}
+
+		/*
+		 * The rest of the walk from here is the walk the log cache
+		 * recorded, if it did from this commit.
+		 */
+		if (revs->log_cache &&
+		    log_cache_start_replay(revs->log_cache, commit,
+					   !revs->commits))
+			continue;
 
 		if (revs->reflog_info)
 			commit->object.flags &= ~(ADDED | SEEN | SHOWN);
@@ -4345,6 +4482,8 @@ static struct commit *get_revision_1(struct rev_info *revs)
 		default:
 			if (revs->track_linear)
 				track_linear(revs, commit);
+			if (revs->log_cache)
+				log_cache_add(revs->log_cache, commit);
 			return commit;
 		}
 	}
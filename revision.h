@@ -64,6 +64,8 @@ struct string_list;
 struct saved_parents;
 struct bloom_key;
 struct bloom_filter_settings;
+struct changed_dirs_key;
+struct log_cache;
 struct option;
 struct parse_opt_ctx_t;
 define_shared_commit_slab(revision_sources, char *);
@@ -370,6 +372,22 @@ struct rev_info {
 	 */
 	struct bloom_filter_settings *bloom_filter_settings;
 
+	/*
+	 * Commit graph changed-directory summary fields: whether the
+	 * summaries are used, and a key for each pathspec element (none
+	 * if an element may match any path).
+	 */
+	int use_changed_dirs;
+	struct changed_dirs_key *changed_dirs_keys;
+	int changed_dirs_keys_nr;
+
+	/*
+	 * Whether the output of pathspec-limited walks may be replayed
+	 * from (and saved to) the log cache, and the cache of this walk.
+	 */
+	int use_log_cache;
+	struct log_cache *log_cache;
+
 	/* misc. flags related to '--no-kept-objects' */
 	unsigned keep_pack_cache_flags;
 
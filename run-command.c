@@ -985,6 +985,139 @@ int start_command(struct child_process *cmd)
 	return 0;
 }
 
+#ifndef GIT_WINDOWS_NATIVE
+static NORETURN void die_forked_child(const char *err, va_list params)
+{
+	get_die_message_routine()(err, params);
+	_exit(128);
+}
+
+int start_forked_command(struct child_process *cmd,
+			 int (*fn)(int argc, const char **argv))
+{
+	int need_in, need_out, need_err;
+	int fdin[2], fdout[2], fderr[2];
+	int status;
+
+	if (cmd->no_stdin || cmd->no_stdout || cmd->no_stderr ||
+	    cmd->stdout_to_stderr || cmd->dir || cmd->env.nr)
+		BUG("start_forked_command() only supports plain redirections");
+
+	need_in = cmd->in < 0;
+	if (need_in) {
+		if (pipe(fdin) < 0)
+			goto fail_pipe;
+		cmd->in = fdin[1];
+	}
+
+	need_out = cmd->out < 0;
+	if (need_out) {
+		if (pipe(fdout) < 0) {
+			if (need_in)
+				close_pair(fdin);
+			goto fail_pipe;
+		}
+		cmd->out = fdout[0];
+	}
+
+	need_err = cmd->err < 0;
+	if (need_err) {
+		if (pipe(fderr) < 0) {
+			if (need_in)
+				close_pair(fdin);
+			if (need_out)
+				close_pair(fdout);
+			goto fail_pipe;
+		}
+		cmd->err = fderr[0];
+	}
+
+	trace2_child_start(cmd);
+	trace_run_command(cmd);
+
+	/* Flush stdio before fork() to avoid cloning buffers */
+	fflush(NULL);
+
+	cmd->pid = fork();
+	if (cmd->pid < 0) {
+		int failed_errno = errno;
+
+		error_errno("cannot fork() for %s", cmd->args.v[0]);
+		if (need_in)
+			close_pair(fdin);
+		if (need_out)
+			close_pair(fdout);
+		if (need_err)
+			close_pair(fderr);
+		trace2_child_exit(cmd, -1);
+		child_process_clear(cmd);
+		errno = failed_errno;
+		return -1;
+	}
+	if (!cmd->pid) {
+		if (need_in) {
+			dup2(fdin[0], 0);
+			close_pair(fdin);
+		} else if (cmd->in) {
+			dup2(cmd->in, 0);
+			close(cmd->in);
+		}
+
+		if (need_err) {
+			dup2(fderr[1], 2);
+			close_pair(fderr);
+		} else if (cmd->err > 1) {
+			dup2(cmd->err, 2);
+			close(cmd->err);
+		}
+
+		if (need_out) {
+			dup2(fdout[1], 1);
+			close_pair(fdout);
+		} else if (cmd->out > 1) {
+			dup2(cmd->out, 1);
+			close(cmd->out);
+		}
+
+		/*
+		 * The exit handlers we inherited belong to the parent: they
+		 * would e.g. log a second trace2 exit event under its session
+		 * id and kill its clean_on_exit children. Do not run them,
+		 * neither when fn() returns nor when it dies.
+		 */
+		set_die_routine(die_forked_child);
+		status = fn(cmd->args.nr, cmd->args.v);
+		fflush(NULL);
+		_exit(status);
+	}
+
+	if (cmd->clean_on_exit)
+		mark_child_for_cleanup(cmd->pid, cmd);
+
+	if (need_in)
+		close(fdin[0]);
+	else if (cmd->in)
+		close(cmd->in);
+
+	if (need_out)
+		close(fdout[1]);
+	else if (cmd->out)
+		close(cmd->out);
+
+	if (need_err)
+		close(fderr[1]);
+	else if (cmd->err)
+		close(cmd->err);
+
+	return 0;
+
+fail_pipe:
+	error_errno("cannot create pipe for %s", cmd->args.v[0]);
+	child_process_clear(cmd);
+	return -1;
+}
+#endif
+
 int finish_command(struct child_process *cmd)
 {
 	int ret = wait_or_whine(cmd->pid, cmd->args.v[0], 0);
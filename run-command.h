@@ -207,6 +207,23 @@ char *git_shell_path(void);
  */
 int start_command(struct child_process *);
 
+#ifndef GIT_WINDOWS_NATIVE
+/**
+ * Like start_command(), but instead of exec'ing a new program, fork the
+ * current process and call `fn` with `.args` in the child, exiting with
+ * its return value (or 128 if it dies) without running the exit handlers
+ * of the parent. The child inherits everything the caller has already
+ * loaded (configuration, mapped packfiles, the commit-graph, ...), which
+ * saves the start-up cost of a separate git process.
+ *
+ * Only `.in`, `.out`, `.err` and `.clean_on_exit` are honored. Use
+ * finish_command() to wait for the child as usual. The caller must not
+ * have any threads running.
+ */
+int start_forked_command(struct child_process *cmd,
+			 int (*fn)(int argc, const char **argv));
+#endif
+
 /**
  * Wait for the completion of a sub-process that was started with
  * start_command().
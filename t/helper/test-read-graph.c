@@ -34,6 +34,12 @@ static void dump_graph_info(struct commit_graph *graph)
 		printf(" bloom_indexes");
 	if (graph->chunk_bloom_data)
 		printf(" bloom_data");
+	if (graph->chunk_changed_dirs_index)
+		printf(" changed_dirs_index");
+	if (graph->chunk_changed_dirs_data)
+		printf(" changed_dirs_data");
+	if (graph->chunk_reachability_index)
+		printf(" reachability_index");
 	printf("\n");
 
 	printf("options:");
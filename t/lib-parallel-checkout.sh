@@ -2,6 +2,7 @@
 
 # Parallel checkout tests need full control of the number of workers
 unset GIT_TEST_CHECKOUT_WORKERS
+unset GIT_TEST_CHECKOUT_PIPELINE
 
 set_checkout_config () {
 	if test $# -ne 2
@@ -57,6 +57,22 @@ test_perf "read-tree br_ballast_plus_1 ($nr_files)" '
 	done
 '
 
+test_perf "read-tree -m br_ballast br_ballast ($nr_files)" '
+	# Every tree matches the cache-tree, so nothing needs to be
+	# read from the object database.
+	for i in $(test_seq 100)
+	do
+		git read-tree -n -m br_ballast br_ballast || return 1
+	done
+'
+
+test_perf "read-tree --reset br_ballast ($nr_files)" '
+	for i in $(test_seq 100)
+	do
+		git read-tree -n --reset br_ballast || return 1
+	done
+'
+
 test_perf "switch between br_base br_ballast ($nr_files)" '
 	git checkout -q br_base &&
 	git checkout -q br_ballast
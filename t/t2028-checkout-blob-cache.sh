@@ -0,0 +1,123 @@
+#!/bin/sh
+
+test_description='checkout from a shared blob cache'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	echo "*.crlf text eol=crlf" >.gitattributes &&
+	printf "one\ntwo\n" >text.crlf &&
+	echo content >file &&
+	mkdir dir &&
+	echo other >dir/file &&
+	echo "#!/bin/sh" >script &&
+	chmod +x script &&
+	git add . &&
+	git commit -m initial &&
+	git branch -M main &&
+	git ls-files >expect-files &&
+	git clone -q . expect
+'
+
+checkout_with_cache () {
+	rm -rf "$1" &&
+	git clone -q --no-checkout . "$1" &&
+	git -C "$1" -c checkout.blobCache="$(pwd)/cache" \
+		-c checkout.blobCacheMode="$2" checkout -q main
+}
+
+verify_worktree () {
+	for f in $(cat expect-files)
+	do
+		test_cmp_bin "expect/$f" "$1/$f" || return 1
+	done &&
+	test -x "$1/script" &&
+	git -C "$1" status --porcelain >status &&
+	test_must_be_empty status
+}
+
+link_count () {
+	ls -l "$1" | sed -e "s/^[^ ]* *\([0-9]*\) .*/\1/"
+}
+
+test_expect_success 'first checkout populates the cache' '
+	checkout_with_cache first hardlink &&
+	verify_worktree first &&
+	find cache -type f >cached &&
+	test_line_count = 4 cached &&
+	test 1 = "$(link_count first/file)"
+'
+
+test_expect_success !MINGW 'hardlink mode links files from the cache' '
+	checkout_with_cache second hardlink &&
+	verify_worktree second &&
+	test 2 = "$(link_count second/file)" &&
+	test 2 = "$(link_count second/script)" &&
+	find cache -type f >cached &&
+	test_line_count = 4 cached
+'
+
+test_expect_success 'only files written as their blob are cached' '
+	test 1 = "$(link_count second/text.crlf)" &&
+	rm -rf third &&
+	git clone -q --no-checkout . third &&
+	echo "*.crlf text eol=lf" >third/.git/info/attributes &&
+	git -C third -c checkout.blobCache="$(pwd)/cache" \
+		-c checkout.blobCacheMode=hardlink checkout -q main &&
+	printf "one\ntwo\n" >expect-lf &&
+	test_cmp_bin expect-lf third/text.crlf &&
+	find cache -type f >cached &&
+	test_line_count = 5 cached
+'
+
+test_expect_success 'reflink mode falls back to regular writes' '
+	checkout_with_cache reflink reflink &&
+	verify_worktree reflink &&
+	test 1 = "$(link_count reflink/file)"
+'
+
+test_expect_success 'parallel checkout uses the cache' '
+	rm -rf parallel &&
+	git clone -q --no-checkout . parallel &&
+	git -C parallel -c checkout.blobCache="$(pwd)/cache" \
+		-c checkout.blobCacheMode=hardlink \
+		-c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+		checkout -q main &&
+	verify_worktree parallel &&
+	if test_have_prereq !MINGW
+	then
+		# cache, second, third and parallel
+		test 4 = "$(link_count parallel/dir/file)"
+	fi
+'
+
+test_expect_success 'invalid checkout.blobCacheMode' '
+	rm -rf invalid &&
+	git clone -q --no-checkout . invalid &&
+	test_must_fail git -C invalid -c checkout.blobCache="$(pwd)/cache" \
+		-c checkout.blobCacheMode=bogus checkout -q main 2>err &&
+	test_grep "invalid value for .checkout.blobCacheMode." err
+'
+
+test_expect_success POSIXPERM 'cache directories are private' '
+	test_write_lines drwx------ drwx------ >expect-modes &&
+	ls -ld cache "$(dirname "$(head -n 1 cached)")" >out &&
+	cut -c1-10 out >actual &&
+	test_cmp expect-modes actual
+'
+
+test_expect_success 'corrupt cache entries are detected' '
+	entry=cache/$(git rev-parse HEAD:file | sed "s|^..|&/|") &&
+	test_path_is_file $entry &&
+	chmod u+w $entry &&
+	echo poisoned >$entry &&
+	chmod a-w $entry &&
+	checkout_with_cache poisoned hardlink 2>err &&
+	test_grep "ignoring corrupt blob cache entry" err &&
+	verify_worktree poisoned &&
+	test_cmp_bin expect/file $entry &&
+	checkout_with_cache reflink-poisoned reflink &&
+	verify_worktree reflink-poisoned
+'
+
+test_done
@@ -274,4 +274,67 @@ test_expect_success '"git checkout ." report should not include failed entries'
 	)
 '
 
+test_expect_success 'pipelined writes produce the same working tree' '
+	git init pipeline &&
+	(
+		cd pipeline &&
+		cat >.gitattributes <<-\EOF &&
+		*.crlf text eol=crlf
+		*.ident ident
+		EOF
+		for i in 1 2 3 4 5 6 7 8 9 10
+		do
+			printf "line %d\nline\n" $i >file$i.crlf &&
+			echo "\$Id\$ $i" >file$i.ident &&
+			test_seq 1000 $i >file$i.large &&
+			echo $i >file$i || return 1
+		done &&
+		git add . &&
+		git commit -m files &&
+		rm -f file* &&
+		git checkout . &&
+		mkdir ../pipeline-expect &&
+		cp file* ../pipeline-expect/
+	) &&
+
+	for workers in 1 2
+	do
+		rm -rf pipeline/file* &&
+		set_checkout_config $workers 0 &&
+		test_env GIT_TEST_CHECKOUT_PIPELINE=1 \
+			test_checkout_workers $((workers > 1 ? workers : 0)) \
+			git -C pipeline -c core.bigFileThreshold=1k checkout . &&
+		for f in pipeline-expect/*
+		do
+			test_cmp_bin $f pipeline/${f#pipeline-expect/} || return 1
+		done
+	done
+'
+
+test_expect_success 'checkout.pipeline reads blobs ahead in sequential checkout' '
+	rm -f pipeline/file* pipeline.trace &&
+	set_checkout_config 1 0 &&
+	GIT_TRACE2_EVENT="$(pwd)/pipeline.trace" \
+		git -C pipeline -c checkout.pipeline=true checkout . &&
+	grep "\"label\":\"pipeline\"" pipeline.trace &&
+	for f in pipeline-expect/*
+	do
+		test_cmp_bin $f pipeline/${f#pipeline-expect/} || return 1
+	done
+'
+
+test_expect_success 'checkout.workers=1 stays sequential by default' '
+	rm -f pipeline/file* pipeline.trace &&
+	set_checkout_config 1 0 &&
+	GIT_TRACE2_EVENT="$(pwd)/pipeline.trace" git -C pipeline checkout . &&
+	! grep "\"category\":\"pcheckout\"" pipeline.trace &&
+	verify_checkout pipeline &&
+
+	rm -f pipeline/file* pipeline.trace &&
+	GIT_TRACE2_EVENT="$(pwd)/pipeline.trace" \
+		git -C pipeline -c checkout.pipeline=false checkout . &&
+	! grep "\"category\":\"pcheckout\"" pipeline.trace &&
+	verify_checkout pipeline
+'
+
 test_done
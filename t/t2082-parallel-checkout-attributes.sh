@@ -188,4 +188,157 @@ test_expect_success 'parallel-checkout and delayed checkout' '
 	test_cmp delayed/Z original
 '
 
+# Filters declared as parallel-safe are run by the workers, each of which
+# starts its own instance of a long-running process filter.
+#
+test_expect_success 'parallel-checkout with a parallel process filter' '
+	test_config_global filter.prot.process \
+		"test-tool rot13-filter --log=\"$(pwd)/prot.log\" clean smudge" &&
+	test_config_global filter.prot.required true &&
+	test_config_global filter.prot.parallel true &&
+
+	echo "abcd" >original &&
+	echo "nopq" >rot13 &&
+
+	git init parallel-filter &&
+	(
+		cd parallel-filter &&
+		echo "*.r filter=prot" >.gitattributes &&
+		for f in A B C D
+		do
+			cp ../original $f.r || return 1
+		done &&
+		git add -A &&
+		git commit -m parallel-filter &&
+		git cat-file -p :A.r >A.internal &&
+		test_cmp ../rot13 A.internal &&
+		rm *.r A.internal
+	) &&
+
+	set_checkout_config 2 0 &&
+	GIT_TRACE2="$(pwd)/trace" git -C parallel-filter checkout -f &&
+	grep "child_start.* git checkout--worker" trace >workers &&
+	test_line_count = 2 workers &&
+	grep "child_start.*test-tool rot13-filter" trace >filters &&
+	test_line_count = 2 filters &&
+	for f in A B C D
+	do
+		test_cmp original parallel-filter/$f.r || return 1
+	done &&
+	git -C parallel-filter status --porcelain >status &&
+	test_must_be_empty status
+'
+
+test_expect_success 'parallel-checkout with a parallel filter delaying entries' '
+	test_config_global filter.pdelay.process \
+		"test-tool rot13-filter --always-delay --log=\"$(pwd)/pdelay.log\" clean smudge delay" &&
+	test_config_global filter.pdelay.required true &&
+	test_config_global filter.pdelay.parallel true &&
+
+	echo "abcd" >original &&
+
+	git init parallel-delay &&
+	(
+		cd parallel-delay &&
+		echo "*.d filter=pdelay" >.gitattributes &&
+		for f in A B C D
+		do
+			cp ../original $f.d || return 1
+		done &&
+		git add -A &&
+		git commit -m parallel-delay &&
+		rm *.d
+	) &&
+
+	rm -f pdelay.log &&
+	set_checkout_config 2 0 &&
+	test_checkout_workers 2 git -C parallel-delay checkout -f &&
+	for f in A B C D
+	do
+		grep "smudge $f.d .* \[DELAYED\]" pdelay.log &&
+		test_cmp original parallel-delay/$f.d || return 1
+	done &&
+	git -C parallel-delay status --porcelain >status &&
+	test_must_be_empty status
+'
+
+# "git add" hands the files of a parallel filter to several instances of
+# it, with as many processes as add.filterPrefetch.
+#
+test_expect_success 'git add with a parallel process filter' '
+	test_config_global filter.pclean.process \
+		"test-tool rot13-filter --log=\"$(pwd)/pclean.log\" clean smudge" &&
+	test_config_global filter.pclean.required true &&
+	test_config_global filter.pclean.parallel true &&
+	test_config_global add.filterPrefetch 2 &&
+
+	echo "abcd" >original &&
+	echo "nopq" >rot13 &&
+	echo "efgh" >modified &&
+	echo "rstu" >modified.rot13 &&
+
+	git init parallel-clean &&
+	(
+		cd parallel-clean &&
+		echo "*.c filter=pclean" >.gitattributes &&
+		for f in A B C D
+		do
+			cp ../original $f.c || return 1
+		done &&
+		test-tool chmtime =-60 *.c &&
+		GIT_TRACE2_EVENT="$(pwd)/../add.trace" git add -A &&
+		for f in A B C D
+		do
+			git cat-file -p :$f.c >actual &&
+			test_cmp ../rot13 actual || return 1
+		done &&
+
+		cp ../modified A.c &&
+		cp ../modified C.c &&
+		GIT_TRACE2_EVENT="$(pwd)/../update.trace" git add -u &&
+		for f in A C
+		do
+			git cat-file -p :$f.c >actual &&
+			test_cmp ../modified.rot13 actual || return 1
+		done &&
+		git cat-file -p :B.c >actual &&
+		test_cmp ../rot13 actual
+	) &&
+
+	grep "child_start.*test-tool rot13-filter" add.trace >filters &&
+	test_line_count = 2 filters &&
+	grep "prefetch_clean/cleaned.*\"value\":\"4\"" add.trace &&
+	grep "child_start.*test-tool rot13-filter" update.trace >filters &&
+	test_line_count = 2 filters &&
+	grep "prefetch_clean/cleaned.*\"value\":\"2\"" update.trace
+'
+
+test_expect_success 'git add does not prefetch with checkout.workers alone' '
+	test_config_global filter.pclean.process \
+		"test-tool rot13-filter --log=\"$(pwd)/pclean.log\" clean smudge" &&
+	test_config_global filter.pclean.required true &&
+	test_config_global filter.pclean.parallel true &&
+	set_checkout_config 2 0 &&
+
+	git init sequential-clean &&
+	(
+		cd sequential-clean &&
+		echo "*.c filter=pclean" >.gitattributes &&
+		for f in A B C D
+		do
+			cp ../original $f.c || return 1
+		done &&
+		GIT_TRACE2_EVENT="$(pwd)/../sequential.trace" git add -A &&
+		for f in A B C D
+		do
+			git cat-file -p :$f.c >actual &&
+			test_cmp ../rot13 actual || return 1
+		done
+	) &&
+
+	grep "child_start.*test-tool rot13-filter" sequential.trace >filters &&
+	test_line_count = 1 filters &&
+	! grep "prefetch_clean" sequential.trace
+'
+
 test_done
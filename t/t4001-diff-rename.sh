@@ -309,4 +309,162 @@ test_expect_success 'last line matters too' '
 	test_cmp expected actual.munged
 '
 
+test_expect_success 'diff.renameCache records and reuses similarity scores' '
+	test_when_finished "git update-ref -d refs/notes/renames" &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >cache-src &&
+	git add cache-src &&
+	git commit -m "add cache-src" &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 changed >cache-dst &&
+	git rm -q cache-src &&
+	git add cache-dst &&
+	git commit -m "rename cache-src -> cache-dst" &&
+
+	git diff-tree -r -M --name-status HEAD^ HEAD >expect &&
+	test_must_fail git rev-parse --verify refs/notes/renames &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep "^R[0-9]*	cache-src	cache-dst" actual &&
+	git ls-tree -r refs/notes/renames >notes &&
+	test_line_count = 1 notes &&
+	git cat-file blob $(cut -d" " -f3 notes | cut -f1) >row &&
+	grep "^30000$" row &&
+	grep "^0 [0-9]*$" row &&
+
+	# Pretend that no source reached the minimum score; the cached
+	# row must be used instead of comparing the blobs again.
+	empty=$(echo 30000 | git hash-object -w --stdin) &&
+	sed -e "s/blob [0-9a-f]*/blob $empty/" notes >notes.empty &&
+	tree=$(git mktree <notes.empty) &&
+	commit=$(git commit-tree -m "rename scores v3" $tree) &&
+	git update-ref refs/notes/renames $commit &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	cat >expect <<-\EOF &&
+	A	cache-dst
+	D	cache-src
+	EOF
+	test_cmp expect actual &&
+
+	# A row computed with a higher minimum score is not used for a
+	# lower one.
+	git -c diff.renameCache=true \
+		diff-tree -r -M20% --name-status HEAD^ HEAD >actual &&
+	grep "^R[0-9]*	cache-src	cache-dst" actual &&
+
+	# Without the setting the cache is ignored.
+	git update-ref refs/notes/renames $commit &&
+	git diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	grep "^R[0-9]*	cache-src	cache-dst" actual
+'
+
+test_expect_success 'diff.renameCache only records sources reaching the minimum score' '
+	test_when_finished "git update-ref -d refs/notes/renames" &&
+	test_write_lines a b c d e f g h i j >unrelated-src &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >related-src &&
+	git add unrelated-src related-src &&
+	git commit -m "add sources" &&
+	git rm -q unrelated-src related-src &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 X >related-dst &&
+	test_write_lines k l m n o p q r s t >unrelated-dst &&
+	git add related-dst unrelated-dst &&
+	git commit -m "rename with unrelated files" &&
+
+	git diff-tree -r -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git ls-tree -r refs/notes/renames >notes &&
+	test_line_count = 2 notes &&
+	for blob in $(cut -d" " -f3 notes | cut -f1)
+	do
+		git cat-file blob $blob || return 1
+	done >rows &&
+	grep -c " " rows >count &&
+	echo 1 >expect.count &&
+	test_cmp expect.count count &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"inexact renames/cached\",\"value\":\"2\"" trace
+'
+
+test_expect_success 'diff.renameCache does not reuse scores for another mode' '
+	test_when_finished "git update-ref -d refs/notes/renames" &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >mode-src &&
+	git add mode-src &&
+	git commit -m "add mode-src" &&
+	base=$(git rev-parse HEAD) &&
+	git rm -q mode-src &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 X >mode-dst &&
+	git add mode-dst &&
+	git commit -m "rename mode-src -> mode-dst" &&
+	regular=$(git rev-parse HEAD) &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status $base $regular >actual &&
+	grep "^R[0-9]*	mode-src	mode-dst" actual &&
+
+	# The same blob as a symbolic link is no rename destination.
+	git rm -q --cached mode-dst &&
+	git update-index --add --cacheinfo \
+		120000,$(git rev-parse $regular:mode-dst),mode-dst &&
+	git commit -m "mode-dst as a symbolic link" &&
+	test_when_finished "git reset -q --hard $regular" &&
+	symlink=$(git rev-parse HEAD) &&
+	git diff-tree -r -M --name-status $base $symlink >expect &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status $base $symlink >actual &&
+	test_cmp expect actual &&
+	! grep "^R" actual
+'
+
+test_expect_success 'diff.renameCache does not reuse scores for other attributes' '
+	test_when_finished "git update-ref -d refs/notes/renames" &&
+	test_when_finished "rm -f .gitattributes" &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 11 12 >crlf-src &&
+	git add crlf-src &&
+	git commit -m "add crlf-src" &&
+	git rm -q crlf-src &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 11 12 | append_cr >crlf-dst &&
+	git add crlf-dst &&
+	git commit -m "rename crlf-src -> crlf-dst" &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	grep "^R[0-9]*	crlf-src	crlf-dst" actual &&
+
+	# As binary files, the line endings count as changes.
+	echo "crlf-* binary" >.gitattributes &&
+	git diff-tree -r -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true \
+		diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'threaded rename detection finds the same renames' '
+	for i in 1 2 3 4 5 6 7 8
+	do
+		test_seq 1 $((40 + i)) >threads-$i || return 1
+	done &&
+	git add threads-* &&
+	git commit -m "add threads-*" &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		git mv threads-$i moved-$i &&
+		echo change >>moved-$i || return 1
+	done &&
+	git commit -a -m "move threads-* to moved-*" &&
+	GIT_TEST_RENAME_THREADS=1 \
+		git diff-tree -r -M --raw HEAD^ HEAD >expect &&
+	GIT_TEST_RENAME_THREADS=3 \
+		git diff-tree -r -M --raw HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	test_line_count = 8 actual &&
+	GIT_TEST_RENAME_THREADS=3 \
+		git diff-tree -r -C --find-copies-harder --raw HEAD^ HEAD >actual &&
+	GIT_TEST_RENAME_THREADS=1 \
+		git diff-tree -r -C --find-copies-harder --raw HEAD^ HEAD >expect &&
+	test_cmp expect actual
+'
+
 test_done
@@ -725,6 +725,47 @@ test_expect_success 'when writing commit graph, reuse changed-path of another ve
 	test_filter_upgraded 1 trace2.txt
 '
 
+test_expect_success 'Bloom filters computed in threads match serial ones' '
+	git init threaded &&
+	(
+		cd threaded &&
+		git commit --allow-empty -m root &&
+		mkdir -p dir/sub &&
+		echo a >dir/sub/file &&
+		echo a >dir/other &&
+		echo b >file &&
+		git add . &&
+		git commit -m add &&
+		git rm -q -r dir/sub &&
+		echo c >dir/sub &&
+		git add dir/sub &&
+		git commit -m file-to-dir &&
+		test_chmod +x file &&
+		git commit -m mode &&
+		git rm -q file &&
+		git commit -m delete &&
+		for i in $(test_seq 1 600)
+		do
+			echo $i >large-$i || return 1
+		done &&
+		git add . &&
+		git commit -m large &&
+		git update-index --add --cacheinfo 160000,$(git rev-parse HEAD),gitlink &&
+		git commit -m gitlink &&
+
+		GIT_TEST_BLOOM_THREADS=1 \
+			git commit-graph write --reachable --changed-paths &&
+		mv .git/objects/info/commit-graph serial &&
+		GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TEST_BLOOM_THREADS=4 \
+			git commit-graph write --reachable --changed-paths &&
+		test_cmp_bin serial .git/objects/info/commit-graph &&
+		if test_have_prereq PTHREADS
+		then
+			grep "\"key\":\"precomputed\",\"value\":\"6\"" trace2.txt
+		fi
+	)
+'
+
 corrupt_graph () {
 	test_when_finished "rm -rf $graph" &&
 	git commit-graph write --reachable --changed-paths &&
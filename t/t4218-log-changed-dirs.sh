@@ -0,0 +1,167 @@
+#!/bin/sh
+
+test_description='git log for pathspecs with changed-directory summaries'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-chunk.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+graph=.git/objects/info/commit-graph
+
+test_expect_success 'setup' '
+	mkdir -p src/lib src/app doc &&
+	test_commit root README &&
+	test_commit lib1 src/lib/one.c &&
+	test_commit app1 src/app/main.c &&
+	test_commit doc1 doc/guide.txt &&
+	test_commit lib2 src/lib/two.h &&
+	git checkout -b side HEAD~2 &&
+	test_commit side1 src/side.c &&
+	mkdir -p doc &&
+	test_commit side2 doc/side.txt &&
+	git checkout main &&
+	git merge side &&
+	git mv src/app/main.c src/app/main.cc &&
+	git commit -m rename &&
+	git rm -q doc/guide.txt &&
+	echo guide >doc/guide &&
+	git add doc/guide &&
+	git commit -m "replace guide" &&
+	git rm -q doc/guide &&
+	mkdir doc/guide &&
+	echo deep >doc/guide/deep.txt &&
+	git add doc/guide &&
+	git commit -m "file to directory" &&
+	test_chmod +x src/lib/one.c &&
+	git commit -m mode &&
+	git commit --allow-empty -m empty &&
+	for i in $(test_seq 1 600)
+	do
+		echo $i >src/app/f$i.c || return 1
+	done &&
+	git add src/app &&
+	git commit -m many &&
+	test_commit top Makefile &&
+	mkdir -p src/Ext.D &&
+	echo ext >src/Ext.D/file &&
+	git add src/Ext.D &&
+	git commit -m "directory with extension" &&
+	test_commit upper src/lib/Upper.H
+'
+
+test_expect_success 'summaries are not written by default' '
+	git commit-graph write --reachable --changed-paths &&
+	test-tool read-graph >out &&
+	! grep changed_dirs out
+'
+
+test_expect_success 'commit-graph write stores summaries' '
+	git -c commitGraph.changedDirectories=true \
+		commit-graph write --reachable --changed-paths &&
+	test-tool read-graph >out &&
+	grep "changed_dirs_index changed_dirs_data" out
+'
+
+test_log_matches () {
+	rm -f trace.perf &&
+	git -c core.commitGraph=false log --format=%s "$@" >expect &&
+	GIT_TRACE2_PERF="$(pwd)/trace.perf" git log --format=%s "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_summaries_used () {
+	test_log_matches "$@" &&
+	grep "changed-dirs.*statistics:{\"summary_not_present\":0," trace.perf &&
+	! grep "\"definitely_not\":0," trace.perf
+}
+
+for pathspec in 'src/*.c' 'src/lib/*' 'src/lib/o*' 'doc/*' 'doc/guide/*' \
+	':(glob)src/**/*.h' 'doc' 'src/app/f1*' ':/Make*' \
+	'*.c' '*.H' 'src/**/*.cc' ':(icase)SRC/LIB/*' ':(icase)*.h' \
+	'src/Ext.D' ':(icase)src/ext.d' '*.d'
+do
+	test_expect_success "summaries are used for '$pathspec'" "
+		test_summaries_used -- '$pathspec' &&
+		test_summaries_used --full-history -- '$pathspec' &&
+		test_summaries_used --simplify-merges -- '$pathspec'
+	"
+done
+
+test_expect_success 'summaries are used with several pathspecs' '
+	test_summaries_used -- "doc/*" "src/lib/*"
+'
+
+test_expect_success 'only empty commits are skipped for other pathspecs' '
+	for pathspec in "s*" "*" ":(exclude)doc"
+	do
+		test_log_matches -- "$pathspec" &&
+		grep "\"definitely_not\":1," trace.perf || return 1
+	done
+'
+
+test_expect_success 'summaries are kept when rewriting the commit-graph' '
+	git commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	grep changed_dirs_data out &&
+	git -c commitGraph.changedDirectories=false \
+		commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	! grep changed_dirs out
+'
+
+test_expect_success 'summaries in part of a commit-graph chain' '
+	git commit-graph write --reachable --split=replace &&
+	test_commit new1 src/lib/three.c &&
+	test_commit new2 doc/new.txt &&
+	git -c commitGraph.changedDirectories=true \
+		commit-graph write --reachable --split=no-merge &&
+	test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+	test_log_matches -- "src/lib/*" &&
+	grep "\"summary_not_present\":[1-9][0-9]*,\"maybe\":1,\"definitely_not\":1," trace.perf
+'
+
+test_expect_success 'summaries are written when merging a chain' '
+	git -c commitGraph.changedDirectories=true \
+		commit-graph write --reachable --split=replace &&
+	test_summaries_used -- "src/lib/*"
+'
+
+test_expect_success 'corrupt summary offsets are ignored' '
+	rm -rf .git/objects/info/commit-graphs &&
+	git -c commitGraph.changedDirectories=true \
+		commit-graph write --reachable &&
+	test_when_finished "rm -f $graph" &&
+	corrupt_chunk_file $graph DIRX 0 FFFFFFFF &&
+	test_log_matches -- "src/lib/*" 2>err &&
+	test_grep "ignoring invalid changed-directory summary offsets" err
+'
+
+test_expect_success 'commits deeper than core.maxTreeDepth are not summarized' '
+	test_when_finished "rm -rf deep" &&
+	git init deep &&
+	(
+		cd deep &&
+		mkdir x &&
+		test_commit base x/file &&
+		mkdir -p a/b/c/d &&
+		test_commit deep a/b/c/d/e.c &&
+		test_commit other x/other &&
+		git -c commitGraph.changedDirectories=true -c core.maxTreeDepth=2 \
+			commit-graph write --reachable &&
+		test_log_matches -- "x/*" &&
+		grep "\"summary_not_present\":0,\"maybe\":3,\"definitely_not\":0," trace.perf &&
+		test_log_matches -- "a/*" &&
+		grep "\"summary_not_present\":0,\"maybe\":1,\"definitely_not\":2," trace.perf
+	)
+'
+
+test_done
@@ -0,0 +1,134 @@
+#!/bin/sh
+
+test_description='git log with the log.pathCache cache'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+test_expect_success 'setup' '
+	mkdir -p a b &&
+	test_commit a1 a/file &&
+	test_commit b1 b/file &&
+	git checkout -b side &&
+	test_commit a2 a/side &&
+	git checkout main &&
+	test_commit b2 b/file &&
+	git merge side &&
+	test_commit a3 a/file &&
+	test_commit b3 b/file &&
+	git config log.pathCache true
+'
+
+# test_log_cached <expected trace2 data> <log args>...
+test_log_cached () {
+	expect_trace=$1 &&
+	shift &&
+	rm -f trace.perf &&
+	git -c log.pathCache=false log --format=%s "$@" >expect &&
+	GIT_TRACE2_PERF="$(pwd)/trace.perf" git log --format=%s "$@" >actual &&
+	test_cmp expect actual &&
+	if test -n "$expect_trace"
+	then
+		grep "log-cache.*$expect_trace" trace.perf
+	else
+		! grep log-cache trace.perf
+	fi
+}
+
+test_expect_success 'first walk writes the cache' '
+	test_log_cached "written:3" main~1 -- a &&
+	ls .git/log-cache >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'walk from the same tip is replayed' '
+	test_log_cached "replayed:3" main~1 -- a &&
+	! grep "log-cache.*written" trace.perf
+'
+
+test_expect_success 'walk from a descendant extends the cache' '
+	test_log_cached "replayed:3" main -- a &&
+	grep "log-cache.*written:3" trace.perf &&
+	test_commit a4 a/file &&
+	test_log_cached "replayed:3" -- a &&
+	grep "log-cache.*written:4" trace.perf
+'
+
+test_expect_success 'walk through a merge uses the cache only if it is simplified' '
+	test_log_cached "written:" main~4 -- b &&
+	test_log_cached "replayed:" main -- b &&
+	test_log_cached "written:" main~4 -- a b &&
+	test_log_cached "written:" main -- a b &&
+	! grep "log-cache.*replayed" trace.perf
+'
+
+test_expect_success 'other pathspecs use other caches' '
+	test_log_cached "written:" -- a/file &&
+	test_log_cached "written:" -- ":(icase)A" &&
+	test_log_cached "replayed:" -- a/file
+'
+
+test_expect_success 'incompatible walks do not use the cache' '
+	test_log_cached "" --full-history -- a &&
+	test_log_cached "" --parents -- a &&
+	test_log_cached "" --author=nobody -- a &&
+	test_log_cached "" main~2..main -- a &&
+	test_log_cached "" main side -- a &&
+	test_log_cached "" -- &&
+	test_log_cached "" --follow -- a/file
+'
+
+test_expect_success 'partial walks do not write the cache' '
+	rm -rf .git/log-cache &&
+	test_log_cached "" -1 -- a &&
+	test_path_is_missing .git/log-cache &&
+	test_log_cached "written:" -- a &&
+	test_log_cached "replayed:" -1 -- a
+'
+
+test_expect_success 'cache is not used with replace refs' '
+	git replace main~1 main~2 &&
+	test_when_finished "git replace -d main~1" &&
+	test_log_cached "" -- a
+'
+
+test_expect_success 'corrupt cache is ignored' '
+	for f in .git/log-cache/*
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	test_log_cached "written:" -- a
+'
+
+test_expect_success 'cache is not replayed over commits already walked' '
+	git init skew &&
+	(
+		cd skew &&
+		mkdir a &&
+		echo e >a/file &&
+		git add a &&
+		GIT_COMMITTER_DATE="@2000 +0000" git commit -m e &&
+		git checkout -b c-branch &&
+		echo c >a/c &&
+		git add a &&
+		GIT_COMMITTER_DATE="@1000 +0000" git commit -m c &&
+		git checkout -b d-branch main &&
+		echo d >a/d &&
+		git add a &&
+		GIT_COMMITTER_DATE="@3000 +0000" git commit -m d &&
+		GIT_COMMITTER_DATE="@4000 +0000" git merge -m M c-branch &&
+		git config log.pathCache true &&
+		test_log_cached "written:2" c-branch -- a &&
+		test_log_cached "overlap" d-branch -- a &&
+		! grep "log-cache.*replayed" trace.perf &&
+		test_log_cached "replayed:4" d-branch -- a
+	)
+'
+
+test_done
@@ -0,0 +1,106 @@
+#!/bin/sh
+
+test_description='git log with log.workers'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-terminal.sh
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+test_expect_success 'setup' '
+	test_commit one file &&
+	git checkout -b side &&
+	test_commit side1 file side-content &&
+	test_commit side2 other &&
+	git checkout main &&
+	test_commit two file main-content &&
+	test_must_fail git merge side &&
+	echo resolved >file &&
+	git add file &&
+	git commit -m merge &&
+	git mv other renamed &&
+	git commit -m rename &&
+	git commit --allow-empty -m empty &&
+	mkdir dir &&
+	for i in $(test_seq 1 20)
+	do
+		test_commit "c$i" "dir/f$((i % 4))" "$i" || return 1
+	done
+'
+
+# test_log_workers <log args>...
+test_log_workers () {
+	rm -f trace.perf &&
+	git log "$@" >expect &&
+	GIT_TRACE2_PERF="$(pwd)/trace.perf" \
+		git -c log.workers=3 log "$@" >actual &&
+	test_cmp expect actual &&
+	grep "| log .*| workers:3" trace.perf
+}
+
+for args in '-p' '--stat' '--cc' '-m --raw' '--name-status -- dir' \
+	'--reverse -p' '-p -5' '-z --raw' '--oneline -p' '--format=%s%n%b -p' \
+	'-p --color=always' '-p --full-diff -- dir/f1' '--boundary --stat -3' \
+	'--left-right --stat side...main'
+do
+	test_expect_success "output is the same with workers: $args" "
+		test_log_workers $args
+	"
+done
+
+test_expect_success 'exit code is the same with workers' '
+	test_expect_code 1 git -c log.workers=3 log --exit-code -p -3 &&
+	git -c log.workers=3 log --exit-code -p -1 -- missing
+'
+
+test_expect_success '--check exit code is the same with workers' '
+	echo "trailing " >ws &&
+	git add ws &&
+	git commit -m whitespace &&
+	test_expect_code 2 git log --check -3 >expect &&
+	test_expect_code 2 git -c log.workers=3 log --check -3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success TTY 'colors are decided before forking workers' '
+	test_terminal git --no-pager log --stat --color=auto -3 >expect &&
+	test_terminal git --no-pager -c log.workers=3 \
+		log --stat --color=auto -3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'failing workers are reported' '
+	git init broken &&
+	(
+		cd broken &&
+		test_commit one file &&
+		test_commit two file &&
+		test_commit three file &&
+		blob=$(git rev-parse two:file) &&
+		rm .git/objects/$(test_oid_to_path $blob) &&
+		test_expect_code 128 git log -p &&
+		test_expect_code 128 git -c log.workers=3 \
+			log --exit-code -p 2>err &&
+		test_grep "log worker process failed" err
+	)
+'
+
+test_expect_success 'workers are not used without diffs or with walk state' '
+	for args in "--oneline" "--graph -p" "--follow -p -- file" \
+		"--parents -p -- dir" "--children -p" "--source -p"
+	do
+		rm -f trace.perf &&
+		git log $args >expect &&
+		GIT_TRACE2_PERF="$(pwd)/trace.perf" \
+			git -c log.workers=3 log $args >actual &&
+		test_cmp expect actual &&
+		! grep "workers:" trace.perf || return 1
+	done
+'
+
+test_done
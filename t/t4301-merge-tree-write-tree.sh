@@ -945,12 +945,106 @@ test_expect_success 'check the input format when --stdin is passed' '
 	test_cmp expect actual
 '
 
+test_expect_success '--stdin reuses merge bases and rename scores across merges' '
+	test_when_finished "rm -rf batch" &&
+	git init batch &&
+	(
+		cd batch &&
+		test_write_lines 1 2 3 4 5 6 7 8 9 10 >doc &&
+		git add doc &&
+		git commit -m base &&
+		git branch t1 &&
+		git branch t2 &&
+		git checkout -b upstream &&
+		test_write_lines 1 2 3 4 5 6 7 8 9 ten >guide &&
+		git rm -q doc &&
+		git add guide &&
+		git commit -m "rename doc -> guide" &&
+		git checkout t1 &&
+		test_write_lines one 2 3 4 5 6 7 8 9 10 >doc &&
+		git commit -a -m t1 &&
+		git checkout t2 &&
+		test_write_lines 1 2 3 4 five 6 7 8 9 ten >doc &&
+		git commit -a -m t2 &&
+
+		printf "upstream t1\nupstream t2\nupstream t1\n" |
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git merge-tree --stdin >actual &&
+		grep "\"key\":\"merge bases reused\",\"value\":\"1\"" trace.event &&
+		grep "\"key\":\"inexact renames/cached\",\"value\":\"0\"" trace.event >misses &&
+		test_line_count = 1 misses &&
+		grep "\"key\":\"inexact renames/cached\",\"value\":\"1\"" trace.event >hits &&
+		test_line_count = 2 hits &&
+
+		for branch in t1 t2 t1
+		do
+			printf "1\0" >>expect &&
+			git merge-tree --write-tree -z upstream $branch >>expect &&
+			printf "\0" >>expect || return 1
+		done &&
+		test_cmp expect actual &&
+		test_must_fail git rev-parse --verify refs/notes/renames
+	)
+'
+
 test_expect_success '--merge-base with tree OIDs' '
 	git merge-tree --merge-base=side1^ side1 side3 >with-commits &&
 	git merge-tree --merge-base=side1^^{tree} side1^{tree} side3^{tree} >with-trees &&
 	test_cmp with-commits with-trees
 '
 
+test_expect_success 'content merges with merge.threads give the same result' '
+	git init threads &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 40)
+		do
+			test_write_lines 1 2 3 4 5 6 7 8 9 >file$i || return 1
+		done &&
+		printf "\0binary\n" >binary &&
+		echo "custom* merge=custom" >.gitattributes &&
+		cp file1 custom-file &&
+		git add . &&
+		git commit -m base &&
+		git branch other &&
+		git checkout -b ours &&
+
+		for i in $(test_seq 1 40)
+		do
+			test_write_lines ours 2 3 4 5 6 7 8 9 >file$i || return 1
+		done &&
+		printf "\0ours\n" >binary &&
+		test_write_lines ours 2 3 4 5 6 7 8 9 >custom-file &&
+		git commit -a -m ours &&
+
+		git checkout other &&
+		for i in $(test_seq 1 40)
+		do
+			if test $((i % 3)) = 0
+			then
+				test_write_lines theirs 2 3 4 5 6 7 8 9 >file$i
+			else
+				test_write_lines 1 2 3 4 5 6 7 8 theirs >file$i
+			fi || return 1
+		done &&
+		printf "\0theirs\n" >binary &&
+		test_write_lines 1 2 3 4 5 6 7 8 theirs >custom-file &&
+		git commit -a -m theirs &&
+
+		git config merge.custom.driver "cat %A >/dev/null" &&
+		test_expect_code 1 git -c merge.threads=1 \
+			merge-tree --write-tree ours other >expect &&
+		test_expect_code 1 git -c merge.threads=4 \
+			merge-tree --write-tree ours other >actual &&
+		test_cmp expect actual &&
+		test_grep "CONFLICT (content): Merge conflict in file3" actual &&
+		test_grep "Cannot merge binary files: binary" actual &&
+		test_grep "^Auto-merging file40$" actual &&
+		test_grep ! "CONFLICT (content): Merge conflict in file40" actual &&
+		test_grep ! "CONFLICT (content): Merge conflict in custom-file" actual
+	)
+'
+
 test_expect_success 'error out on missing tree objects' '
 	git init --bare missing-tree.git &&
 	git rev-list side3 >list &&
@@ -604,6 +604,22 @@ test_expect_success 'detect incorrect commit date' '
 		"commit date"
 '
 
+test_expect_success 'detect incorrect commit date when reading in threads' '
+	test_when_finished "sane_unset GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS" &&
+	GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS=4 &&
+	export GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS &&
+	corrupt_graph_and_verify $GRAPH_BYTE_COMMIT_DATE "\01" \
+		"commit date"
+'
+
+test_expect_success 'detect OID not in object database when reading in threads' '
+	test_when_finished "sane_unset GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS" &&
+	GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS=4 &&
+	export GIT_TEST_COMMIT_GRAPH_VERIFY_THREADS &&
+	corrupt_graph_and_verify $GRAPH_BYTE_OID_LOOKUP_MISSING "\01" \
+		"from object database"
+'
+
 test_expect_success 'detect incorrect parent for octopus merge' '
 	corrupt_graph_and_verify $GRAPH_BYTE_OCTOPUS "\01" \
 		"invalid parent"
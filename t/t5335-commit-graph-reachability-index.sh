@@ -0,0 +1,161 @@
+#!/bin/sh
+
+test_description='commit-graph reachability index'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-chunk.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+
+graph=.git/objects/info/commit-graph
+
+test_expect_success 'setup' '
+	test_commit root &&
+	for topic in a b c
+	do
+		git checkout -b $topic main &&
+		test_commit $topic-1 &&
+		test_commit $topic-2 &&
+		git checkout main &&
+		test_commit main-$topic || return 1
+	done &&
+	git merge -m octopus a b c &&
+	test_commit after-octopus &&
+	git checkout -b d a &&
+	test_commit d-1 &&
+	git merge -m "merge main" main &&
+	test_commit d-2 &&
+	git checkout -b e root &&
+	test_commit e-1 &&
+	git checkout main &&
+	git rev-list --all >commits
+'
+
+# Compare --is-ancestor for all pairs of commits in "commits", as well
+# as tag and branch --contains for all of them, with and without the
+# commit-graph.
+test_reach_matches () {
+	while read a
+	do
+		while read b
+		do
+			git merge-base --is-ancestor $a $b
+			echo "$a $b $?" || return 1
+		done <commits || return 1
+	done <commits >actual &&
+	while read a
+	do
+		git tag --contains $a &&
+		git branch --contains $a &&
+		git branch --no-contains $a || return 1
+	done <commits >>actual &&
+	while read a
+	do
+		while read b
+		do
+			git -c core.commitGraph=false \
+				merge-base --is-ancestor $a $b
+			echo "$a $b $?" || return 1
+		done <commits || return 1
+	done <commits >expect &&
+	while read a
+	do
+		git -c core.commitGraph=false tag --contains $a &&
+		git -c core.commitGraph=false branch --contains $a &&
+		git -c core.commitGraph=false branch --no-contains $a || return 1
+	done <commits >>expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'no reachability index by default' '
+	git commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	! grep reachability_index out
+'
+
+test_expect_success 'write reachability index' '
+	git -c commitGraph.reachabilityIndex=true \
+		commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	grep reachability_index out &&
+	git commit-graph verify
+'
+
+test_expect_success 'reachability queries match without the commit-graph' '
+	test_reach_matches
+'
+
+test_expect_success 'reachability index is kept when rewriting the commit-graph' '
+	git commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	grep reachability_index out &&
+	git -c commitGraph.reachabilityIndex=false \
+		commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	! grep reachability_index out
+'
+
+test_expect_success 'reachability index in the first layer of a chain' '
+	git -c commitGraph.reachabilityIndex=true \
+		commit-graph write --reachable --split=replace &&
+	git checkout -b f d &&
+	test_commit f-1 &&
+	git merge -m "merge e" e &&
+	git checkout main &&
+	git rev-list --all >commits &&
+	git commit-graph write --reachable --split=no-merge &&
+	test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+	git commit-graph verify &&
+	test_reach_matches
+'
+
+test_expect_success 'reachability index is written when merging a chain' '
+	git commit-graph write --reachable --split=replace &&
+	test_line_count = 1 .git/objects/info/commit-graphs/commit-graph-chain &&
+	git commit-graph verify &&
+	test_reach_matches
+'
+
+test_expect_success 'verify notices inconsistent reachability labels' '
+	rm -rf .git/objects/info/commit-graphs &&
+	git -c commitGraph.reachabilityIndex=true \
+		commit-graph write --reachable &&
+	test_when_finished "rm -f $graph" &&
+	corrupt_chunk_file $graph RIDX 0 00000000FFFFFFFF00000000 &&
+	test_must_fail git commit-graph verify 2>err &&
+	test_grep "reachability label for commit .* is invalid" err
+'
+
+test_expect_success 'verify notices a reachability label starting too early' '
+	git init orphans &&
+	(
+		cd orphans &&
+		test_commit one &&
+		git checkout --orphan other &&
+		test_commit two &&
+		git -c commitGraph.reachabilityIndex=true \
+			commit-graph write --reachable &&
+		git commit-graph verify &&
+
+		# Each of the two commits is the only one it reaches, so
+		# the range of the second one starts at its own finishing
+		# number, 1. Starting it at 0 makes it claim the first one.
+		corrupt_chunk_file $graph RIDX 16 00000000 &&
+		test_must_fail git commit-graph verify 2>err &&
+		test_grep "reachability label for commit .* is invalid" err
+	)
+'
+
+test_expect_success 'truncated reachability index is ignored' '
+	git -c commitGraph.reachabilityIndex=true \
+		commit-graph write --reachable &&
+	test_when_finished "rm -f $graph" &&
+	corrupt_chunk_file $graph RIDX clear 00000000 &&
+	git merge-base --is-ancestor root main 2>err &&
+	test_grep "reachability index chunk is too small" err
+'
+
+test_done
@@ -0,0 +1,119 @@
+#!/bin/sh
+
+test_description='test bloom fetch negotiator'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=base 20 &&
+	git clone --no-local . client &&
+	test_commit_bulk --id=server 5 &&
+	git config uploadpack.allowBloomHaves true &&
+
+	# The client has much local history the server does not know
+	# about, so that finding the common commits by sending one "have"
+	# line after another takes several rounds.
+	test_commit_bulk -C client --id=client 200
+'
+
+# fetch_with <algorithm> <name> [<client>]
+#
+# Fetch into a fresh copy of <client> (by default "client"), recording
+# packet and trace2 output in files named after <name>.
+fetch_with () {
+	rm -rf "client-$2" "packet-$2" "trace-$2" &&
+	cp -R "${3:-client}" "client-$2" &&
+	GIT_TRACE_PACKET="$PWD/packet-$2" \
+	GIT_TRACE2_EVENT="$PWD/trace-$2" \
+	git -C "client-$2" -c protocol.version=2 \
+		-c fetch.negotiationAlgorithm=$1 \
+		fetch --upload-pack "unset GIT_TRACE_PACKET; git-upload-pack" \
+		origin &&
+	git -C "client-$2" fsck &&
+	git -C "client-$2" for-each-ref >"refs-$2"
+}
+
+rounds () {
+	grep "\"key\":\"total_rounds\"" "trace-$1" |
+	sed -e "s/.*\"value\":\"\\([0-9]*\\)\".*/\\1/"
+}
+
+# Print the "have" lines sent more than once in the same request.
+repeated_haves () {
+	sed -n -e 's/.*fetch> \(have .*\)/\1/p' \
+		-e 's/.*fetch> 0000$/0000/p' "packet-$1" |
+	awk '/^0000/ { n++; next } seen[n " " $0]++ == 1'
+}
+
+test_expect_success 'server advertises bloom-haves' '
+	test-tool serve-v2 --advertise-capabilities >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_grep "^fetch=.* bloom-haves" actual
+'
+
+test_expect_success 'bloom negotiator finds common commits in fewer rounds' '
+	fetch_with consecutive consecutive &&
+	fetch_with bloom bloom &&
+	test_cmp refs-consecutive refs-bloom &&
+
+	grep "fetch> bloom-haves 7 " packet-bloom &&
+	grep "fetch< bloom-candidates" packet-bloom &&
+	grep "fetch> have $(git -C client rev-parse origin/HEAD)" packet-bloom &&
+	echo 2 >expect &&
+	rounds bloom >actual &&
+	test_cmp expect actual &&
+	test "$(rounds consecutive)" -gt 2
+'
+
+test_expect_success 'bloom negotiator does not send a candidate twice' '
+	# The candidate is sent first in the second round. With only a
+	# few more local commits left, the walk of the consecutive
+	# negotiator gets to it in the same round.
+	rm -rf client-short &&
+	cp -R client client-short &&
+	git -C client-short reset --hard HEAD~180 &&
+	fetch_with bloom repeated client-short &&
+	git rev-parse HEAD >expect &&
+	git -C client-repeated rev-parse origin/HEAD >actual &&
+	test_cmp expect actual &&
+	grep "fetch< bloom-candidates" packet-repeated &&
+	repeated_haves repeated >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'bloom negotiator without server support' '
+	test_when_finished "git config uploadpack.allowBloomHaves true" &&
+	git config uploadpack.allowBloomHaves false &&
+	fetch_with bloom unsupported &&
+	test_cmp refs-consecutive refs-unsupported &&
+	! grep bloom-haves packet-unsupported &&
+	test "$(rounds unsupported)" = "$(rounds consecutive)"
+'
+
+test_expect_success 'bloom negotiator is not used by protocol v0' '
+	rm -rf client-v0 &&
+	cp -R client client-v0 &&
+	git -C client-v0 -c protocol.version=0 \
+		-c fetch.negotiationAlgorithm=bloom fetch origin &&
+	git -C client-v0 fsck
+'
+
+test_expect_success 'server rejects invalid bloom-haves' '
+	{
+		packetize command=fetch &&
+		packetize object-format=$(test_oid algo) &&
+		printf 0001 &&
+		packetize "bloom-haves 0 ff" &&
+		packetize done &&
+		printf 0000
+	} >input &&
+	test_must_fail env GIT_PROTOCOL=version=2 \
+		git upload-pack . <input >out 2>err &&
+	test_grep "invalid bloom-haves line" err &&
+	test_must_fail env GIT_PROTOCOL=version=2 \
+		git -c uploadpack.allowBloomHaves=false upload-pack . \
+		<input >out 2>err &&
+	test_grep "unexpected line" err
+'
+
+test_done
@@ -0,0 +1,81 @@
+#!/bin/sh
+
+test_description='upload-pack generating packs without exec-ing pack-objects'
+
+. ./test-lib.sh
+
+if test_have_prereq MINGW
+then
+	skip_all='skipping in-process pack-objects tests, no fork() on Windows'
+	test_done
+fi
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git tag -m annotated annotated two &&
+	git config uploadpack.packObjectsInProcess true
+'
+
+test_expect_success 'clone uses in-process pack-objects (protocol v0)' '
+	GIT_TRACE="$PWD/trace" \
+		git -c protocol.version=0 clone --no-local . v0.git &&
+	grep "run_command: git pack-objects" trace &&
+	! grep "built-in: git pack-objects" trace &&
+	git -C v0.git fsck &&
+	git rev-parse annotated >expect &&
+	git -C v0.git rev-parse annotated >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone uses in-process pack-objects (protocol v2)' '
+	rm -f trace &&
+	GIT_TRACE="$PWD/trace" \
+		git -c protocol.version=2 clone --no-local . v2.git &&
+	grep "run_command: git pack-objects" trace &&
+	! grep "built-in: git pack-objects" trace &&
+	git -C v2.git fsck
+'
+
+test_expect_success 'incremental fetch' '
+	test_commit three &&
+	git -C v2.git fetch origin &&
+	git rev-parse three >expect &&
+	git -C v2.git rev-parse "origin/$(git branch --show-current)" >actual &&
+	test_cmp expect actual &&
+	git -C v2.git fsck
+'
+
+test_expect_success 'shallow fetch falls back to pack-objects subprocess' '
+	rm -f trace &&
+	GIT_TRACE="$PWD/trace" \
+		git clone --no-local --depth=1 . shallow.git &&
+	grep "built-in: git pack-objects" trace &&
+	git -C shallow.git fsck &&
+	echo 1 >expect &&
+	git -C shallow.git rev-list --count HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'in-process pack-objects logs no second trace2 exit' '
+	test_when_finished "rm -rf trace2.git" &&
+	GIT_TRACE2_EVENT="$PWD/trace.event" \
+		git clone --no-local . trace2.git &&
+	grep "\"event\":\"exit\"" trace.event >exits &&
+	sed -e "s/.*\"sid\":\"\([^\"]*\)\".*/\1/" exits | sort >sids &&
+	sort -u sids >expect &&
+	test_cmp expect sids &&
+	grep "\"event\":\"child_start\".*\"pack-objects\"" trace.event
+'
+
+test_expect_success 'pack-objects failure is reported' '
+	git init corrupt &&
+	test_commit -C corrupt file &&
+	git -C corrupt config uploadpack.packObjectsInProcess true &&
+	blob=$(git -C corrupt rev-parse HEAD:file.t) &&
+	rm -f "corrupt/.git/objects/$(test_oid_to_path $blob)" &&
+	test_must_fail git clone --no-local corrupt broken.git 2>err &&
+	test_grep "pack-objects died with error" err
+'
+
+test_done
@@ -0,0 +1,154 @@
+#!/bin/sh
+
+test_description='upload-pack relaying requests to a resident daemon'
+
+. ./test-lib.sh
+
+test -z "$NO_UNIX_SOCKETS" || {
+	skip_all='skipping upload-pack daemon tests, unix sockets not available'
+	test_done
+}
+if test_have_prereq MINGW
+then
+	skip_all='skipping upload-pack daemon tests, no fork() on Windows'
+	test_done
+fi
+
+test_expect_success 'setup' '
+	git init server &&
+	test_commit -C server one &&
+	test_commit -C server two
+'
+
+start_daemon () {
+	GIT_TRACE2_EVENT="$PWD/daemon-trace" \
+		git -C server upload-pack --serve-socket="$PWD/upload-pack.sock" . &
+	daemon_pid=$!
+	test_atexit "kill $daemon_pid 2>/dev/null || :"
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		test -S upload-pack.sock && return 0
+		sleep 1
+	done
+	false
+}
+
+wait_for_daemon_exit () {
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		grep -q "\"region_leave\".*\"label\":\"daemon\"" daemon-trace &&
+		return 0
+		sleep 1
+	done
+	false
+}
+
+test_expect_success 'start daemon' '
+	start_daemon &&
+	git config --global uploadpack.daemonSocket "$PWD/upload-pack.sock"
+'
+
+test_expect_success 'clone is served by the daemon' '
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=2 clone --no-local server client &&
+	grep "\"key\":\"daemon\"" trace &&
+	git -C client fsck &&
+	git -C server rev-parse HEAD >expect &&
+	git -C client rev-parse HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'daemon sees new commits and packs' '
+	test_commit -C server three &&
+	git -C server repack -ad &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -C client -c protocol.version=2 fetch origin &&
+	grep "\"key\":\"daemon\"" trace &&
+	git -C server rev-parse HEAD >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-remote is served by the daemon' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=2 ls-remote server >actual &&
+	grep "\"key\":\"daemon\"" trace &&
+	git -C server show-ref --head >expect.raw &&
+	sed "s/ /	/" expect.raw >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'other repositories are served directly' '
+	git init other &&
+	test_commit -C other other &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=2 clone --no-local other other-client &&
+	grep "\"key\":\"daemon/rejected\"" trace &&
+	git -C other-client fsck
+'
+
+test_expect_success 'protocol v0 is served directly' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=0 clone --no-local server v0-client &&
+	! grep "\"key\":\"daemon" trace &&
+	git -C v0-client fsck
+'
+
+test_expect_success 'requests in a namespace are served directly' '
+	git -C server update-ref refs/namespaces/ns/refs/heads/main one &&
+	test-tool pkt-line pack >request <<-\EOF &&
+	command=ls-refs
+	0000
+	EOF
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" GIT_NAMESPACE=ns GIT_PROTOCOL=version=2 \
+		git -C server upload-pack . <request >out &&
+	grep "\"key\":\"daemon/skipped\"" trace &&
+	! grep "\"key\":\"daemon\"" trace &&
+	test-tool pkt-line unpack <out >unpacked &&
+	grep refs/ unpacked >actual &&
+	echo "$(git -C server rev-parse one) refs/heads/main" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'requests with --timeout or -c are served directly' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" GIT_PROTOCOL=version=2 \
+		git -C server upload-pack --timeout=60 . <request >out &&
+	grep "\"key\":\"daemon/skipped\"" trace &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" GIT_PROTOCOL=version=2 \
+		git -c uploadpack.allowFilter=true -C server upload-pack . \
+		<request >out &&
+	grep "\"key\":\"daemon/skipped\"" trace &&
+	! grep "\"key\":\"daemon\"" trace
+'
+
+test_expect_success 'repository config cannot point to the daemon' '
+	test_unconfig --global uploadpack.daemonSocket &&
+	git -C server config uploadpack.daemonSocket "$PWD/upload-pack.sock" &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=2 clone --no-local server direct-client &&
+	! grep "\"key\":\"daemon" trace
+'
+
+test_expect_success 'daemon exits when its socket goes away' '
+	rm upload-pack.sock &&
+	wait_for_daemon_exit
+'
+
+test_expect_success 'requests are served directly without a daemon' '
+	test_config_global uploadpack.daemonSocket "$PWD/upload-pack.sock" &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$PWD/trace" \
+		git -c protocol.version=2 clone --no-local server late-client &&
+	grep "\"key\":\"daemon/unavailable\"" trace &&
+	git -C late-client fsck
+'
+
+test_done
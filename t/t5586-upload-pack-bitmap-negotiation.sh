@@ -0,0 +1,63 @@
+#!/bin/sh
+
+test_description='upload-pack using reachability bitmaps to process haves'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=base 20 &&
+	git clone --no-local . client &&
+	git checkout -b side HEAD~10 &&
+	test_commit_bulk --id=side 10 &&
+	git checkout - &&
+	test_commit_bulk --id=main 10 &&
+	git tag -m annotated annotated side &&
+	git repack -adb &&
+	test_commit_bulk -C client --id=client 30 &&
+
+	# an unrelated, old commit makes the client send a "have" the
+	# server does not know after all the common ones, which is
+	# when protocol v0 asks whether it is ok to give up
+	git -C client checkout --orphan old &&
+	test_commit -C client --date "@0 +0000" old
+'
+
+# Run a fetch into a fresh copy of the client with the given
+# uploadpack.bitmapNegotiation setting and protocol version, and record
+# the acknowledgements the server sent and the resulting refs.
+fetch_with () {
+	rm -rf "client-$1" "packet-$1" "trace-$1" &&
+	cp -R client "client-$1" &&
+	GIT_TRACE_PACKET="$PWD/packet-$1" \
+	GIT_TRACE2_PERF="$PWD/trace-$1" \
+	git -C "client-$1" -c protocol.version=$2 \
+		-c fetch.negotiationAlgorithm=consecutive \
+		fetch --no-tags --upload-pack="git -c uploadpack.bitmapNegotiation=$1 upload-pack" \
+		origin "+refs/heads/*:refs/remotes/origin/*" \
+		"+refs/tags/annotated:refs/tags/annotated" &&
+	git -C "client-$1" fsck &&
+	grep "fetch< \(ACK\|NAK\|ready\)" "packet-$1" >"acks-$1" &&
+	git -C "client-$1" for-each-ref >"refs-$1"
+}
+
+for v in 0 2
+do
+	test_expect_success "bitmaps give the same answers (protocol v$v)" "
+		fetch_with false $v &&
+		fetch_with true $v &&
+		test_cmp acks-false acks-true &&
+		test_cmp refs-false refs-true &&
+		grep ready acks-true &&
+		test_grep negotiate/bitmap-haves-checked trace-true &&
+		test_grep ! negotiate/bitmap-haves-checked trace-false
+	"
+done
+
+test_expect_success 'without bitmaps, the walk is used' '
+	rm -f .git/objects/pack/*.bitmap &&
+	fetch_with true 2 &&
+	test_grep ! negotiate/bitmap-haves-checked trace-true &&
+	test_cmp acks-false acks-true
+'
+
+test_done
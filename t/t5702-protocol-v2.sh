@@ -1226,6 +1226,75 @@ test_expect_success 'part of packfile response provided as URI' '
 	test_line_count = 6 filelist
 '
 
+# Print "start" and "exit" for each http-fetch process in the order in
+# which the trace2 event log in $1 records them.
+http_fetch_events () {
+	awk '
+	function key() {
+		match($0, /"sid":"[^"]*"/)
+		sid = substr($0, RSTART, RLENGTH)
+		match($0, /"child_id":[0-9]+/)
+		return sid substr($0, RSTART, RLENGTH)
+	}
+	/"event":"child_start"/ && /"http-fetch"/ {
+		http_fetch[key()] = 1
+		print "start"
+	}
+	/"event":"child_exit"/ && (key() in http_fetch) {
+		print "exit"
+	}' "$1"
+}
+
+test_expect_success 'packfile URIs are downloaded concurrently' '
+	P="$HTTPD_DOCUMENT_ROOT_PATH/http_parent" &&
+	rm -rf "$P" http_child trace &&
+
+	git init "$P" &&
+	git -C "$P" config "uploadpack.allowsidebandall" "true" &&
+
+	echo my-blob >"$P/my-blob" &&
+	git -C "$P" add my-blob &&
+	echo other-blob >"$P/other-blob" &&
+	git -C "$P" add other-blob &&
+	git -C "$P" commit -m x &&
+
+	configure_exclusion "$P" my-blob >h &&
+	configure_exclusion "$P" other-blob >h2 &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+	git -c protocol.version=2 \
+		-c fetch.uriprotocols=http,https \
+		clone "$HTTPD_URL/smart/http_parent" http_child &&
+
+	# both downloads are started before either is waited for
+	cat >expect <<-\EOF &&
+	start
+	start
+	exit
+	exit
+	EOF
+	http_fetch_events trace >actual &&
+	test_cmp expect actual &&
+	git -C http_child fsck &&
+
+	# fetch.uriJobs limits how many run at the same time
+	rm -rf http_child trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+	git -c protocol.version=2 \
+		-c fetch.uriprotocols=http,https \
+		-c fetch.uriJobs=1 \
+		clone "$HTTPD_URL/smart/http_parent" http_child &&
+	cat >expect <<-\EOF &&
+	start
+	exit
+	start
+	exit
+	EOF
+	http_fetch_events trace >actual &&
+	test_cmp expect actual &&
+	git -C http_child fsck
+'
+
 test_expect_success 'packfile URIs with fetch instead of clone' '
 	P="$HTTPD_DOCUMENT_ROOT_PATH/http_parent" &&
 	rm -rf "$P" http_child log &&
@@ -541,4 +541,82 @@ test_expect_success 'validate worktree atom' '
 	test_cmp expect actual
 '
 
+test_expect_success 'setup history for reachability bitmaps' '
+	git init bitmaps &&
+	(
+		cd bitmaps &&
+		test_commit_bulk --id=base 8 &&
+		git branch -M main &&
+		for i in 1 2 3
+		do
+			git checkout -b topic$i main~$i &&
+			test_commit_bulk --id=topic$i 3 &&
+			git tag topic$i-tip &&
+			git checkout main &&
+			git merge -m "merge topic$i" topic$i &&
+			test_commit after$i || return 1
+		done &&
+		git checkout -b unmerged main~2 &&
+		test_commit unmerged
+	)
+'
+
+filter_with_all_commits () {
+	for commit in $(git rev-list --all)
+	do
+		echo "$commit" &&
+		git for-each-ref --format="%(refname)" --contains $commit &&
+		git for-each-ref --format="%(refname)" --no-contains $commit &&
+		git for-each-ref --format="%(refname)" --merged $commit &&
+		git for-each-ref --format="%(refname)" --no-merged $commit &&
+		git for-each-ref --format="%(refname)" \
+			--contains $commit --merged main || return 1
+	done
+}
+
+test_expect_success 'reachability filters with bitmaps' '
+	(
+		cd bitmaps &&
+		filter_with_all_commits >expect &&
+		git repack -adb &&
+		test_env GIT_TRACE2_EVENT="$(pwd)/trace" \
+			filter_with_all_commits >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"contains/bitmapped\"" trace &&
+		grep "\"reach_filter/bitmap\"" trace
+	)
+'
+
+test_expect_success 'reachability filters with commits outside of bitmaps' '
+	(
+		cd bitmaps &&
+		git checkout -b loose topic2 &&
+		test_commit loose &&
+		git checkout main &&
+		git merge -m "merge loose" loose &&
+		mv .git/objects/pack/*.bitmap . &&
+		filter_with_all_commits >expect &&
+		mv *.bitmap .git/objects/pack/ &&
+		filter_with_all_commits >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'reachability filters ignore bitmaps with replace refs' '
+	(
+		cd bitmaps &&
+		git repack -adb &&
+		git replace --graft topic1-tip unmerged &&
+		test_when_finished "git replace -d topic1-tip" &&
+		mv .git/objects/pack/*.bitmap . &&
+		filter_with_all_commits >expect &&
+		mv *.bitmap .git/objects/pack/ &&
+		test_env GIT_TRACE2_EVENT="$(pwd)/trace-replace" \
+			filter_with_all_commits >actual &&
+		test_cmp expect actual &&
+		! grep "\"key\":\"contains/bitmapped\"" trace-replace &&
+		! grep "\"reach_filter/bitmap\"" trace-replace
+	)
+'
+
 test_done
@@ -58,6 +58,9 @@ test_expect_success 'setup' '
 	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
 	mv .git/objects/info/commit-graph commit-graph-no-gdat &&
 	chmod u+w commit-graph-no-gdat &&
+	git -c commitGraph.reachabilityIndex=true commit-graph write --reachable &&
+	mv .git/objects/info/commit-graph commit-graph-reach &&
+	chmod u+w commit-graph-reach &&
 	git config core.commitGraph true
 '
 
@@ -73,6 +76,9 @@ run_all_modes () {
 	test_cmp expect actual &&
 	cp commit-graph-no-gdat .git/objects/info/commit-graph &&
 	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-reach .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
 	test_cmp expect actual
 }
 
@@ -443,6 +449,48 @@ test_expect_success 'get_reachable_subset:none' '
 	test_all_modes get_reachable_subset
 '
 
+test_expect_success 'rev-list --count:range' '
+	: >input &&
+	echo 7 >expect &&
+	run_all_modes git rev-list --count commit-5-7 ^commit-4-9 &&
+	run_all_modes git rev-list --count tag-5-7 ^tag-4-9
+'
+
+test_expect_success 'rev-list --count:multiple' '
+	: >input &&
+	echo 12 >expect &&
+	run_all_modes git rev-list --count commit-3-8 commit-7-2 \
+		--not commit-2-9 commit-6-1
+'
+
+test_expect_success 'rev-list --count:first-parent' '
+	: >input &&
+	echo 11 >expect &&
+	run_all_modes git rev-list --count --first-parent commit-5-7 &&
+	echo 8 >expect &&
+	run_all_modes git rev-list --count --first-parent commit-5-7 ^commit-3-3
+'
+
+test_expect_success 'rev-list --count:max-count' '
+	: >input &&
+	echo 5 >expect &&
+	run_all_modes git rev-list --count -n 5 commit-5-7 ^commit-4-9
+'
+
+test_expect_success 'rev-list --count only walks the commit-graph' '
+	test_when_finished rm -rf .git/objects/info/commit-graph &&
+	cp commit-graph-full .git/objects/info/commit-graph &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git rev-list --count commit-5-7 ^commit-4-9 >actual &&
+	echo 7 >expect &&
+	test_cmp expect actual &&
+	grep "count_reachable_in_graph/walked" trace.txt &&
+	rm trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git rev-list --count --left-right commit-5-7...commit-4-9 &&
+	! grep "count_reachable_in_graph/walked" trace.txt
+'
+
 test_expect_success 'for-each-ref ahead-behind:linear' '
 	cat >input <<-\EOF &&
 	refs/heads/commit-1-1
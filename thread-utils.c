@@ -84,6 +84,56 @@ int init_recursive_mutex(pthread_mutex_t *m)
 #endif
 }
 
+static void *batch_thread(void *arg)
+{
+	struct batch_threads *bt = arg;
+
+	for (;;) {
+		size_t i, end;
+
+		pthread_mutex_lock(&bt->mutex);
+		i = bt->next;
+		end = bt->next = bt->nr - i > bt->batch ? i + bt->batch : bt->nr;
+		pthread_mutex_unlock(&bt->mutex);
+
+		if (i >= end)
+			break;
+		for (; i < end; i++)
+			bt->fn(i, bt->data);
+	}
+	return NULL;
+}
+
+void batch_threads_start(struct batch_threads *bt, size_t nr, int nr_threads)
+{
+	int t;
+
+	bt->nr = nr;
+	bt->next = 0;
+	if (!bt->batch)
+		bt->batch = 1;
+	if (nr_threads > 0 && (size_t)nr_threads > nr)
+		nr_threads = nr;
+	pthread_mutex_init(&bt->mutex, NULL);
+	CALLOC_ARRAY(bt->threads, nr_threads > 0 ? nr_threads : 1);
+	for (t = 0; t < nr_threads; t++)
+		if (pthread_create(&bt->threads[t], NULL, batch_thread, bt))
+			break;
+	bt->nr_threads = t;
+}
+
+void batch_threads_finish(struct batch_threads *bt)
+{
+	int t;
+
+	batch_thread(bt);
+	for (t = 0; t < bt->nr_threads; t++)
+		pthread_join(bt->threads[t], NULL);
+	FREE_AND_NULL(bt->threads);
+	bt->nr_threads = 0;
+	pthread_mutex_destroy(&bt->mutex);
+}
+
 #ifdef NO_PTHREADS
 int dummy_pthread_create(pthread_t *pthread, const void *attr,
 			 void *(*fn)(void *), void *data)
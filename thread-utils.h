@@ -53,5 +53,27 @@ int dummy_pthread_init(void *);
 int online_cpus(void);
 int init_recursive_mutex(pthread_mutex_t*);
 
+/*
+ * Call `fn(i, data)` for every `i` from 0 to `nr` - 1 on up to
+ * `nr_threads` threads, which take `batch` consecutive indices at a
+ * time. batch_threads_start() returns once the threads are started, so
+ * that the caller can do something else meanwhile, and
+ * batch_threads_finish() helps with what is left and waits for them.
+ * Without threads, everything is done by batch_threads_finish().
+ */
+struct batch_threads {
+	void (*fn)(size_t i, void *data);
+	void *data;
+	size_t batch;
+
+	size_t nr, next;
+	pthread_mutex_t mutex;
+	pthread_t *threads;
+	int nr_threads;
+};
+
+void batch_threads_start(struct batch_threads *bt, size_t nr, int nr_threads);
+void batch_threads_finish(struct batch_threads *bt);
+
 
 #endif /* THREAD_COMPAT_H */
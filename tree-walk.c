@@ -98,6 +98,124 @@ void *fill_tree_descriptor(struct repository *r,
 	return buf;
 }
 
+static int read_tree_gently(struct repository *r, const struct object_id *oid,
+			    struct tree_desc *desc, void **buf)
+{
+	enum object_type type;
+	unsigned long size;
+
+	if (!oid) {
+		init_tree_desc(desc, NULL, NULL, 0);
+		return 0;
+	}
+
+	*buf = repo_read_object_file(r, oid, &type, &size);
+	if (!*buf || type != OBJ_TREE)
+		return -1;
+	return init_tree_desc_gently(desc, oid, *buf, size, 0);
+}
+
+static int walk_changed_trees(struct repository *r,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct strbuf *base, int depth,
+			      changed_tree_entry_fn fn, void *data);
+
+static int walk_changed_entry(struct repository *r,
+			      const struct name_entry *old_e,
+			      const struct name_entry *new_e,
+			      struct strbuf *base, int depth,
+			      changed_tree_entry_fn fn, void *data)
+{
+	const struct name_entry *e = new_e ? new_e : old_e;
+	const struct object_id *old_tree = NULL, *new_tree = NULL;
+	size_t baselen = base->len;
+	int ret;
+
+	ret = fn(old_e, new_e, base, depth, data);
+	if (ret)
+		return ret;
+
+	if (old_e && S_ISDIR(old_e->mode))
+		old_tree = &old_e->oid;
+	if (new_e && S_ISDIR(new_e->mode))
+		new_tree = &new_e->oid;
+	if (!old_tree && !new_tree)
+		return 0;
+
+	strbuf_add(base, e->path, tree_entry_len(e));
+	strbuf_addch(base, '/');
+	ret = walk_changed_trees(r, old_tree, new_tree, base, depth + 1,
+				 fn, data);
+	strbuf_setlen(base, baselen);
+	return ret;
+}
+
+static int walk_changed_trees(struct repository *r,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct strbuf *base, int depth,
+			      changed_tree_entry_fn fn, void *data)
+{
+	struct tree_desc t[2];
+	void *buf[2] = { NULL, NULL };
+	int ret = 0;
+
+	if (depth > max_allowed_tree_depth ||
+	    read_tree_gently(r, old_oid, &t[0], &buf[0]) ||
+	    read_tree_gently(r, new_oid, &t[1], &buf[1])) {
+		ret = -1;
+		goto out;
+	}
+
+	while (!ret && (t[0].size || t[1].size)) {
+		struct name_entry *e0 = &t[0].entry, *e1 = &t[1].entry;
+		int cmp;
+
+		if (!t[0].size)
+			cmp = 1;
+		else if (!t[1].size)
+			cmp = -1;
+		else
+			cmp = base_name_compare(e0->path, tree_entry_len(e0),
+						e0->mode, e1->path,
+						tree_entry_len(e1), e1->mode);
+
+		if (!cmp) {
+			if (e0->mode != e1->mode || !oideq(&e0->oid, &e1->oid))
+				ret = walk_changed_entry(r, e0, e1, base, depth,
+							 fn, data);
+			if (!ret && (update_tree_entry_gently(&t[0]) ||
+				     update_tree_entry_gently(&t[1])))
+				ret = -1;
+		} else if (cmp < 0) {
+			ret = walk_changed_entry(r, e0, NULL, base, depth,
+						 fn, data);
+			if (!ret && update_tree_entry_gently(&t[0]))
+				ret = -1;
+		} else {
+			ret = walk_changed_entry(r, NULL, e1, base, depth,
+						 fn, data);
+			if (!ret && update_tree_entry_gently(&t[1]))
+				ret = -1;
+		}
+	}
+
+out:
+	free(buf[0]);
+	free(buf[1]);
+	return ret;
+}
+
+int walk_changed_tree_entries(struct repository *r,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct strbuf *base,
+			      changed_tree_entry_fn fn, void *data)
+{
+	return walk_changed_trees(r, old_oid, new_oid, base, 0, fn, data);
+}
+
 static void entry_clear(struct name_entry *a)
 {
 	memset(a, 0, sizeof(*a));
@@ -5,6 +5,7 @@
 
 struct index_state;
 struct repository;
+struct strbuf;
 
 /**
  * The tree walking API is used to traverse and inspect trees.
@@ -118,6 +119,37 @@ typedef int (*traverse_callback_t)(int n, unsigned long mask, unsigned long dirm
  */
 int traverse_trees(struct index_state *istate, int n, struct tree_desc *t, struct traverse_info *info);
 
+/**
+ * Called by `walk_changed_tree_entries` for each entry which differs
+ * between the two trees, `old_e` or `new_e` being NULL if it was added
+ * or deleted. `base` holds the path of the directory containing it,
+ * with a trailing slash, and `depth` the number of directories above
+ * it. A non-zero return value stops the walk.
+ */
+typedef int (*changed_tree_entry_fn)(const struct name_entry *old_e,
+				     const struct name_entry *new_e,
+				     struct strbuf *base, int depth,
+				     void *data);
+
+/**
+ * Call `fn` for the entries which differ between the trees `old_oid`
+ * and `new_oid` (either may be NULL for the empty tree), descending
+ * into the subtrees which differ, like a recursive `diff_tree_oid()`
+ * without rename detection or pathspecs. Entries of different types
+ * are reported as a deletion and an addition. This only reads the trees,
+ * which is safe to do from several threads once `enable_obj_read_lock()`
+ * has been called, unlike the diff machinery.
+ *
+ * Returns the first non-zero value returned by `fn`, -1 if a tree
+ * cannot be read or if the trees are nested more than
+ * core.maxTreeDepth levels deep, or 0.
+ */
+int walk_changed_tree_entries(struct repository *r,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct strbuf *base,
+			      changed_tree_entry_fn fn, void *data);
+
 enum get_oid_result get_tree_entry_follow_symlinks(struct repository *r, struct object_id *tree_oid, const char *name, struct object_id *result, struct strbuf *result_path, unsigned short *mode);
 
 /**
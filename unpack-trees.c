@@ -427,7 +427,7 @@ static int check_updates(struct unpack_trees_options *o,
 	int errs = 0;
 	struct progress *progress;
 	struct checkout state = CHECKOUT_INIT;
-	int i, pc_workers, pc_threshold;
+	int i, pc_workers, pc_threshold, use_pc;
 
 	trace_performance_enter();
 	state.super_prefix = o->super_prefix;
@@ -479,9 +479,10 @@ static int check_updates(struct unpack_trees_options *o,
 		prefetch_cache_entries(index, must_checkout);
 
 	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	use_pc = use_parallel_checkout(pc_workers);
 
 	enable_delayed_checkout(&state);
-	if (pc_workers > 1)
+	if (use_pc)
 		init_parallel_checkout();
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
@@ -499,7 +500,7 @@ static int check_updates(struct unpack_trees_options *o,
 				display_progress(progress, ++cnt);
 		}
 	}
-	if (pc_workers > 1)
+	if (use_pc)
 		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold,
 					      progress, &cnt);
 	stop_progress(&progress);
@@ -793,6 +794,27 @@ static int index_pos_by_traverse_info(struct name_entry *names,
 	return pos;
 }
 
+/*
+ * When all trees are the same as cache-tree at a path, some merge
+ * functions are known to keep every index entry below it unchanged:
+ * twoway_merge() (cases 14 and 15, as there cannot be conflicted
+ * entries under a valid cache-tree), and oneway_merge() unless it may
+ * need to look at the worktree.  Their entries can be copied without
+ * calling the merge function at all.
+ */
+static int cache_tree_keeps_entries(int nr_names,
+				    struct unpack_trees_options *o)
+{
+	if (o->internal.debug_unpack || o->internal.merge_size != nr_names)
+		return 0;
+	if (o->fn == twoway_merge)
+		return 1;
+	if (o->fn == oneway_merge)
+		return !o->update ||
+		       (!o->reset && !should_update_submodules());
+	return 0;
+}
+
 /*
  * Fast path if we detect that all trees are the same as cache-tree at this
  * path. We'll walk these trees in an iterative loop using cache-tree/index
@@ -812,6 +834,16 @@ static int traverse_by_cache_tree(int pos, int nr_entries, int nr_names,
 	if (nr_entries + pos > o->src_index->cache_nr)
 		return error(_("corrupted cache-tree has entries not present in index"));
 
+	if (cache_tree_keeps_entries(nr_names, o)) {
+		for (i = 0; i < nr_entries; i++) {
+			struct cache_entry *ce = o->src_index->cache[pos + i];
+
+			add_entry(o, ce, 0, CE_STAGEMASK);
+			mark_ce_used(ce, o);
+		}
+		return 0;
+	}
+
 	/*
 	 * Do what unpack_callback() and unpack_single_entry() normally
 	 * do. But we walk all paths in an iterative loop instead.
@@ -32,6 +32,11 @@
 #include "write-or-die.h"
 #include "json-writer.h"
 #include "strmap.h"
+#include "pack-bitmap.h"
+#include "tag.h"
+#include "bloom.h"
+#include "hex-ll.h"
+#include "prio-queue.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -47,6 +52,22 @@
 #define ALL_FLAGS (THEY_HAVE | OUR_REF | WANTED | COMMON_KNOWN | SHALLOW | \
 		NOT_SHALLOW | CLIENT_SHALLOW | HIDDEN_REF)
 
+/*
+ * Beyond this many wants, computing one reachability bitmap per want
+ * costs more than walking saves; see ok_to_give_up_bitmap(). The bitmaps
+ * are kept compressed, so memory stays proportional to the number of
+ * runs in them rather than to the size of the repository.
+ */
+#define MAX_BITMAP_NEGOTIATION_WANTS 256
+
+/*
+ * Bounds on the work done for a "bloom-haves" summary: how many commits
+ * to walk from the wants looking for matches, and how many of them to
+ * suggest to the client.
+ */
+#define MAX_BLOOM_HAVES_WALK 10000
+#define MAX_BLOOM_CANDIDATES 256
+
 /* Enum for allowed unadvertised object request (UOR) */
 enum allow_uor {
 	/* Allow specifying sha1 if it is a ref tip. */
@@ -79,6 +100,21 @@ struct upload_pack_data {
 	int shallow_nr;
 	timestamp_t oldest_have;
 
+	/* used when uploadpack.bitmapNegotiation is set */
+	struct {
+		struct bitmap_index *bitmap_git;
+		struct ewah_bitmap **reachable;	/* per want, NULL if satisfied */
+		int nr;
+		int nr_unsatisfied;
+		struct object_array haves;	/* every commit "have" we got */
+		int haves_checked;		/* prefix of haves we looked at */
+		unsigned prepared : 1;
+		unsigned failed : 1;
+	} want_reach;
+
+	struct bloom_filter bloom_haves;			/* v2 only */
+	struct bloom_filter_settings bloom_haves_settings;	/* v2 only */
+
 	unsigned int timeout;					/* v0 only */
 	enum {
 		NO_MULTI_ACK = 0,
@@ -98,6 +134,8 @@ struct upload_pack_data {
 	struct packet_writer writer;
 
 	char *pack_objects_hook;
+	unsigned pack_objects_in_process : 1;
+	unsigned bitmap_negotiation : 1;
 
 	unsigned stateless_rpc : 1;				/* v0 only */
 	unsigned no_done : 1;					/* v0 only */
@@ -118,6 +156,7 @@ struct upload_pack_data {
 	unsigned allow_sideband_all : 1;			/* v2 only */
 	unsigned seen_haves : 1;				/* v2 only */
 	unsigned allow_packfile_uris : 1;			/* v2 only */
+	unsigned allow_bloom_haves : 1;				/* v2 only */
 	unsigned advertise_sid : 1;
 	unsigned sent_capabilities : 1;
 };
@@ -168,10 +207,23 @@ static void upload_pack_data_clear(struct upload_pack_data *data)
 	list_objects_filter_release(&data->filter_options);
 	string_list_clear(&data->allowed_filters, 0);
 	string_list_clear(&data->uri_protocols, 0);
+	for (int i = 0; i < data->want_reach.nr; i++)
+		ewah_free(data->want_reach.reachable[i]);
+	free(data->want_reach.reachable);
+	free_bitmap_index(data->want_reach.bitmap_git);
+	object_array_clear(&data->want_reach.haves);
+	free(data->bloom_haves.to_free);
 
 	free((char *)data->pack_objects_hook);
 }
 
+static upload_pack_pack_objects_fn pack_objects_fn;
+
+void upload_pack_set_pack_objects_fn(upload_pack_pack_objects_fn fn)
+{
+	pack_objects_fn = fn;
+}
+
 static void reset_timeout(unsigned int timeout)
 {
 	alarm(timeout);
@@ -281,6 +333,36 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	return readsz;
 }
 
+#ifndef GIT_WINDOWS_NATIVE
+static int run_pack_objects_in_process(int argc, const char **argv)
+{
+	/*
+	 * We inherited the flags that the negotiation left on the objects
+	 * we parsed; pack-objects expects to start from a clean slate.
+	 */
+	clear_object_flags(~0);
+	return pack_objects_fn(argc, argv, NULL, the_repository);
+}
+#endif
+
+static int start_pack_objects(struct upload_pack_data *pack_data,
+			      struct child_process *pack_objects)
+{
+#ifndef GIT_WINDOWS_NATIVE
+	/*
+	 * With a hook we have to run whatever it tells us to, and a shallow
+	 * fetch needs a pack-objects that has not seen our shallow grafts
+	 * (see the "--shallow-file" dance in create_pack_file()), so both
+	 * of these need a real subprocess.
+	 */
+	if (pack_data->pack_objects_in_process && pack_objects_fn &&
+	    !pack_data->pack_objects_hook && !pack_data->shallow_nr)
+		return start_forked_command(pack_objects,
+					    run_pack_objects_in_process);
+#endif
+	return start_command(pack_objects);
+}
+
 static void create_pack_file(struct upload_pack_data *pack_data,
 			     const struct string_list *uri_protocols)
 {
@@ -335,7 +417,7 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	pack_objects.err = -1;
 	pack_objects.clean_on_exit = 1;
 
-	if (start_command(&pack_objects))
+	if (start_pack_objects(pack_data, &pack_objects))
 		die("git upload-pack: unable to fork git-pack-objects");
 
 	pipe_fd = xfdopen(pack_objects.in, "w");
@@ -493,6 +575,8 @@ static int do_got_oid(struct upload_pack_data *data, const struct object_id *oid
 		     parents;
 		     parents = parents->next)
 			parents->item->object.flags |= THEY_HAVE;
+		if (data->bitmap_negotiation)
+			add_object_array(o, NULL, &data->want_reach.haves);
 	}
 	if (!we_knew_they_have) {
 		add_object_array(o, NULL, &data->have_obj);
@@ -512,6 +596,133 @@ static int got_oid(struct upload_pack_data *data,
 	return do_got_oid(data, oid);
 }
 
+static int prepare_want_reach(struct upload_pack_data *data)
+{
+	struct repository *r = the_repository;
+	int i;
+
+	if (data->want_obj.nr > MAX_BITMAP_NEGOTIATION_WANTS)
+		return -1;
+
+	data->want_reach.bitmap_git = prepare_bitmap_git(r);
+	if (!data->want_reach.bitmap_git)
+		return -1;
+
+	trace2_region_enter("upload-pack", "negotiate/bitmap-wants", r);
+	data->want_reach.nr = data->want_obj.nr;
+	CALLOC_ARRAY(data->want_reach.reachable, data->want_reach.nr);
+	for (i = 0; i < data->want_reach.nr; i++) {
+		struct object *o = data->want_obj.objects[i].item;
+		struct bitmap *reachable;
+
+		o = deref_tag(r, o, "a want", 0);
+		/*
+		 * Like can_all_from_reach_with_flag(), do not wait for
+		 * anything on behalf of wants that are not commits.
+		 */
+		if (!o || o->type != OBJ_COMMIT)
+			continue;
+		reachable = bitmap_reachable_from(data->want_reach.bitmap_git,
+						  (struct commit *)o);
+		if (!reachable) {
+			trace2_region_leave("upload-pack",
+					    "negotiate/bitmap-wants", r);
+			return -1;
+		}
+		/* only one of them is ever held uncompressed */
+		data->want_reach.reachable[i] = bitmap_to_ewah(reachable);
+		bitmap_free(reachable);
+		data->want_reach.nr_unsatisfied++;
+	}
+	trace2_region_leave("upload-pack", "negotiate/bitmap-wants", r);
+	return 0;
+}
+
+static void add_have_position(struct upload_pack_data *data,
+			      const struct object_id *oid,
+			      size_t **pos, size_t *nr, size_t *alloc)
+{
+	int p = bitmap_object_position(data->want_reach.bitmap_git, oid);
+
+	/* objects without a position cannot be reachable from any want */
+	if (p < 0)
+		return;
+	ALLOC_GROW(*pos, *nr + 1, *alloc);
+	(*pos)[(*nr)++] = p;
+}
+
+static int cmp_size_t(const void *va, const void *vb)
+{
+	size_t a = *(const size_t *)va, b = *(const size_t *)vb;
+
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Answer ok_to_give_up() with the reachability bitmaps of the wants:
+ * once computed, the "haves" of each round are checked against every
+ * want not yet known to share history with the client in one pass over
+ * its compressed bitmap, instead of walking from the wants again for
+ * each round. Unlike the walk, this
+ * is not cut short at the oldest "have", which only makes a difference
+ * in the presence of clock skew.
+ *
+ * Returns -1 if bitmaps cannot be used for this request.
+ */
+static int ok_to_give_up_bitmap(struct upload_pack_data *data)
+{
+	int checked = data->want_reach.haves_checked;
+	size_t *pos = NULL, nr = 0, alloc = 0;
+	int i;
+
+	if (data->want_reach.failed)
+		return -1;
+	if (!data->want_reach.prepared) {
+		data->want_reach.prepared = 1;
+		if (prepare_want_reach(data) < 0) {
+			data->want_reach.failed = 1;
+			return -1;
+		}
+	}
+
+	/*
+	 * do_got_oid() counts the parents of a have as common, too, so
+	 * look for those as well. Sorting the positions lets us test all
+	 * new haves against a want in a single pass over its compressed
+	 * bitmap.
+	 */
+	for (; data->want_reach.haves_checked < data->want_reach.haves.nr &&
+	       data->want_reach.nr_unsatisfied;
+	     data->want_reach.haves_checked++) {
+		struct commit *commit = (struct commit *)
+			data->want_reach.haves.objects[
+				data->want_reach.haves_checked].item;
+		struct commit_list *p;
+
+		add_have_position(data, &commit->object.oid, &pos, &nr, &alloc);
+		for (p = commit->parents; p; p = p->next)
+			add_have_position(data, &p->item->object.oid,
+					  &pos, &nr, &alloc);
+	}
+	QSORT(pos, nr, cmp_size_t);
+
+	for (i = 0; nr && i < data->want_reach.nr; i++) {
+		if (!data->want_reach.reachable[i] ||
+		    !ewah_bitmap_any_set(data->want_reach.reachable[i],
+					 pos, nr))
+			continue;
+		ewah_free(data->want_reach.reachable[i]);
+		data->want_reach.reachable[i] = NULL;
+		data->want_reach.nr_unsatisfied--;
+	}
+	free(pos);
+	trace2_data_intmax("upload-pack", the_repository,
+			   "negotiate/bitmap-haves-checked",
+			   data->want_reach.haves_checked - checked);
+
+	return !data->want_reach.nr_unsatisfied;
+}
+
 static int ok_to_give_up(struct upload_pack_data *data)
 {
 	timestamp_t min_generation = GENERATION_NUMBER_ZERO;
@@ -519,6 +730,12 @@ static int ok_to_give_up(struct upload_pack_data *data)
 	if (!data->have_obj.nr)
 		return 0;
 
+	if (data->bitmap_negotiation) {
+		int ret = ok_to_give_up_bitmap(data);
+		if (ret >= 0)
+			return ret;
+	}
+
 	return can_all_from_reach_with_flag(&data->want_obj, THEY_HAVE,
 					    COMMON_KNOWN, data->oldest_have,
 					    min_generation);
@@ -1385,6 +1602,12 @@ static int upload_pack_config(const char *var, const char *value,
 		data->allow_ref_in_want = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowsidebandall", var)) {
 		data->allow_sideband_all = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.allowbloomhaves", var)) {
+		data->allow_bloom_haves = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.bitmapnegotiation", var)) {
+		data->bitmap_negotiation = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packobjectsinprocess", var)) {
+		data->pack_objects_in_process = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.blobpackfileuri", var)) {
 		if (value)
 			data->allow_packfile_uris = 1;
@@ -1418,6 +1641,8 @@ static void get_upload_pack_config(struct repository *r,
 	git_protected_config(upload_pack_protected_config, data);
 
 	data->allow_sideband_all |= git_env_bool("GIT_TEST_SIDEBAND_ALL", 0);
+	data->pack_objects_in_process |=
+		git_env_bool("GIT_TEST_UPLOAD_PACK_IN_PROCESS", 0);
 }
 
 void upload_pack(const int advertise_refs, const int stateless_rpc,
@@ -1605,6 +1830,31 @@ static void trace2_fetch_info(struct upload_pack_data *data)
 	jw_release(&jw);
 }
 
+static void parse_bloom_haves(struct upload_pack_data *data, const char *arg)
+{
+	struct bloom_filter_settings settings = BLOOM_HAVES_FILTER_SETTINGS;
+	struct bloom_filter *filter = &data->bloom_haves;
+	unsigned long num_hashes;
+	char *end;
+	size_t len;
+
+	if (filter->len)
+		send_err_and_die(data, "multiple bloom-haves lines forbidden");
+
+	num_hashes = strtoul(arg, &end, 10);
+	len = *end == ' ' ? strlen(end + 1) : 0;
+	if (!num_hashes || num_hashes > 32 || !len || len % 2)
+		send_err_and_die(data, "invalid bloom-haves line");
+
+	filter->len = len / 2;
+	filter->to_free = filter->data = xmalloc(filter->len);
+	if (hex_to_bytes(filter->data, end + 1, filter->len))
+		send_err_and_die(data, "invalid bloom-haves line");
+
+	settings.num_hashes = num_hashes;
+	data->bloom_haves_settings = settings;
+}
+
 static void process_args(struct packet_reader *request,
 			 struct upload_pack_data *data)
 {
@@ -1678,6 +1928,12 @@ static void process_args(struct packet_reader *request,
 			continue;
 		}
 
+		if (data->allow_bloom_haves &&
+		    skip_prefix(arg, "bloom-haves ", &p)) {
+			parse_bloom_haves(data, p);
+			continue;
+		}
+
 		if (data->allow_packfile_uris &&
 		    skip_prefix(arg, "packfile-uris ", &p)) {
 			if (data->uri_protocols.nr)
@@ -1725,13 +1981,98 @@ static int send_acks(struct upload_pack_data *data, struct object_array *acks)
 	return 0;
 }
 
+static int bloom_haves_contain(struct upload_pack_data *data,
+			       const struct object_id *oid)
+{
+	struct bloom_key key;
+	int ret;
+
+	fill_bloom_key((const char *)oid->hash, the_hash_algo->rawsz, &key,
+		       &data->bloom_haves_settings);
+	ret = bloom_filter_contains(&data->bloom_haves, &key,
+				    &data->bloom_haves_settings);
+	clear_bloom_key(&key);
+	return ret > 0;
+}
+
+/*
+ * Walk from the wants towards older history and suggest the commits that
+ * match the client's summary as candidates for "have" lines. The history
+ * behind a match is not walked any further: if the client does have the
+ * commit, it has all of that history, too.
+ */
+static void send_bloom_candidates(struct upload_pack_data *data)
+{
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit **roots;
+	struct commit *commit;
+	int i, nr_roots = 0, walked = 0, nr = 0;
+
+	ALLOC_ARRAY(roots, data->want_obj.nr);
+	for (i = 0; i < data->want_obj.nr; i++) {
+		struct object *o = deref_tag(the_repository,
+					     data->want_obj.objects[i].item,
+					     NULL, 0);
+
+		if (!o || o->type != OBJ_COMMIT || (o->flags & TMP_MARK))
+			continue;
+		o->flags |= TMP_MARK;
+		roots[nr_roots++] = (struct commit *)o;
+		prio_queue_put(&queue, o);
+	}
+
+	trace2_region_enter("upload-pack", "negotiate/bloom-candidates",
+			    the_repository);
+	packet_writer_write(&data->writer, "bloom-candidates\n");
+	while (nr < MAX_BLOOM_CANDIDATES && walked++ < MAX_BLOOM_HAVES_WALK &&
+	       (commit = prio_queue_get(&queue))) {
+		struct commit_list *p;
+
+		/* the client told us already */
+		if (commit->object.flags & THEY_HAVE)
+			continue;
+
+		if (bloom_haves_contain(data, &commit->object.oid)) {
+			packet_writer_write(&data->writer, "%s\n",
+					    oid_to_hex(&commit->object.oid));
+			nr++;
+			continue;
+		}
+
+		if (repo_parse_commit(the_repository, commit))
+			continue;
+		for (p = commit->parents; p; p = p->next) {
+			if (p->item->object.flags & TMP_MARK)
+				continue;
+			p->item->object.flags |= TMP_MARK;
+			prio_queue_put(&queue, p->item);
+		}
+	}
+	packet_writer_delim(&data->writer);
+	trace2_data_intmax("upload-pack", the_repository,
+			   "negotiate/bloom-candidates", nr);
+	trace2_region_leave("upload-pack", "negotiate/bloom-candidates",
+			    the_repository);
+
+	clear_prio_queue(&queue);
+	clear_commit_marks_many(nr_roots, roots, TMP_MARK);
+	free(roots);
+}
+
 static int process_haves_and_send_acks(struct upload_pack_data *data)
 {
-	int ret = 0;
+	int ret;
 
-	if (data->done) {
-		ret = 1;
-	} else if (send_acks(data, &data->have_obj)) {
+	if (data->done)
+		return 1;
+
+	if (data->bloom_haves.len)
+		send_bloom_candidates(data);
+
+	trace2_region_enter("upload-pack", "negotiate/acks", the_repository);
+	trace2_data_intmax("upload-pack", the_repository,
+			   "negotiate/haves", data->have_obj.nr);
+	if (send_acks(data, &data->have_obj)) {
 		packet_writer_delim(&data->writer);
 		ret = 1;
 	} else {
@@ -1739,6 +2080,7 @@ static int process_haves_and_send_acks(struct upload_pack_data *data)
 		packet_writer_flush(&data->writer);
 		ret = 0;
 	}
+	trace2_region_leave("upload-pack", "negotiate/acks", the_repository);
 
 	return ret;
 }
@@ -1872,6 +2214,9 @@ int upload_pack_advertise(struct repository *r,
 
 		if (data.allow_packfile_uris)
 			strbuf_addstr(value, " packfile-uris");
+
+		if (data.allow_bloom_haves)
+			strbuf_addstr(value, " bloom-haves");
 	}
 
 	upload_pack_data_clear(&data);
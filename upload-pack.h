@@ -8,6 +8,17 @@ struct repository;
 struct packet_reader;
 int upload_pack_v2(struct repository *r, struct packet_reader *request);
 
+/*
+ * Register the function that implements "git pack-objects", to be used
+ * when "uploadpack.packObjectsInProcess" asks us to generate the pack
+ * without exec'ing a new program. Without it, we always spawn a separate
+ * "git pack-objects" process.
+ */
+typedef int (*upload_pack_pack_objects_fn)(int argc, const char **argv,
+					   const char *prefix,
+					   struct repository *repo);
+void upload_pack_set_pack_objects_fn(upload_pack_pack_objects_fn fn);
+
 struct strbuf;
 int upload_pack_advertise(struct repository *r,
 			  struct strbuf *value);